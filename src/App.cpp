@@ -1,6 +1,8 @@
 #include "App.h"
 
+#include <stdio.h>
 #include <algorithm>
+#include <filesystem>
 #include <memory>
 #include <fstream>
 #include <sstream>
@@ -11,12 +13,129 @@
 #include "Texture.h"
 
 #include "model.h"
+#include "model_benchmark.h"
 #include "buffer_graphics.h"
 #include "util/MSS.h"
 #include "util/AutoGui.h"
 #include "util/KeyListener.h"
 
-App::App(ID3D11Device *dx11_device, ID3D11DeviceContext *dx11_context)
+static const char *MODEL_BONUSES_FILEPATH = "assets/models/bonuses.tflite";
+static const char *MODEL_CHARACTERS_FILEPATH = "assets/models/characters.tflite";
+static const char *MODEL_VALUES_FILEPATH = "assets/models/two_digit_classifier.tflite";
+// fastest configuration of each model per processor, written on the first launch
+static const char *MODEL_TUNING_FILEPATH = "model_tuning.txt";
+// outputs of the crops each model has read, kept between launches with --persist-crop-cache
+static const char *CROP_CACHE_DIRECTORY = "crop_cache";
+static const size_t CROP_CACHE_MAX_ENTRIES = 256;
+
+// batched kernels can round differently, but only by a couple of steps of an 8 bit score
+constexpr float MAX_BATCH_PARITY_ERROR = 1e-2f;
+
+// crops are the size of the default croppers, in a batch of a 4x4 grid split between a few interpreters
+// which goes through the same direct tensor copies and interpreter pool as a read
+template <typename T>
+static bool CheckModelBatches(
+    const char *filepath, const ModelEngine engine,
+    const int crop_width, const int crop_height, const int total_crops)
+{
+    T model(filepath, engine);
+    T reference(filepath, engine);
+    ModelBenchmarkConfig config;
+    config.batch_size = 16;
+    config.total_interpreters = 4;
+    const auto check = CheckModelBatchParity(model, reference, config, crop_width, crop_height, total_crops);
+    const auto &parity = check.parity;
+    printf("%s (%s, batch %d on %d interpreters%s): max_error=%.2e, mismatches=%d/%d\n",
+        filepath, GetModelEngineName(engine), check.batch_size, check.total_interpreters,
+        check.is_batched ? "" : ", not batched",
+        parity.max_error, parity.total_mismatches, parity.total_crops);
+    return (parity.total_mismatches == 0) && (parity.max_error <= MAX_BATCH_PARITY_ERROR);
+}
+
+void CheckModelEngines(const int total_crops) {
+    if (IsModelEngineAvailable(MODEL_ENGINE_TFLITE)) {
+        for (auto filepath: {MODEL_BONUSES_FILEPATH, MODEL_CHARACTERS_FILEPATH, MODEL_VALUES_FILEPATH}) {
+            auto tflite = LoadModelBackend(filepath, MODEL_ENGINE_TFLITE);
+            auto builtin = LoadModelBackend(filepath, MODEL_ENGINE_BUILTIN);
+            const auto parity = CheckModelParity(*tflite, *builtin, total_crops);
+            printf("%s: max_error=%.2e, mismatches=%d/%d\n",
+                filepath, parity.max_error, parity.total_mismatches, parity.total_crops);
+        }
+    } else {
+        printf("Only the builtin model engine is available\n");
+    }
+
+    int total_failed = 0;
+    for (auto engine: {MODEL_ENGINE_TFLITE, MODEL_ENGINE_BUILTIN}) {
+        if (!IsModelEngineAvailable(engine)) {
+            continue;
+        }
+        total_failed += CheckModelBatches<BonusesModel>(MODEL_BONUSES_FILEPATH, engine, 23, 17, total_crops) ? 0 : 1;
+        total_failed += CheckModelBatches<CharacterModel>(MODEL_CHARACTERS_FILEPATH, engine, 40, 40, total_crops) ? 0 : 1;
+        total_failed += CheckModelBatches<ValuesModel>(MODEL_VALUES_FILEPATH, engine, 20, 16, total_crops) ? 0 : 1;
+    }
+    if (total_failed > 0) {
+        throw std::runtime_error(fmt::format(
+            "Batched reads of {} models differ from reading one crop at a time", total_failed));
+    }
+}
+
+// uses the stored configuration of the model for this processor, and tunes it on a synthetic crop
+// of the cropper size when there is none or the model file has changed since it was tuned
+template <typename T>
+static std::unique_ptr<T> CreateTunedModel(
+    const char *filepath, const GridCropper &cropper, const int total_crops,
+    const AppModelOptions &options, ModelTuning &tuning, ModelTuning::Entry &entry)
+{
+    entry.cpu = GetCpuName();
+    entry.model = filepath;
+    entry.model_hash = GetFileHash(filepath);
+    const bool is_found = 
+        !options.is_retuning && 
+        tuning.Find(entry.cpu, entry.model, entry.model_hash, entry.result) &&
+        (!options.is_engine_forced || (entry.result.config.engine == options.engine));
+    if (!is_found) {
+        ModelTuneParams params;
+        if (options.is_engine_forced) {
+            params.engines = {options.engine};
+        } else {
+            for (auto engine: {MODEL_ENGINE_TFLITE, MODEL_ENGINE_BUILTIN}) {
+                if (IsModelEngineAvailable(engine)) {
+                    params.engines.push_back(engine);
+                }
+            }
+        }
+        params.total_crops = total_crops;
+        // the threads are shared by all three models
+        params.max_interpreters = std::max(1, static_cast<int>(std::thread::hardware_concurrency()+2) / 3);
+        params.crop_width = cropper.size.x;
+        params.crop_height = cropper.size.y;
+        entry.result = TuneModel(
+            [filepath](const ModelEngine engine) -> std::unique_ptr<Model> {
+                return std::make_unique<T>(filepath, engine);
+            },
+            params);
+        if (!options.is_engine_forced) {
+            tuning.Set(entry.cpu, entry.model, entry.model_hash, entry.result);
+        }
+    }
+    return std::make_unique<T>(filepath, entry.result.config.engine);
+}
+
+// the cache file is named after the model and only loaded if it was written for the same model file
+static std::unique_ptr<CropCache> CreateCropCache(const char *filepath, const Model &model, const bool is_persisting) {
+    if (!is_persisting) {
+        return std::make_unique<CropCache>(CROP_CACHE_MAX_ENTRIES, model.GetOutputBytes());
+    }
+    std::filesystem::create_directories(CROP_CACHE_DIRECTORY);
+    const auto cache_filepath = fmt::format(
+        "{}/{}.bin", CROP_CACHE_DIRECTORY, std::filesystem::path(filepath).stem().string());
+    return std::make_unique<CropCache>(
+        CROP_CACHE_MAX_ENTRIES, model.GetOutputBytes(), 
+        cache_filepath.c_str(), GetFileHash(filepath));
+}
+
+App::App(ID3D11Device *dx11_device, ID3D11DeviceContext *dx11_context, const AppModelOptions &model_options)
 : m_dx11_device(dx11_device), 
   m_dx11_context(dx11_context)
 {
@@ -26,20 +145,14 @@ App::App(ID3D11Device *dx11_device, ID3D11DeviceContext *dx11_context)
     m_is_tracing = false;
     m_is_tracer_thread_alive = true;
     m_tracer_speed_ms = 33;
+    m_is_planning = false;
+    m_total_planned = 0;
     m_tracer_thread = std::make_unique<std::thread>([this]() {
         this->TracerThread();
     });
 
     m_mss = std::make_shared<util::MSS>();
     m_params = std::make_shared<AppParams>(4);
-    {
-        auto model_bonuses      = std::make_unique<BonusesModel>    ("assets/models/bonuses.tflite");
-        auto model_characters   = std::make_unique<CharacterModel>  ("assets/models/characters.tflite");
-        auto model_values       = std::make_unique<ValuesModel>     ("assets/models/two_digit_classifier.tflite");
-        m_model = std::make_shared<UnifiedModel>(
-            model_bonuses, model_characters, model_values, 
-            m_params);
-    }
     {
         std::ifstream fp;
         fp.open("assets/dicts/en.txt", std::ios::binary);
@@ -53,6 +166,8 @@ App::App(ID3D11Device *dx11_device, ID3D11DeviceContext *dx11_context)
         const auto &buf = ss.str();
 
         wordtree::ReadWordTree(buf.c_str(), static_cast<int>(buf.length()), m_node_pool, 20);
+        m_solver = std::make_unique<wordblitz::IncrementalSolver>(m_node_pool);
+        m_solve_cache = std::make_unique<wordblitz::SolveCache>(256);
     }
     {
         m_params->cropper_bonuses = {
@@ -72,6 +187,42 @@ App::App(ID3D11Device *dx11_device, ID3D11DeviceContext *dx11_context)
         };
         m_params->inter_buffer_size = {433,433};
     }
+    {
+        // the models are tuned for crops of the cropper sizes
+        ModelTuning tuning(MODEL_TUNING_FILEPATH);
+        const int total_cells = m_params->grid.size;
+        m_model_tunings.resize(3);
+        auto model_bonuses = CreateTunedModel<BonusesModel>(
+            MODEL_BONUSES_FILEPATH, m_params->cropper_bonuses, total_cells, 
+            model_options, tuning, m_model_tunings[0]);
+        auto model_characters = CreateTunedModel<CharacterModel>(
+            MODEL_CHARACTERS_FILEPATH, m_params->cropper_characters, total_cells, 
+            model_options, tuning, m_model_tunings[1]);
+        auto model_values = CreateTunedModel<ValuesModel>(
+            MODEL_VALUES_FILEPATH, m_params->cropper_values, total_cells, 
+            model_options, tuning, m_model_tunings[2]);
+        // the bot still runs with the tuned models when the file can't be written
+        if (!model_options.is_engine_forced) {
+            try {
+                tuning.Save();
+            } catch (std::exception &ex) {
+                m_errors.push_back(ex.what());
+            }
+        }
+        m_model = std::make_shared<UnifiedModel>(
+            model_bonuses, model_characters, model_values, 
+            m_params);
+        m_model->SetModelConfigs(
+            m_model_tunings[0].result.config, 
+            m_model_tunings[1].result.config, 
+            m_model_tunings[2].result.config);
+
+        const bool is_persisting = model_options.is_persisting_crops;
+        auto crops_bonuses = CreateCropCache(MODEL_BONUSES_FILEPATH, *m_model->m_model_bonuses, is_persisting);
+        auto crops_characters = CreateCropCache(MODEL_CHARACTERS_FILEPATH, *m_model->m_model_characters, is_persisting);
+        auto crops_values = CreateCropCache(MODEL_VALUES_FILEPATH, *m_model->m_model_values, is_persisting);
+        m_model->SetCropCaches(crops_bonuses, crops_characters, crops_values);
+    }
 
     // setup screen shotter
     m_capture_position = {463,558};
@@ -110,6 +261,17 @@ App::~App() {
     m_is_tracer_thread_alive = false;
     m_is_tracing = false;
     m_tracer_thread->join();
+
+    // caches without a file aren't written
+    try {
+        for (auto &cache: {&m_model->m_crops_bonuses, &m_model->m_crops_characters, &m_model->m_crops_values}) {
+            if (*cache != nullptr) {
+                (*cache)->Save();
+            }
+        }
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+    }
 }
 
 void App::Update() {
@@ -121,10 +283,47 @@ void App::Update() {
 
 void App::UpdateTraces() {
     auto &grid = m_params->grid;
+    const bool is_bounded = 
+        (m_search_limits.max_results > 0) || 
+        (m_search_limits.time_budget.count() > 0);
     try {
-        auto searches = wordblitz::SearchWordTree(m_node_pool, grid.characters, grid.sqrt_size);
+        wordblitz::ResetSearchStats();
+        // filled in the back buffer and swapped in, so the buffers of both are reused every round
+        auto &traces = m_next_traces;
+        // every equally good path of each word, so the planner can pick the one with the least travel
+        // planning and the lattice search allocate their results every round, unlike the cached and incremental solves
+        std::vector<wordblitz::TraceResult> candidates;
+        if (m_params->total_letter_candidates > 1) {
+            // ambiguous letters change the words themselves, so the cache and incremental solver don't apply
+            auto searches = wordblitz::SearchWordTreeLattice(
+                m_node_pool, grid, m_params->lattice, m_params->min_confidence);
+            traces = wordblitz::GetTraceFromSearch(searches);
+            if (m_is_planning) {
+                candidates = wordblitz::GetTraceCandidates(searches);
+            }
+        } else if (is_bounded) {
+            traces = wordblitz::SearchWordTreeTopK(m_node_pool, grid, m_search_limits);
+        } else if (!m_solve_cache->Find(grid, traces)) {
+            // only redo the parts of the search affected by corrected cells
+            m_solver->Update(grid);
+            m_solver->GetTraces(traces);
+            m_solve_cache->Insert(grid, traces);
+            if (m_is_planning) {
+                candidates = wordblitz::GetTraceCandidates(m_solver->GetResults());
+            }
+        }
+
+        int total_planned = static_cast<int>(traces.size());
+        if (m_is_planning) {
+            auto plan = m_trace_plan;
+            plan.cell_ms = m_tracer_speed_ms;
+            traces = wordblitz::PlanTraces(candidates.empty() ? traces : candidates, plan, &total_planned);
+        }
+
         auto lock = std::unique_lock(m_traces_mutex);
-        m_traces = wordblitz::GetTraceFromSearch(grid, searches);
+        std::swap(m_traces, traces);
+        m_total_planned = total_planned;
+        m_search_stats = wordblitz::GetSearchStats();
     } catch (std::exception &ex) {
         m_errors.push_back(fmt::format(
             "Error when tracing: {}", 
@@ -204,8 +403,8 @@ void App::UpdateScreenshotTexture() {
         GridCropper &cropper, wordblitz::Grid &grid,
         const RGBA<uint8_t> &pen_color, const int pen_width=1)
     {
-        for (int x = 0; x < grid.sqrt_size; x++) {
-            for (int y = 0; y < grid.sqrt_size; y++) {
+        for (int x = 0; x < grid.width; x++) {
+            for (int y = 0; y < grid.height; y++) {
                 const int i = grid.GetIndex(x, y);
                 auto &cell = grid.GetCell(i);
 
@@ -244,6 +443,10 @@ void App::UpdateScreenshotTexture() {
         characters_color);
 }
 
+void App::SetIsModelViewOpen(const bool v) {
+    m_model->m_model_characters->SetIsKeepingResize(v);
+}
+
 void App::UpdateModelTexture() {
     auto &m = m_model->m_model_characters;
     auto buffer_size = m->GetInputSize();
@@ -12,13 +12,34 @@
 
 #include "Texture.h"
 #include "util/MSS.h"
+#include "model_backend.h"
+#include "model_tuner.h"
 #include "unified_model.h"
 #include "wordblitz.h"
 #include "wordtree.h"
+#include "incremental_solver.h"
+#include "solve_cache.h"
+#include "trace_planner.h"
 #include "buffer_graphics.h"
 
 typedef std::list<std::string> ErrorList;
 
+// how the recognition models are picked at startup
+struct AppModelOptions {
+    // only this engine is tuned and used, and the tuning isn't saved
+    bool is_engine_forced = false;
+    ModelEngine engine = GetDefaultModelEngine();
+    // tunes every model again even if this processor was already tuned
+    bool is_retuning = false;
+    // crop caches are loaded at startup and written on exit
+    bool is_persisting_crops = false;
+};
+
+// runs random crops through every model with both engines and prints how far apart they are
+// then reads crops of every model in batches across interpreters with each engine, against one crop at a time
+// throws if a batched read doesn't match
+void CheckModelEngines(const int total_crops=256);
+
 class App
 {
 private:
@@ -34,17 +55,29 @@ private:
     ID3D11Device *m_dx11_device; 
     ID3D11DeviceContext *m_dx11_context;
     wordtree::NodePool m_node_pool; 
+    std::unique_ptr<wordblitz::IncrementalSolver> m_solver;
+    std::unique_ptr<wordblitz::SolveCache> m_solve_cache;
     std::shared_ptr<UnifiedModel> m_model;
     std::shared_ptr<util::MSS> m_mss;
     std::shared_ptr<AppParams> m_params;
+    // configuration of bonuses, characters and values on this processor
+    std::vector<ModelTuning::Entry> m_model_tunings;
 
     // traces
     std::vector<wordblitz::TraceResult> m_traces;
+    std::vector<wordblitz::TraceResult> m_next_traces;
     std::shared_mutex m_traces_mutex;
     bool m_is_tracing;
     bool m_is_tracer_thread_alive;
     int m_tracer_speed_ms;
     std::unique_ptr<std::thread> m_tracer_thread;
+    wordblitz::SearchLimits m_search_limits;
+    // counters of the last solve, only collected with WORDBLITZ_SEARCH_STATS
+    wordblitz::SearchStats m_search_stats;
+    // picks and orders the traces for the time left in the round
+    bool m_is_planning;
+    wordblitz::TracePlan m_trace_plan;
+    int m_total_planned;
     
     Position m_capture_position;
     std::unique_ptr<Texture> m_screenshot_texture;
@@ -57,7 +90,7 @@ private:
     bool m_is_grabbing;
     ErrorList m_errors;
 public:
-    App(ID3D11Device *dx11_device, ID3D11DeviceContext *dx11_context);
+    App(ID3D11Device *dx11_device, ID3D11DeviceContext *dx11_context, const AppModelOptions &model_options=AppModelOptions());
     ~App();
     void Update();
     void UpdateTraces();
@@ -83,14 +116,27 @@ public:
     inline Position& GetCapturePosition() { return m_capture_position; }
 
     inline Texture& GetModelTexture() { return *m_resize_texture; }
+    void SetIsModelViewOpen(const bool v);
 
     inline std::vector<wordblitz::TraceResult>& GetTraces() { return m_traces; }
     std::shared_mutex &GetTraceMutex() { return m_traces_mutex; }
     inline int GetTracerSpeedMillis() const { return m_tracer_speed_ms; }
     inline void SetTracerSpeedMillis(const int v) { m_tracer_speed_ms = v; }
+    inline wordblitz::SearchLimits& GetSearchLimits() { return m_search_limits; }
+    inline const wordblitz::SearchStats& GetSearchStats() const { return m_search_stats; }
+    inline bool GetIsPlanning() const { return m_is_planning; }
+    inline void SetIsPlanning(const bool v) { m_is_planning = v; }
+    inline wordblitz::TracePlan& GetTracePlan() { return m_trace_plan; }
+    inline int GetTotalPlanned() const { return m_total_planned; }
     inline bool GetIsTracing() const { return m_is_tracing; }
     inline void SetIsTracing(const bool v) { m_is_tracing = v; }
 
+    inline const std::vector<ModelTuning::Entry>& GetModelTunings() const { return m_model_tunings; }
+    inline UnifiedModel& GetModel() { return *m_model; }
+
+    inline wordblitz::IncrementalSolver& GetSolver() { return *m_solver; }
+    inline wordblitz::SolveCache& GetSolveCache() { return *m_solve_cache; }
+
     inline int GetNodePoolSize() { 
         return static_cast<int>(m_node_pool.size()); 
     }
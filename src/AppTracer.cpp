@@ -36,6 +36,10 @@ void App::TracerThread() {
                 if (trace.status == wordblitz::TraceStatus::COMPLETE) {
                     continue;
                 }
+                // unsure words wait until the letters are recognized with more confidence
+                if (trace.confidence < m_params->min_trace_confidence) {
+                    continue;
+                }
                 // if trace is incomplete or in progress, we continue off with it
                 const int path_length = static_cast<int>(trace.path.size());
                 int curr_length = 0;
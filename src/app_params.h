@@ -21,6 +21,25 @@ struct AppParams {
     GridCropper cropper_characters;
     Vec2D inter_buffer_size;
     wordblitz::Grid grid;
+    // candidate letters of each cell when the recognizer keeps more than one
+    wordblitz::LetterLattice lattice;
+    int total_letter_candidates = 1;
+    // words below this confidence aren't searched for
+    float min_confidence = 0.05f;
+    // words below this confidence are listed but not traced
+    float min_trace_confidence = 0.5f;
+    // threads which run the models when reading the screen, 0 uses the tuned interpreters of each model
+    int total_read_threads = 0;
+    // crops which were already read are decoded from the cached outputs of their model instead of being run
+    bool is_caching_crops = true;
+    // largest difference of a thumbnail byte for a crop to match a cached one, 0 only matches the same thumbnail
+    int crop_cache_tolerance = 4;
+    // bonuses are told apart by the colour statistics of their crop, and only the crops too close to call are run by the model
+    bool is_classifying_bonus_colours = true;
+    // smallest margin between the nearest and second nearest colour prototype to skip the model
+    float bonus_colour_margin = 0.5f;
+    // every this many confident bonuses is also run by the model to check they agree, 0 never checks
+    int bonus_colour_audit_interval = 32;
 
     AppParams(const int _sqrt_grid_size)
     : sqrt_grid_size(_sqrt_grid_size),
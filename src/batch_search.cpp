@@ -0,0 +1,268 @@
+#include "batch_search.h"
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace wordtree;
+
+namespace wordblitz {
+
+typedef uint64_t CellMask;
+
+// index of the lowest set bit, which is then cleared
+template <typename T>
+static int PopLowestBit(T &mask) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, static_cast<uint64_t>(mask));
+#else
+    const int i = __builtin_ctzll(static_cast<uint64_t>(mask));
+#endif
+    mask &= mask-1;
+    return static_cast<int>(i);
+}
+
+// per board lookup tables as bitboards
+struct BatchBoard {
+    int width;
+    int traces_index;
+    CellMask neighbours[MAX_BATCH_CELLS];
+    CellMask letter_cells[MAX_BRANCHES];
+    uint32_t neighbour_letters[MAX_BATCH_CELLS];
+    int letter_scores[MAX_BATCH_CELLS];
+    int word_multipliers[MAX_BATCH_CELLS];
+};
+
+// live paths of every board which spell the prefix of the current node
+// one lane per path, stored as a structure of arrays so each pass over the lanes is a linear scan
+struct LaneLevel {
+    std::vector<uint32_t> board;
+    std::vector<uint8_t> cell;
+    std::vector<CellMask> visited;
+    std::vector<int> letter_sum;
+    std::vector<int> word_multiplier;
+    // lane in the previous level which this path extends
+    std::vector<uint32_t> parent;
+
+    void Clear() {
+        board.clear();
+        cell.clear();
+        visited.clear();
+        letter_sum.clear();
+        word_multiplier.clear();
+        parent.clear();
+    }
+
+    void Push(
+        const uint32_t _board, const uint8_t _cell, const CellMask _visited,
+        const int _letter_sum, const int _word_multiplier, const uint32_t _parent)
+    {
+        board.push_back(_board);
+        cell.push_back(_cell);
+        visited.push_back(_visited);
+        letter_sum.push_back(_letter_sum);
+        word_multiplier.push_back(_word_multiplier);
+        parent.push_back(_parent);
+    }
+
+    size_t Size() const {
+        return board.size();
+    }
+};
+
+// lanes of a depth are bucketed by the letter they moved onto
+typedef std::array<LaneLevel, MAX_BRANCHES> LaneBuckets;
+
+// state shared by every level of the batch search
+struct BatchSearch {
+    NodePool &pool;
+    std::vector<BatchBoard> &boards;
+    std::vector<LaneBuckets> levels;
+    std::vector<char> word_stack;
+    std::vector<std::vector<TraceResult>> &traces;
+};
+
+static void CreateBatchBoard(const Grid &grid, const int traces_index, BatchBoard &board) {
+    const ScoreTable scores = CreateScoreTable(grid);
+    const BoardMasks masks = CreateBoardMasks(grid);
+    auto &topology = grid.topology;
+
+    board.width = grid.width;
+    board.traces_index = traces_index;
+    for (auto &cells: board.letter_cells) {
+        cells = 0;
+    }
+    for (int i = 0; i < grid.size; i++) {
+        CellMask neighbours = 0;
+        for (int j = topology.offsets[i]; j < topology.offsets[i+1]; j++) {
+            neighbours |= (CellMask(1) << topology.adjacency[j]);
+        }
+        board.neighbours[i] = neighbours;
+        board.letter_cells[masks.letters[i]] |= (CellMask(1) << i);
+        board.neighbour_letters[i] = masks.neighbour_letters[i];
+        board.letter_scores[i] = scores.letter_scores[i];
+        board.word_multipliers[i] = scores.word_multipliers[i];
+    }
+}
+
+// lanes spelling the prefix which ends at this depth
+static const LaneLevel& GetLaneLevel(const BatchSearch &s, const int depth) {
+    return s.levels[depth][s.word_stack[depth] - 'a'];
+}
+
+// every lane at this depth has spelt a word
+// lanes stay sorted by board, so each board keeps its best path out of a run of lanes
+static void PushBatchTraces(BatchSearch &s, const int depth) {
+    const auto &level = GetLaneLevel(s, depth);
+    const int length = depth+1;
+    const uint32_t total_lanes = static_cast<uint32_t>(level.Size());
+    uint32_t k = 0;
+    while (k < total_lanes) {
+        const uint32_t b = level.board[k];
+        uint32_t best_lane = k;
+        int best_value = level.word_multiplier[k]*level.letter_sum[k];
+        for (k++; (k < total_lanes) && (level.board[k] == b); k++) {
+            const int value = level.word_multiplier[k]*level.letter_sum[k];
+            if (value > best_value) {
+                best_value = value;
+                best_lane = k;
+            }
+        }
+
+        const auto &board = s.boards[b];
+        TraceResult trace;
+        trace.word.assign(s.word_stack.data(), s.word_stack.data()+length);
+        trace.value = best_value + length;
+        trace.status = TraceStatus::INCOMPLETE;
+        trace.path.resize(length);
+        // follow the parent lanes back to the first letter
+        uint32_t lane = best_lane;
+        for (int d = depth; d >= 0; d--) {
+            const auto &parent_level = GetLaneLevel(s, d);
+            const int cell = parent_level.cell[lane];
+            trace.path[d] = {cell % board.width, cell / board.width};
+            lane = parent_level.parent[lane];
+        }
+        s.traces[board.traces_index].emplace_back(std::move(trace));
+    }
+}
+
+static void RecursiveSearchWordTreeBatch(BatchSearch &s, const Node &node, const int depth) {
+    if (node.is_leaf) {
+        PushBatchTraces(s, depth);
+    }
+
+    // move every lane onto its neighbours which continue a word
+    const auto &level = GetLaneLevel(s, depth);
+    auto &next_levels = s.levels[depth+1];
+    uint32_t next_letters = 0;
+    for (uint32_t k = 0; k < static_cast<uint32_t>(level.Size()); k++) {
+        const auto &board = s.boards[level.board[k]];
+        const int cell = level.cell[k];
+        const CellMask candidates = board.neighbours[cell] & ~level.visited[k];
+        uint32_t letters = board.neighbour_letters[cell] & node.child_mask;
+        while (letters) {
+            const int letter = PopLowestBit(letters);
+            CellMask cells = candidates & board.letter_cells[letter];
+            if (cells == 0) {
+                continue;
+            }
+            auto &next_level = next_levels[letter];
+            // buckets are cleared lazily on their first use at this node
+            if (((next_letters >> letter) & 1u) == 0) {
+                next_letters |= (1u << letter);
+                next_level.Clear();
+            }
+            while (cells) {
+                const int next_cell = PopLowestBit(cells);
+                next_level.Push(
+                    level.board[k], static_cast<uint8_t>(next_cell),
+                    level.visited[k] | (CellMask(1) << next_cell),
+                    level.letter_sum[k] + board.letter_scores[next_cell],
+                    level.word_multiplier[k] * board.word_multipliers[next_cell],
+                    k);
+            }
+        }
+    }
+
+    // letters without lanes are branches where every board has backtracked
+    while (next_letters) {
+        const int letter = PopLowestBit(next_letters);
+        s.word_stack[depth+1] = static_cast<char>('a' + letter);
+        RecursiveSearchWordTreeBatch(s, s.pool[node.children[letter]], depth+1);
+    }
+}
+
+void SearchWordTreeBatch(
+    NodePool &pool, const std::vector<const Grid*> &grids,
+    std::vector<std::vector<TraceResult>> &traces)
+{
+    traces.clear();
+    traces.resize(grids.size());
+
+    std::vector<BatchBoard> boards;
+    boards.reserve(grids.size());
+    for (size_t i = 0; i < grids.size(); i++) {
+        const Grid &grid = *grids[i];
+        if (grid.size > MAX_BATCH_CELLS) {
+            auto searches = SearchWordTree(pool, grid);
+            traces[i] = GetTraceFromSearch(searches);
+            continue;
+        }
+        boards.emplace_back();
+        CreateBatchBoard(grid, static_cast<int>(i), boards.back());
+    }
+
+    if (boards.empty()) {
+        return;
+    }
+
+    int max_size = 0;
+    for (auto *grid: grids) {
+        max_size = std::max(max_size, grid->size);
+    }
+    const int max_length = std::min(GetMaxWordLength(pool), max_size);
+    BatchSearch s = {
+        pool, boards,
+        std::vector<LaneBuckets>(max_length+1),
+        std::vector<char>(max_length+1, 0),
+        traces
+    };
+
+    // the first level holds every cell of every board, bucketed by its letter
+    auto &first_levels = s.levels[0];
+    for (uint32_t b = 0; b < static_cast<uint32_t>(boards.size()); b++) {
+        const auto &board = boards[b];
+        for (int letter = 0; letter < MAX_BRANCHES; letter++) {
+            CellMask cells = board.letter_cells[letter];
+            while (cells) {
+                const int cell = PopLowestBit(cells);
+                first_levels[letter].Push(
+                    b, static_cast<uint8_t>(cell), CellMask(1) << cell,
+                    board.letter_scores[cell], board.word_multipliers[cell], 0);
+            }
+        }
+    }
+
+    const Node &root = pool[0];
+    for (int letter = 0; letter < MAX_BRANCHES; letter++) {
+        if ((first_levels[letter].Size() == 0) || (((root.child_mask >> letter) & 1u) == 0)) {
+            continue;
+        }
+        s.word_stack[0] = static_cast<char>('a' + letter);
+        RecursiveSearchWordTreeBatch(s, pool[root.children[letter]], 0);
+    }
+
+    for (auto &board: boards) {
+        auto &board_traces = traces[board.traces_index];
+        std::sort(board_traces.begin(), board_traces.end(), [](const TraceResult &a, const TraceResult &b) {
+            return a.value > b.value;
+        });
+    }
+}
+
+}
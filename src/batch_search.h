@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include "wordtree.h"
+#include "wordblitz.h"
+
+namespace wordblitz {
+
+// boards with more cells than this are solved one at a time
+constexpr int MAX_BATCH_CELLS = 64;
+
+// solves several boards in lockstep by walking the word tree once for all of them
+// each dictionary node is fetched once for all the boards which have a path spelling its prefix
+// and a subtree is skipped as soon as no board can extend the prefix
+// traces[i] holds the value sorted traces of grids[i] like GetTraceFromSearch
+// all paths of a word are found together, so the best path is kept without a lookup on the word
+void SearchWordTreeBatch(
+    wordtree::NodePool &pool, const std::vector<const Grid*> &grids,
+    std::vector<std::vector<TraceResult>> &traces);
+
+}
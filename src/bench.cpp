@@ -0,0 +1,692 @@
+// Word engine benchmark
+// Measures loading the dictionary, word lookups, the search latency and the cost of turning
+// search results into traces, then compares the word tree search against the word first
+// signature search and the lockstep batch search over a few distributions of random boards
+// and checks that they agree
+//
+// Real boards can be added with --input, which takes the same text format as solve
+//     <letters> [values] [modifiers]
+// and --json writes every result as a single json object so runs can be compared
+//
+// --check-allocations replays the read, solve and trace cycle of the bot instead, and fails
+// if any round allocates once the buffers have grown to fit every board
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "wordtree.h"
+#include "wordblitz.h"
+#include "word_signatures.h"
+#include "batch_search.h"
+#include "incremental_solver.h"
+#include "board_input.h"
+#include "solve_cache.h"
+
+// every allocation of the program goes through here, and is counted while checking allocations
+static std::atomic<bool> g_is_counting_allocations{false};
+static std::atomic<size_t> g_total_allocations{0};
+
+// allocating and freeing aren't inlined into the operators, otherwise the compiler pairs the
+// malloc of an inlined new with the free of an inlined delete and warns they are mismatched
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE static void *AllocateCounted(const size_t size) noexcept {
+    if (g_is_counting_allocations.load(std::memory_order_relaxed)) {
+        g_total_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return malloc((size > 0) ? size : 1);
+}
+
+BENCH_NOINLINE static void FreeCounted(void *ptr) noexcept {
+    free(ptr);
+}
+
+static void *AllocateOrThrow(const size_t size) {
+    void *ptr = AllocateCounted(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(size_t size) { return AllocateOrThrow(size); }
+void *operator new[](size_t size) { return AllocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t&) noexcept { return AllocateCounted(size); }
+void *operator new[](size_t size, const std::nothrow_t&) noexcept { return AllocateCounted(size); }
+
+void operator delete(void *ptr) noexcept { FreeCounted(ptr); }
+void operator delete[](void *ptr) noexcept { FreeCounted(ptr); }
+void operator delete(void *ptr, size_t) noexcept { FreeCounted(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { FreeCounted(ptr); }
+void operator delete(void *ptr, const std::nothrow_t&) noexcept { FreeCounted(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept { FreeCounted(ptr); }
+
+struct BenchParams {
+    const char *dict_filepath = "assets/dicts/en.txt";
+    const char *boards_filepath = nullptr;
+    const char *json_filepath = nullptr;
+    int total_boards = 200;
+    int total_loads = 5;
+    uint32_t seed = 1234;
+    bool is_checking_allocations = false;
+};
+
+// boards are filled from an alphabet weighted by english letter frequencies
+// total_letters > 0 restricts the board to that many distinct letters
+struct BoardDistribution {
+    const char *name;
+    wordblitz::TopologyType topology;
+    int width;
+    int height;
+    int total_letters;
+};
+
+const BoardDistribution BOARD_DISTRIBUTIONS[] = {
+    {"grid 4x4",            wordblitz::TopologyType::TOPOLOGY_GRID,  4, 4, 0},
+    {"grid 4x4 8 letters",  wordblitz::TopologyType::TOPOLOGY_GRID,  4, 4, 8},
+    {"grid 4x4 5 letters",  wordblitz::TopologyType::TOPOLOGY_GRID,  4, 4, 5},
+    {"grid 4x4 3 letters",  wordblitz::TopologyType::TOPOLOGY_GRID,  4, 4, 3},
+    {"grid 5x5",            wordblitz::TopologyType::TOPOLOGY_GRID,  5, 5, 0},
+    {"grid 6x6 6 letters",  wordblitz::TopologyType::TOPOLOGY_GRID,  6, 6, 6},
+    {"grid 8x8",            wordblitz::TopologyType::TOPOLOGY_GRID,  8, 8, 0},
+    {"torus 5x5",           wordblitz::TopologyType::TOPOLOGY_TORUS, 5, 5, 0},
+    {"hex 6x6",             wordblitz::TopologyType::TOPOLOGY_HEX,   6, 6, 0},
+};
+
+// rounds of timing every engine over the same boards
+constexpr int TOTAL_ENGINE_ROUNDS = 3;
+
+constexpr const char *LETTER_FREQUENCIES =
+    "eeeeeeeeeeeeaaaaaaaaaiiiiiiiiioooooooonnnnnnrrrrrrttttttllllssssuuuuddddgggbbccmmppffhhvvwwyykjxqz";
+
+typedef std::vector<std::unique_ptr<wordblitz::Grid>> BoardList;
+
+struct LatencySummary {
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+struct DictionaryResults {
+    int total_nodes;
+    size_t memory_bytes;
+    size_t capacity_bytes;
+    double load_ms;
+    int total_words;
+    // lookups per second of dictionary words and of words with their last letter changed
+    double hit_lookups_per_second;
+    double miss_lookups_per_second;
+};
+
+struct BoardResults {
+    std::string name;
+    int total_boards;
+    LatencySummary search_us;
+    double trace_us;
+    double paths_per_board;
+    double words_per_board;
+    double tree_us;
+    double signature_us;
+    double auto_us;
+    double auto_signature_percent;
+    double batch_us;
+};
+
+static void PrintUsage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -d, --dict <file>       Dictionary (default: assets/dicts/en.txt)\n"
+        "  -i, --input <file>      Real boards to add to the random ones, in the solve input format\n"
+        "  -j, --json <file>       Write the results as json\n"
+        "  -n, --boards <n>        Number of boards per distribution (default: 200)\n"
+        "  -l, --loads <n>         Number of dictionary loads to time (default: 5)\n"
+        "  -s, --seed <n>          Seed for the random boards (default: 1234)\n"
+        "      --check-allocations Fail if the steady state solve and trace cycle allocates\n"
+        "  -h, --help              Show this message\n",
+        name);
+}
+
+static BenchParams ParseArgs(int argc, char **argv) {
+    BenchParams p;
+
+    auto GetValue = [argc, argv](int &i) -> const char * {
+        if ((i+1) >= argc) {
+            throw std::runtime_error(fmt::format("Missing value for argument {}", argv[i]));
+        }
+        return argv[++i];
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const auto IsArg = [arg](const char *s, const char *l) {
+            return (strcmp(arg, s) == 0) || (strcmp(arg, l) == 0);
+        };
+
+        if (IsArg("-h", "--help")) {
+            PrintUsage(argv[0]);
+            exit(0);
+        } else if (IsArg("-d", "--dict")) {
+            p.dict_filepath = GetValue(i);
+        } else if (IsArg("-i", "--input")) {
+            p.boards_filepath = GetValue(i);
+        } else if (IsArg("-j", "--json")) {
+            p.json_filepath = GetValue(i);
+        } else if (IsArg("-n", "--boards")) {
+            p.total_boards = std::max(1, atoi(GetValue(i)));
+        } else if (IsArg("-l", "--loads")) {
+            p.total_loads = std::max(1, atoi(GetValue(i)));
+        } else if (IsArg("-s", "--seed")) {
+            p.seed = static_cast<uint32_t>(atoi(GetValue(i)));
+        } else if (strcmp(arg, "--check-allocations") == 0) {
+            p.is_checking_allocations = true;
+        } else {
+            throw std::runtime_error(fmt::format("Unknown argument {}", arg));
+        }
+    }
+
+    return p;
+}
+
+static std::string ReadFile(const char *filepath) {
+    std::ifstream fp;
+    fp.open(filepath, std::ios::binary);
+    if (!fp.is_open()) {
+        throw std::runtime_error(fmt::format("Failed to open {}", filepath));
+    }
+    std::stringstream ss;
+    ss << fp.rdbuf();
+    return ss.str();
+}
+
+template <typename F>
+static double GetElapsedMicros(F func) {
+    const auto start = std::chrono::steady_clock::now();
+    func();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end-start).count();
+}
+
+static LatencySummary GetLatencySummary(std::vector<double> latencies) {
+    LatencySummary summary = {0.0, 0.0, 0.0, 0.0, 0.0};
+    if (latencies.empty()) {
+        return summary;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const auto GetPercentile = [&latencies](const double p) {
+        const size_t i = static_cast<size_t>(p * static_cast<double>(latencies.size()-1) + 0.5);
+        return latencies[std::min(i, latencies.size()-1)];
+    };
+    double total = 0.0;
+    for (double v: latencies) {
+        total += v;
+    }
+    summary.mean = total / static_cast<double>(latencies.size());
+    summary.p50 = GetPercentile(0.50);
+    summary.p90 = GetPercentile(0.90);
+    summary.p99 = GetPercentile(0.99);
+    summary.max = latencies.back();
+    return summary;
+}
+
+// every word in the tree in alphabetical order
+static void CollectWords(
+    const wordtree::NodePool &pool, const uint32_t node_index,
+    std::string &prefix, std::vector<std::string> &words)
+{
+    const auto &node = pool[node_index];
+    if (node.is_leaf) {
+        words.push_back(prefix);
+    }
+    for (int i = 0; i < wordtree::MAX_BRANCHES; i++) {
+        if (((node.child_mask >> i) & 1u) == 0) {
+            continue;
+        }
+        prefix.push_back(static_cast<char>('a' + i));
+        CollectWords(pool, node.children[i], prefix, words);
+        prefix.pop_back();
+    }
+}
+
+static double GetLookupsPerSecond(wordtree::NodePool &pool, const std::vector<std::string> &words, int &total_found) {
+    total_found = 0;
+    const double us = GetElapsedMicros([&]() {
+        for (auto &word: words) {
+            total_found += wordtree::TraverseWordTree(pool, word) ? 1 : 0;
+        }
+    });
+    return (us > 0.0) ? (static_cast<double>(words.size()) * 1e6 / us) : 0.0;
+}
+
+static DictionaryResults BenchDictionary(
+    const BenchParams &params, const std::string &buffer,
+    wordtree::NodePool &pool, std::mt19937 &rng)
+{
+    DictionaryResults r;
+
+    // the file is read once so only building the tree is timed
+    std::vector<double> load_us;
+    for (int i = 0; i < params.total_loads; i++) {
+        wordtree::NodePool load_pool;
+        load_us.push_back(GetElapsedMicros([&]() {
+            wordtree::ReadWordTree(buffer.c_str(), static_cast<int>(buffer.length()), load_pool, 20);
+        }));
+        if (i == 0) {
+            pool = std::move(load_pool);
+        }
+    }
+    r.load_ms = GetLatencySummary(load_us).p50 / 1000.0;
+    r.total_nodes = static_cast<int>(pool.size());
+    r.memory_bytes = pool.size() * sizeof(wordtree::Node);
+    r.capacity_bytes = pool.capacity() * sizeof(wordtree::Node);
+
+    std::vector<std::string> words;
+    std::string prefix;
+    CollectWords(pool, 0, prefix, words);
+    r.total_words = static_cast<int>(words.size());
+    std::shuffle(words.begin(), words.end(), rng);
+
+    std::vector<std::string> misses = words;
+    for (auto &word: misses) {
+        word.back() = static_cast<char>('a' + ((word.back() - 'a' + 1 + rng() % 25) % 26));
+    }
+
+    int total_found = 0;
+    r.hit_lookups_per_second = GetLookupsPerSecond(pool, words, total_found);
+    if (total_found != r.total_words) {
+        throw std::runtime_error(fmt::format(
+            "Only found {} out of {} dictionary words", total_found, r.total_words));
+    }
+    r.miss_lookups_per_second = GetLookupsPerSecond(pool, misses, total_found);
+    return r;
+}
+
+// square boards in the solve input format, values and modifiers are optional
+static BoardList LoadBoards(const char *filepath) {
+    std::stringstream file(ReadFile(filepath));
+    BoardList boards;
+    std::string line;
+    int line_number = 0;
+    wordblitz::BoardInput board;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (!wordblitz::ParseBoard(line, line_number, 0, board)) {
+            continue;
+        }
+        auto grid = std::make_unique<wordblitz::Grid>(board.width);
+        wordblitz::CopyBoard(board, *grid);
+        boards.push_back(std::move(grid));
+    }
+    return boards;
+}
+
+static wordblitz::Topology CreateTopology(const BoardDistribution &dist) {
+    switch (dist.topology) {
+    case wordblitz::TopologyType::TOPOLOGY_TORUS:
+        return wordblitz::CreateTorusTopology(dist.width, dist.height);
+    case wordblitz::TopologyType::TOPOLOGY_HEX:
+        return wordblitz::CreateHexTopology(dist.width, dist.height);
+    default:
+        return wordblitz::CreateGridTopology(dist.width, dist.height);
+    }
+}
+
+static BoardList CreateBoards(
+    const BoardDistribution &dist, const int total_boards, std::mt19937 &rng)
+{
+    const wordblitz::Topology topology = CreateTopology(dist);
+    const std::string frequencies = LETTER_FREQUENCIES;
+    BoardList boards;
+    for (int b = 0; b < total_boards; b++) {
+        // pick the distinct letters for this board
+        std::string alphabet = frequencies;
+        if (dist.total_letters > 0) {
+            std::string letters;
+            while (static_cast<int>(letters.size()) < dist.total_letters) {
+                const char c = frequencies[rng() % frequencies.size()];
+                if (letters.find(c) == std::string::npos) {
+                    letters.push_back(c);
+                }
+            }
+            alphabet.clear();
+            for (char c: frequencies) {
+                if (letters.find(c) != std::string::npos) {
+                    alphabet.push_back(c);
+                }
+            }
+        }
+
+        auto grid = std::make_unique<wordblitz::Grid>(topology);
+        for (int i = 0; i < grid->size; i++) {
+            grid->characters[i] = alphabet[rng() % alphabet.size()];
+            grid->values[i] = 1 + static_cast<int>(rng() % 10);
+            const int m = static_cast<int>(rng() % 10);
+            grid->modifiers[i] = static_cast<wordblitz::CellModifier>((m < 6) ? 0 : (m-5));
+        }
+        boards.push_back(std::move(grid));
+    }
+    return boards;
+}
+
+// average microseconds per board, and the total number of paths found
+template <typename F>
+static double TimeSearch(const BoardList &boards, F search, size_t &total_results) {
+    total_results = 0;
+    const double us = GetElapsedMicros([&]() {
+        for (auto &board: boards) {
+            total_results += search(*board).size();
+        }
+    });
+    return us / static_cast<double>(boards.size());
+}
+
+typedef std::vector<std::pair<std::string, int>> WordValues;
+
+// word and value of every result, sorted so engines which find the same results in a different order agree
+template <typename T>
+static WordValues GetWordValues(const std::vector<T> &results) {
+    WordValues values;
+    values.reserve(results.size());
+    for (auto &r: results) {
+        values.emplace_back(r.word, r.value);
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+static BoardResults BenchBoards(
+    const char *name, const BoardList &boards,
+    wordtree::NodePool &pool, const wordblitz::WordSignatures &signatures,
+    bool &is_mismatch)
+{
+    BoardResults r;
+    r.name = name;
+    r.total_boards = static_cast<int>(boards.size());
+
+    // latency of each search and of building its traces
+    std::vector<double> search_us;
+    double total_trace_us = 0.0;
+    size_t tree_paths = 0, tree_words = 0;
+    for (auto &board: boards) {
+        std::vector<wordblitz::SearchResult> searches;
+        search_us.push_back(GetElapsedMicros([&]() {
+            searches = wordblitz::SearchWordTree(pool, *board);
+        }));
+        tree_paths += searches.size();
+        total_trace_us += GetElapsedMicros([&]() {
+            tree_words += wordblitz::GetTraceFromSearch(searches).size();
+        });
+    }
+    const double total_boards = static_cast<double>(boards.size());
+    r.search_us = GetLatencySummary(search_us);
+    r.trace_us = total_trace_us / total_boards;
+    r.paths_per_board = static_cast<double>(tree_paths) / total_boards;
+    r.words_per_board = static_cast<double>(tree_words) / total_boards;
+
+    // the batch engine only returns the best path of each word
+    std::vector<const wordblitz::Grid*> grids;
+    for (auto &board: boards) {
+        grids.push_back(board.get());
+    }
+    std::vector<std::vector<wordblitz::TraceResult>> batch_traces;
+
+    // engines take turns going first so none of them always runs right after another has
+    // filled the caches, and the fastest round of each is kept since noise only adds time
+    size_t tree_results = 0, signature_results = 0, auto_results = 0;
+    r.tree_us = r.signature_us = r.auto_us = r.batch_us = std::numeric_limits<double>::max();
+    for (int round = 0; round < TOTAL_ENGINE_ROUNDS; round++) {
+        for (int k = 0; k < 4; k++) {
+            switch ((round+k) % 4) {
+            case 0:
+                r.tree_us = std::min(r.tree_us, TimeSearch(boards, [&pool](const wordblitz::Grid &grid) {
+                    return wordblitz::SearchWordTree(pool, grid);
+                }, tree_results));
+                break;
+            case 1:
+                r.signature_us = std::min(r.signature_us, TimeSearch(boards, [&signatures](const wordblitz::Grid &grid) {
+                    return signatures.Search(grid);
+                }, signature_results));
+                break;
+            case 2:
+                r.auto_us = std::min(r.auto_us, TimeSearch(boards, [&](const wordblitz::Grid &grid) {
+                    return wordblitz::SearchBoard(pool, signatures, grid, wordblitz::ChooseSearchEngine(grid));
+                }, auto_results));
+                break;
+            default:
+                r.batch_us = std::min(r.batch_us, GetElapsedMicros([&]() {
+                    wordblitz::SearchWordTreeBatch(pool, grids, batch_traces);
+                }) / total_boards);
+                break;
+            }
+        }
+    }
+
+    // every engine has to find the same words with the same values on each board, which is checked
+    // outside of the timed searches
+    int total_mismatches = 0;
+    int total_batch_mismatches = 0;
+    int total_auto_signatures = 0;
+    for (size_t i = 0; i < boards.size(); i++) {
+        const auto &grid = *boards[i];
+        auto searches = wordblitz::SearchWordTree(pool, grid);
+        const auto expected = GetWordValues(searches);
+        const auto engine = wordblitz::ChooseSearchEngine(grid);
+        total_auto_signatures += (engine == wordblitz::SearchEngine::ENGINE_SIGNATURES) ? 1 : 0;
+        const bool is_same = 
+            (GetWordValues(signatures.Search(grid)) == expected) &&
+            (GetWordValues(wordblitz::SearchBoard(pool, signatures, grid, engine)) == expected);
+        total_mismatches += is_same ? 0 : 1;
+        const bool is_batch_same = 
+            GetWordValues(batch_traces[i]) == GetWordValues(wordblitz::GetTraceFromSearch(searches));
+        total_batch_mismatches += is_batch_same ? 0 : 1;
+    }
+    r.auto_signature_percent = 100.0 * total_auto_signatures / total_boards;
+    if (total_mismatches > 0) {
+        fprintf(stderr, "%s: engines found different words or values on %d of %d boards (tree=%zu, signatures=%zu, auto=%zu paths)\n",
+            name, total_mismatches, r.total_boards, tree_results, signature_results, auto_results);
+        is_mismatch = true;
+    }
+    if (total_batch_mismatches > 0) {
+        fprintf(stderr, "%s: batch engine found different words or values on %d of %d boards\n",
+            name, total_batch_mismatches, r.total_boards);
+        is_mismatch = true;
+    }
+
+    return r;
+}
+
+// the same cycle as the bot: look up the board in the cache, otherwise solve what changed
+// and cache the traces, then swap them in for the tracer
+// every board is followed by a read with a corrected cell so the partial solve is covered,
+// and the cache holds fewer boards than there are so entries get evicted and reused
+static size_t CountSteadyStateAllocations(wordtree::NodePool &pool, const BoardList &boards) {
+    BoardList rounds;
+    for (auto &board: boards) {
+        for (int r = 0; r < 2; r++) {
+            auto grid = std::make_unique<wordblitz::Grid>(board->topology);
+            std::copy_n(board->characters, board->size, grid->characters);
+            std::copy_n(board->values, board->size, grid->values);
+            std::copy_n(board->modifiers, board->size, grid->modifiers);
+            rounds.push_back(std::move(grid));
+        }
+        auto &corrected = *rounds.back();
+        const int i = static_cast<int>(rounds.size()) % corrected.size;
+        corrected.characters[i] = static_cast<char>('a' + (corrected.characters[i]-'a'+1) % 26);
+    }
+
+    wordblitz::IncrementalSolver solver(pool);
+    wordblitz::SolveCache cache(std::max<size_t>(1, boards.size()/2));
+    std::vector<wordblitz::TraceResult> traces;
+    std::vector<wordblitz::TraceResult> next_traces;
+    const auto RunRounds = [&]() {
+        for (auto &grid: rounds) {
+            wordblitz::ResetSearchStats();
+            if (!cache.Find(*grid, next_traces)) {
+                solver.Update(*grid);
+                solver.GetTraces(next_traces);
+                cache.Insert(*grid, next_traces);
+            }
+            std::swap(traces, next_traces);
+        }
+    };
+
+    // the first passes grow every buffer to the largest board it sees
+    // which board lands in which cache entry moves around, so it takes more than one
+    constexpr int TOTAL_WARMUP_PASSES = 4;
+    constexpr int TOTAL_CHECKED_PASSES = 4;
+    for (int i = 0; i < TOTAL_WARMUP_PASSES; i++) {
+        RunRounds();
+    }
+    g_total_allocations = 0;
+    g_is_counting_allocations = true;
+    for (int i = 0; i < TOTAL_CHECKED_PASSES; i++) {
+        RunRounds();
+    }
+    g_is_counting_allocations = false;
+    return g_total_allocations;
+}
+
+static void WriteJson(
+    const char *filepath, const BenchParams &params,
+    const DictionaryResults &dict, const double signatures_ms,
+    const std::vector<BoardResults> &results, const bool is_mismatch)
+{
+    fmt::memory_buffer buf;
+    auto out = std::back_inserter(buf);
+    fmt::format_to(out, "{{\"seed\":{},\"boards_per_distribution\":{},", params.seed, params.total_boards);
+    fmt::format_to(out,
+        "\"dictionary\":{{\"nodes\":{},\"memory_bytes\":{},\"capacity_bytes\":{},\"load_ms\":{:.3f},"
+        "\"words\":{},\"hit_lookups_per_second\":{:.0f},\"miss_lookups_per_second\":{:.0f},\"signatures_ms\":{:.3f}}},",
+        dict.total_nodes, dict.memory_bytes, dict.capacity_bytes, dict.load_ms,
+        dict.total_words, dict.hit_lookups_per_second, dict.miss_lookups_per_second, signatures_ms);
+    fmt::format_to(out, "\"boards\":[");
+    bool is_first = true;
+    for (auto &r: results) {
+        fmt::format_to(out,
+            "{}{{\"name\":\"{}\",\"boards\":{},"
+            "\"search_us\":{{\"mean\":{:.2f},\"p50\":{:.2f},\"p90\":{:.2f},\"p99\":{:.2f},\"max\":{:.2f}}},"
+            "\"trace_us\":{:.2f},\"paths\":{:.1f},\"words\":{:.1f},"
+            "\"engines_us\":{{\"tree\":{:.2f},\"signatures\":{:.2f},\"auto\":{:.2f},\"batch\":{:.2f}}},"
+            "\"auto_signatures_percent\":{:.1f}}}",
+            is_first ? "" : ",", r.name, r.total_boards,
+            r.search_us.mean, r.search_us.p50, r.search_us.p90, r.search_us.p99, r.search_us.max,
+            r.trace_us, r.paths_per_board, r.words_per_board,
+            r.tree_us, r.signature_us, r.auto_us, r.batch_us,
+            r.auto_signature_percent);
+        is_first = false;
+    }
+    fmt::format_to(out, "],\"mismatch\":{}}}\n", is_mismatch ? "true" : "false");
+
+    FILE *fp = fopen(filepath, "w");
+    if (fp == nullptr) {
+        throw std::runtime_error(fmt::format("Failed to open output {}", filepath));
+    }
+    fwrite(buf.data(), 1, buf.size(), fp);
+    fclose(fp);
+}
+
+int run_bench(int argc, char **argv) {
+    const auto params = ParseArgs(argc, argv);
+    std::mt19937 rng(params.seed);
+
+    const std::string buffer = ReadFile(params.dict_filepath);
+    wordtree::NodePool pool;
+    const auto dict = BenchDictionary(params, buffer, pool, rng);
+    printf("dictionary: %d nodes, %.1f MiB (%.1f MiB reserved), loaded in %.1fms\n",
+        dict.total_nodes,
+        static_cast<double>(dict.memory_bytes) / (1024.0*1024.0),
+        static_cast<double>(dict.capacity_bytes) / (1024.0*1024.0),
+        dict.load_ms);
+    printf("lookups: %d words, %.1fM hits/s, %.1fM misses/s\n",
+        dict.total_words, dict.hit_lookups_per_second / 1e6, dict.miss_lookups_per_second / 1e6);
+
+    if (params.is_checking_allocations) {
+        auto boards = CreateBoards(BOARD_DISTRIBUTIONS[0], params.total_boards, rng);
+        if (params.boards_filepath != nullptr) {
+            for (auto &board: LoadBoards(params.boards_filepath)) {
+                boards.push_back(std::move(board));
+            }
+        }
+        const size_t total_allocations = CountSteadyStateAllocations(pool, boards);
+        printf("\nsteady state: %zu allocations over %zu boards\n", total_allocations, boards.size());
+        return (total_allocations == 0) ? 0 : 1;
+    }
+
+    std::unique_ptr<wordblitz::WordSignatures> signatures;
+    const double signatures_ms = GetElapsedMicros([&]() {
+        signatures = std::make_unique<wordblitz::WordSignatures>(pool);
+    }) / 1000.0;
+    printf("built signatures for %d words in %.1fms\n",
+        static_cast<int>(signatures->GetTotalWords()), signatures_ms);
+
+    std::vector<std::pair<std::string, BoardList>> board_sets;
+    for (auto &dist: BOARD_DISTRIBUTIONS) {
+        board_sets.push_back({dist.name, CreateBoards(dist, params.total_boards, rng)});
+    }
+    if (params.boards_filepath != nullptr) {
+        auto boards = LoadBoards(params.boards_filepath);
+        if (!boards.empty()) {
+            board_sets.push_back({"input boards", std::move(boards)});
+        }
+    }
+
+    printf("\n%-22s %10s %10s %10s %10s %10s %10s\n",
+        "boards", "search p50", "p90", "p99", "max", "trace us", "paths");
+    bool is_mismatch = false;
+    std::vector<BoardResults> results;
+    for (auto &[name, boards]: board_sets) {
+        results.push_back(BenchBoards(name.c_str(), boards, pool, *signatures, is_mismatch));
+        auto &r = results.back();
+        printf("%-22s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            r.name.c_str(), r.search_us.p50, r.search_us.p90, r.search_us.p99, r.search_us.max,
+            r.trace_us, r.paths_per_board);
+    }
+
+    printf("\n%-22s %12s %12s %12s %10s %12s\n", "boards", "tree us", "signature us", "auto us", "auto sig", "batch us");
+    for (auto &r: results) {
+        printf("%-22s %12.1f %12.1f %12.1f %9.0f%% %12.1f\n",
+            r.name.c_str(), r.tree_us, r.signature_us, r.auto_us,
+            r.auto_signature_percent, r.batch_us);
+    }
+
+    if (params.json_filepath != nullptr) {
+        WriteJson(params.json_filepath, params, dict, signatures_ms, results, is_mismatch);
+    }
+
+    return is_mismatch ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    try {
+        return run_bench(argc, argv);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+    }
+
+    return 1;
+}
@@ -0,0 +1,105 @@
+#include "board_input.h"
+#include <math.h>
+#include <stdlib.h>
+#include <sstream>
+#include <stdexcept>
+#include <fmt/core.h>
+
+namespace wordblitz {
+
+static std::vector<std::string> SplitString(const std::string &s, const char delim) {
+    std::vector<std::string> tokens;
+    std::stringstream ss(s);
+    std::string token;
+    while (std::getline(ss, token, delim)) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+CellModifier ParseModifier(const std::string &s) {
+    if ((s == "-") || s.empty()) return CellModifier::MOD_NONE;
+    if (s == "2L") return CellModifier::MOD_2L;
+    if (s == "3L") return CellModifier::MOD_3L;
+    if (s == "2W") return CellModifier::MOD_2W;
+    if (s == "3W") return CellModifier::MOD_3W;
+    throw std::runtime_error(fmt::format("Unknown modifier '{}'", s));
+}
+
+bool ParseBoard(const std::string &line, const int line_number, const int width, BoardInput &board) {
+    std::stringstream ss(line.substr(0, line.find('#')));
+    std::string characters, values, modifiers;
+    if (!(ss >> characters)) {
+        return false;
+    }
+    ss >> values >> modifiers;
+
+    const auto ThrowError = [line_number](const std::string &msg) {
+        throw std::runtime_error(fmt::format("Invalid board on line {}: {}", line_number, msg));
+    };
+
+    const int size = static_cast<int>(characters.length());
+    if (width > 0) {
+        if ((size % width) != 0) {
+            ThrowError(fmt::format("{} letters don't fill rows of {}", size, width));
+        }
+        board.width = width;
+        board.height = size / width;
+    } else {
+        const int sqrt_size = static_cast<int>(sqrt(static_cast<double>(size)) + 0.5);
+        if ((sqrt_size*sqrt_size) != size) {
+            ThrowError(fmt::format("{} letters don't form a square grid", size));
+        }
+        board.width = sqrt_size;
+        board.height = sqrt_size;
+    }
+    for (auto &c: characters) {
+        if ((c < 'a') || (c > 'z')) {
+            ThrowError(fmt::format("unknown letter '{}'", c));
+        }
+    }
+
+    board.characters = characters;
+    board.values.assign(size, 1);
+    board.modifiers.assign(size, CellModifier::MOD_NONE);
+
+    if (!values.empty()) {
+        auto tokens = SplitString(values, ',');
+        if (static_cast<int>(tokens.size()) != size) {
+            ThrowError(fmt::format("expected {} values, got {}", size, tokens.size()));
+        }
+        for (int i = 0; i < size; i++) {
+            board.values[i] = atoi(tokens[i].c_str());
+        }
+    }
+
+    if (!modifiers.empty()) {
+        auto tokens = SplitString(modifiers, ',');
+        if (static_cast<int>(tokens.size()) != size) {
+            ThrowError(fmt::format("expected {} modifiers, got {}", size, tokens.size()));
+        }
+        for (int i = 0; i < size; i++) {
+            try {
+                board.modifiers[i] = ParseModifier(tokens[i]);
+            } catch (std::exception &ex) {
+                ThrowError(ex.what());
+            }
+        }
+    }
+
+    return true;
+}
+
+void CopyBoard(const BoardInput &board, Grid &grid) {
+    if ((grid.width != board.width) || (grid.height != board.height)) {
+        throw std::runtime_error(fmt::format(
+            "Board of {}x{} doesn't fit a grid of {}x{}", board.width, board.height, grid.width, grid.height));
+    }
+    for (int i = 0; i < grid.size; i++) {
+        grid.characters[i] = board.characters[i];
+        grid.values[i] = board.values[i];
+        grid.modifiers[i] = board.modifiers[i];
+    }
+}
+
+}
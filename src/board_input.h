@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "wordblitz.h"
+
+namespace wordblitz {
+
+// a board in the text format of solve and bench, one board per line laid out row by row
+//     <letters> [values] [modifiers]
+//     letters:   one lowercase letter per cell
+//     values:    comma separated integer per cell (defaults to 1)
+//     modifiers: comma separated modifier per cell out of -,2L,3L,2W,3W (defaults to -)
+// '#' starts a comment
+struct BoardInput {
+    int width;
+    int height;
+    std::string characters;
+    std::vector<int> values;
+    std::vector<CellModifier> modifiers;
+};
+
+// throws on anything other than -, 2L, 3L, 2W, 3W or an empty string
+CellModifier ParseModifier(const std::string &s);
+
+// boards are square unless a width is given
+// returns false if the line has no board, and throws if the board is invalid
+bool ParseBoard(const std::string &line, const int line_number, const int width, BoardInput &board);
+
+// copies the cells of the board into a grid of the same size
+void CopyBoard(const BoardInput &board, Grid &grid);
+
+}
@@ -0,0 +1,187 @@
+#include "colour_classifier.h"
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define COLOUR_CLASSIFIER_SSE2
+#include <emmintrin.h>
+#endif
+
+void GetColourStats(const uint8_t *data, const int width, const int height, const int row_stride, ColourStats &stats) {
+    uint64_t sum[4] = {0, 0, 0, 0};
+    uint64_t sum_sq[4] = {0, 0, 0, 0};
+    for (int y = 0; y < height; y++) {
+        const uint8_t *row = data + y*row_stride;
+        int x = 0;
+#ifdef COLOUR_CLASSIFIER_SSE2
+        // lanes hold the rgba channels, and rows are short enough that 32bit sums of squares don't overflow
+        const __m128i zero = _mm_setzero_si128();
+        __m128i row_sum = zero;
+        __m128i row_sum_sq = zero;
+        for (; (x+4) <= width; x += 4) {
+            const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x*4));
+            const __m128i lo = _mm_unpacklo_epi8(px, zero);
+            const __m128i hi = _mm_unpackhi_epi8(px, zero);
+            // squares of bytes fit in 16 bits
+            const __m128i lo_sq = _mm_mullo_epi16(lo, lo);
+            const __m128i hi_sq = _mm_mullo_epi16(hi, hi);
+            row_sum = _mm_add_epi32(row_sum, _mm_add_epi32(
+                _mm_add_epi32(_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero)),
+                _mm_add_epi32(_mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero))));
+            row_sum_sq = _mm_add_epi32(row_sum_sq, _mm_add_epi32(
+                _mm_add_epi32(_mm_unpacklo_epi16(lo_sq, zero), _mm_unpackhi_epi16(lo_sq, zero)),
+                _mm_add_epi32(_mm_unpacklo_epi16(hi_sq, zero), _mm_unpackhi_epi16(hi_sq, zero))));
+        }
+        alignas(16) uint32_t lanes[4];
+        alignas(16) uint32_t lanes_sq[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), row_sum);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes_sq), row_sum_sq);
+        for (int c = 0; c < 4; c++) {
+            sum[c] += lanes[c];
+            sum_sq[c] += lanes_sq[c];
+        }
+#endif
+        for (; x < width; x++) {
+            for (int c = 0; c < 4; c++) {
+                const uint32_t v = row[x*4 + c];
+                sum[c] += v;
+                sum_sq[c] += v*v;
+            }
+        }
+    }
+
+    const double total = static_cast<double>(std::max(1, width*height));
+    for (int c = 0; c < 3; c++) {
+        const double mean = static_cast<double>(sum[c]) / total;
+        const double variance = std::max(0.0, static_cast<double>(sum_sq[c]) / total - mean*mean);
+        stats.mean[c] = static_cast<float>(mean / 255.0);
+        stats.variance[c] = static_cast<float>(variance / (255.0*255.0));
+    }
+}
+
+// means and standard deviations, so both are in the same units
+static void GetFeature(const ColourStats &stats, float *feature) {
+    for (int c = 0; c < 3; c++) {
+        feature[c] = stats.mean[c];
+        feature[3+c] = sqrtf(stats.variance[c]);
+    }
+}
+
+static float GetDistanceSquared(const float *a, const float *b) {
+    float distance = 0.0f;
+    for (int j = 0; j < TOTAL_COLOUR_FEATURES; j++) {
+        const float d = a[j] - b[j];
+        distance += d*d;
+    }
+    return distance;
+}
+
+ColourClassifier::ColourClassifier(const int total_labels, const int min_samples, const int max_samples, const float radius)
+: m_min_samples(std::max(1, min_samples)),
+  m_max_samples(std::max(min_samples, max_samples)),
+  m_radius(radius)
+{
+    if (total_labels <= 0) {
+        throw std::runtime_error(fmt::format("Invalid number of colour labels {}", total_labels));
+    }
+    m_prototypes.resize(total_labels);
+    Clear();
+}
+
+bool ColourClassifier::Predict(const ColourStats &stats, Prediction &prediction) const {
+    float feature[TOTAL_COLOUR_FEATURES];
+    GetFeature(stats, feature);
+
+    // the nearest usable prototype of each label, and the nearest of a different label
+    int total_usable = 0;
+    float best = std::numeric_limits<float>::max();
+    float second = std::numeric_limits<float>::max();
+    prediction.label = -1;
+    for (int label = 0; label < static_cast<int>(m_prototypes.size()); label++) {
+        float nearest = std::numeric_limits<float>::max();
+        for (auto &prototype: m_prototypes[label]) {
+            if (prototype.total_samples >= m_min_samples) {
+                nearest = std::min(nearest, GetDistanceSquared(feature, prototype.feature));
+            }
+        }
+        if (nearest == std::numeric_limits<float>::max()) {
+            continue;
+        }
+        total_usable++;
+        if (nearest < best) {
+            second = best;
+            best = nearest;
+            prediction.label = label;
+        } else if (nearest < second) {
+            second = nearest;
+        }
+    }
+    if (total_usable < 2) {
+        return false;
+    }
+    prediction.distance = sqrtf(best);
+    prediction.margin = (second > 0.0f) ? (1.0f - sqrtf(best / second)) : 0.0f;
+    return true;
+}
+
+void ColourClassifier::Calibrate(const ColourStats &stats, const int label) {
+    if ((label < 0) || (label >= static_cast<int>(m_prototypes.size()))) {
+        return;
+    }
+    float feature[TOTAL_COLOUR_FEATURES];
+    GetFeature(stats, feature);
+
+    auto &prototypes = m_prototypes[label];
+    Prototype *nearest = nullptr;
+    float nearest_distance = std::numeric_limits<float>::max();
+    for (auto &prototype: prototypes) {
+        const float distance = GetDistanceSquared(feature, prototype.feature);
+        if (distance < nearest_distance) {
+            nearest_distance = distance;
+            nearest = &prototype;
+        }
+    }
+    // a full label merges the sample into its nearest prototype instead
+    const bool is_new = 
+        (nearest == nullptr) || 
+        ((nearest_distance > m_radius*m_radius) && (prototypes.size() < MAX_COLOUR_PROTOTYPES));
+    if (is_new) {
+        Prototype prototype;
+        std::copy(feature, feature+TOTAL_COLOUR_FEATURES, prototype.feature);
+        prototype.total_samples = 1;
+        prototypes.push_back(prototype);
+        return;
+    }
+    nearest->total_samples = std::min(nearest->total_samples+1, m_max_samples);
+    const float weight = 1.0f / static_cast<float>(nearest->total_samples);
+    for (int j = 0; j < TOTAL_COLOUR_FEATURES; j++) {
+        nearest->feature[j] += weight * (feature[j] - nearest->feature[j]);
+    }
+}
+
+void ColourClassifier::Clear() {
+    for (auto &prototypes: m_prototypes) {
+        prototypes.clear();
+        prototypes.reserve(MAX_COLOUR_PROTOTYPES);
+    }
+    m_total_fast = 0;
+    m_total_fallbacks = 0;
+    m_total_audits = 0;
+    m_total_agreements = 0;
+}
+
+int ColourClassifier::GetTotalCalibrated() const {
+    int total = 0;
+    for (auto &prototypes: m_prototypes) {
+        const bool is_usable = std::any_of(prototypes.begin(), prototypes.end(), [this](const Prototype &prototype) {
+            return prototype.total_samples >= m_min_samples;
+        });
+        total += is_usable ? 1 : 0;
+    }
+    return total;
+}
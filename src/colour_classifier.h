@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+constexpr int TOTAL_COLOUR_FEATURES = 6;
+
+// mean and variance of the rgb channels of a crop, scaled to [0,1]
+struct ColourStats {
+    float mean[3];
+    float variance[3];
+};
+
+void GetColourStats(const uint8_t *data, const int width, const int height, const int row_stride, ColourStats &stats);
+
+// a label can have a few prototypes, since the same label can be drawn on different tiles
+constexpr int MAX_COLOUR_PROTOTYPES = 4;
+
+// classifies crops by the nearest prototype of the mean and deviation of their colours
+// prototypes are the running means of crops labelled by a model, so it calibrates itself while the model runs
+class ColourClassifier
+{
+public:
+    struct Prediction {
+        int label;
+        // distance to the nearest prototype
+        float distance;
+        // 1 - nearest/nearest of another label, which is 0 when both are as close
+        float margin;
+    };
+private:
+    struct Prototype {
+        float feature[TOTAL_COLOUR_FEATURES];
+        int total_samples;
+    };
+    // up to MAX_COLOUR_PROTOTYPES of each label
+    std::vector<std::vector<Prototype>> m_prototypes;
+    // prototypes with fewer samples aren't used
+    const int m_min_samples;
+    // later samples are weighted as if there were only this many, so the prototypes follow a changing screen
+    const int m_max_samples;
+    // a sample further than this from every prototype of its label starts a new one
+    const float m_radius;
+
+    int m_total_fast;
+    int m_total_fallbacks;
+    int m_total_audits;
+    int m_total_agreements;
+public:
+    ColourClassifier(const int total_labels, const int min_samples=4, const int max_samples=256, const float radius=0.05f);
+    // returns false unless at least two labels have usable prototypes
+    bool Predict(const ColourStats &stats, Prediction &prediction) const;
+    // moves the nearest prototype of the label towards the crop
+    void Calibrate(const ColourStats &stats, const int label);
+    void Clear();
+
+    // crops which were labelled from their colours
+    inline void AddFast() { m_total_fast++; }
+    // crops whose prediction was too close to call, or which had no usable prototypes, and were run by the model
+    inline void AddFallback() { m_total_fallbacks++; }
+    // confident predictions which were also run by the model to check them
+    inline void AddAudit(const bool is_agreeing) { m_total_audits++; m_total_agreements += is_agreeing ? 1 : 0; }
+    inline int GetTotalFast() const { return m_total_fast; }
+    inline int GetTotalFallbacks() const { return m_total_fallbacks; }
+    inline int GetTotalAudits() const { return m_total_audits; }
+    inline int GetTotalAgreements() const { return m_total_agreements; }
+    // labels with a usable prototype
+    int GetTotalCalibrated() const;
+};
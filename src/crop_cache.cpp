@@ -0,0 +1,280 @@
+#include "crop_cache.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CROP_CACHE_SSE2
+#include <emmintrin.h>
+#endif
+
+constexpr uint32_t CROP_CACHE_FILE_MAGIC = 0x43434257; // "WBCC"
+constexpr uint32_t CROP_CACHE_FILE_VERSION = 1;
+
+// FNV-1a over 64bit words
+static uint64_t HashWords(const uint8_t *data, const size_t total_bytes, uint64_t hash) {
+    size_t i = 0;
+    for (; (i+8) <= total_bytes; i += 8) {
+        uint64_t v;
+        memcpy(&v, data+i, sizeof(v));
+        hash = (hash ^ v) * 0x100000001b3ull;
+    }
+    for (; i < total_bytes; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t HashSignature(const CropSignature &signature) {
+    const int32_t size[2] = {signature.width, signature.height};
+    const uint64_t hash = HashWords(reinterpret_cast<const uint8_t*>(size), sizeof(size), 0xcbf29ce484222325ull);
+    return HashWords(signature.thumbnail, CROP_THUMBNAIL_BYTES, hash);
+}
+
+void GetCropSignature(const uint8_t *data, const int width, const int height, const int row_stride, CropSignature &signature) {
+    constexpr int N = CROP_THUMBNAIL_SIZE;
+    signature.width = width;
+    signature.height = height;
+    // each cell is the mean of a box of the crop, and crops smaller than the thumbnail repeat pixels
+    for (int ty = 0; ty < N; ty++) {
+        const int y0 = std::min((ty*height) / N, height-1);
+        const int y1 = std::max(y0+1, ((ty+1)*height) / N);
+        for (int tx = 0; tx < N; tx++) {
+            const int x0 = std::min((tx*width) / N, width-1);
+            const int x1 = std::max(x0+1, ((tx+1)*width) / N);
+            uint32_t r = 0, g = 0, b = 0;
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *px = data + y*row_stride + x0*4;
+                for (int x = x0; x < x1; x++, px += 4) {
+                    r += px[0];
+                    g += px[1];
+                    b += px[2];
+                }
+            }
+            const uint32_t total = static_cast<uint32_t>((y1-y0)*(x1-x0));
+            uint8_t *dst = &signature.thumbnail[(ty*N + tx)*3];
+            dst[0] = static_cast<uint8_t>((r + total/2) / total);
+            dst[1] = static_cast<uint8_t>((g + total/2) / total);
+            dst[2] = static_cast<uint8_t>((b + total/2) / total);
+        }
+    }
+    signature.hash = HashSignature(signature);
+}
+
+uint64_t GetFileHash(const char *filepath) {
+    std::ifstream fp(filepath, std::ios::binary);
+    if (!fp.is_open()) {
+        return 0;
+    }
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+    return HashWords(buf.data(), buf.size(), 0xcbf29ce484222325ull);
+}
+
+static bool IsSameThumbnail(const CropSignature &a, const CropSignature &b) {
+    return (a.width == b.width) && (a.height == b.height) &&
+           (memcmp(a.thumbnail, b.thumbnail, CROP_THUMBNAIL_BYTES) == 0);
+}
+
+// check if every byte of the thumbnails is within the tolerance
+static bool IsNearThumbnail(const CropSignature &a, const CropSignature &b, const int tolerance) {
+    if ((a.width != b.width) || (a.height != b.height)) {
+        return false;
+    }
+#ifdef CROP_CACHE_SSE2
+    const __m128i max_diff = _mm_set1_epi8(static_cast<char>(std::min(tolerance, 255)));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i excess = zero;
+    for (int i = 0; i < CROP_THUMBNAIL_BYTES; i += 16) {
+        const __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(a.thumbnail + i));
+        const __m128i y = _mm_load_si128(reinterpret_cast<const __m128i*>(b.thumbnail + i));
+        const __m128i diff = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+        excess = _mm_or_si128(excess, _mm_subs_epu8(diff, max_diff));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(excess, zero)) == 0xFFFF;
+#else
+    for (int i = 0; i < CROP_THUMBNAIL_BYTES; i++) {
+        if (std::abs(static_cast<int>(a.thumbnail[i]) - static_cast<int>(b.thumbnail[i])) > tolerance) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+CropCache::CropCache(const size_t max_entries, const size_t output_bytes, const char *filepath, const uint64_t model_hash)
+: m_max_entries(std::max(max_entries, size_t(1))),
+  m_output_bytes(output_bytes),
+  m_model_hash(model_hash)
+{
+    m_lookup.reserve(m_max_entries+1);
+    m_tolerance = 0;
+    m_total_hits = 0;
+    m_total_near_hits = 0;
+    m_total_misses = 0;
+    if (filepath != nullptr) {
+        m_filepath = filepath;
+        Load();
+    }
+}
+
+const uint8_t *CropCache::Find(const CropSignature &signature) {
+    Entry *entry = nullptr;
+    auto it = m_lookup.find(signature.hash);
+    if ((it != m_lookup.end()) && IsSameThumbnail(it->second->signature, signature)) {
+        // move to the front since it is the most recently used
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        entry = &m_entries.front();
+    } else if (m_tolerance > 0) {
+        entry = FindNearest(signature);
+        m_total_near_hits += (entry != nullptr) ? 1 : 0;
+    }
+
+    if (entry == nullptr) {
+        m_total_misses++;
+        return nullptr;
+    }
+    m_total_hits++;
+    return entry->output.data();
+}
+
+// the most recently used entry within the tolerance, which is moved to the front
+CropCache::Entry *CropCache::FindNearest(const CropSignature &signature) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+        if (IsNearThumbnail(it->signature, signature, m_tolerance)) {
+            m_entries.splice(m_entries.begin(), m_entries, it);
+            return &m_entries.front();
+        }
+    }
+    return nullptr;
+}
+
+// moves the entry to the free list, and keeps its lookup node for the next insert
+void CropCache::UnlinkEntry(EntryLookup::iterator it) {
+    m_free_entries.splice(m_free_entries.end(), m_entries, it->second);
+    m_free_node = m_lookup.extract(it);
+}
+
+void CropCache::Insert(const CropSignature &signature, const uint8_t *output) {
+    // a colliding hash replaces the older entry
+    auto it = m_lookup.find(signature.hash);
+    if (it != m_lookup.end()) {
+        UnlinkEntry(it);
+    }
+    // evict the least recently used
+    while (m_entries.size() >= m_max_entries) {
+        UnlinkEntry(m_lookup.find(m_entries.back().signature.hash));
+    }
+
+    if (m_free_entries.empty()) {
+        m_free_entries.emplace_back();
+    }
+    m_entries.splice(m_entries.begin(), m_free_entries, m_free_entries.begin());
+    auto &entry = m_entries.front();
+    entry.signature = signature;
+    entry.output.assign(output, output + m_output_bytes);
+    if (m_free_node.empty()) {
+        m_lookup[signature.hash] = m_entries.begin();
+    } else {
+        m_free_node.key() = signature.hash;
+        m_free_node.mapped() = m_entries.begin();
+        m_lookup.insert(std::move(m_free_node));
+    }
+}
+
+void CropCache::Clear() {
+    m_entries.clear();
+    m_lookup.clear();
+    m_free_entries.clear();
+    m_free_node = EntryLookup::node_type();
+    m_total_hits = 0;
+    m_total_near_hits = 0;
+    m_total_misses = 0;
+}
+
+template <typename T>
+static void WriteValue(std::ofstream &fp, const T &v) {
+    fp.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+static bool ReadValue(std::ifstream &fp, T &v) {
+    fp.read(reinterpret_cast<char*>(&v), sizeof(T));
+    return fp.good();
+}
+
+void CropCache::Save() const {
+    if (m_filepath.empty()) {
+        return;
+    }
+    // written beside the old file and renamed over it, so a failed write never leaves a truncated cache
+    const std::string temp_filepath = m_filepath + ".tmp";
+    std::ofstream fp(temp_filepath, std::ios::binary);
+    if (!fp.is_open()) {
+        throw std::runtime_error(fmt::format("Failed to write crop cache to {}", m_filepath));
+    }
+
+    WriteValue(fp, CROP_CACHE_FILE_MAGIC);
+    WriteValue(fp, CROP_CACHE_FILE_VERSION);
+    WriteValue(fp, m_model_hash);
+    WriteValue(fp, static_cast<uint32_t>(CROP_THUMBNAIL_BYTES));
+    WriteValue(fp, static_cast<uint32_t>(m_output_bytes));
+    WriteValue(fp, static_cast<uint32_t>(m_entries.size()));
+    // least recently used first, so loading them in order keeps the same order
+    for (auto it = m_entries.rbegin(); it != m_entries.rend(); it++) {
+        WriteValue(fp, static_cast<int32_t>(it->signature.width));
+        WriteValue(fp, static_cast<int32_t>(it->signature.height));
+        fp.write(reinterpret_cast<const char*>(it->signature.thumbnail), CROP_THUMBNAIL_BYTES);
+        fp.write(reinterpret_cast<const char*>(it->output.data()), m_output_bytes);
+    }
+    fp.close();
+
+    std::error_code error;
+    if (!fp.good()) {
+        std::filesystem::remove(temp_filepath, error);
+        throw std::runtime_error(fmt::format("Failed to write crop cache to {}", m_filepath));
+    }
+    std::filesystem::rename(temp_filepath, m_filepath, error);
+    if (error) {
+        const std::string message = error.message();
+        std::filesystem::remove(temp_filepath, error);
+        throw std::runtime_error(fmt::format(
+            "Failed to replace crop cache {}: {}", m_filepath, message));
+    }
+}
+
+// a missing file, or one written for another model or thumbnail, leaves the cache empty
+void CropCache::Load() {
+    std::ifstream fp(m_filepath, std::ios::binary);
+    if (!fp.is_open()) {
+        return;
+    }
+
+    uint32_t magic, version, thumbnail_bytes, output_bytes, total_entries;
+    uint64_t model_hash;
+    if (!ReadValue(fp, magic) || (magic != CROP_CACHE_FILE_MAGIC)) return;
+    if (!ReadValue(fp, version) || (version != CROP_CACHE_FILE_VERSION)) return;
+    if (!ReadValue(fp, model_hash) || (model_hash != m_model_hash)) return;
+    if (!ReadValue(fp, thumbnail_bytes) || (thumbnail_bytes != CROP_THUMBNAIL_BYTES)) return;
+    if (!ReadValue(fp, output_bytes) || (output_bytes != m_output_bytes)) return;
+    if (!ReadValue(fp, total_entries)) return;
+
+    CropSignature signature;
+    std::vector<uint8_t> output(m_output_bytes);
+    for (uint32_t i = 0; i < total_entries; i++) {
+        int32_t width, height;
+        if (!ReadValue(fp, width) || !ReadValue(fp, height)) break;
+        fp.read(reinterpret_cast<char*>(signature.thumbnail), CROP_THUMBNAIL_BYTES);
+        fp.read(reinterpret_cast<char*>(output.data()), m_output_bytes);
+        if (!fp.good()) break;
+        signature.width = width;
+        signature.height = height;
+        signature.hash = HashSignature(signature);
+        Insert(signature, output.data());
+    }
+}
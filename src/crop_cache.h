@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// crops are reduced to a thumbnail of this many cells per side, with the mean rgb of each cell
+constexpr int CROP_THUMBNAIL_SIZE = 16;
+constexpr int CROP_THUMBNAIL_BYTES = CROP_THUMBNAIL_SIZE*CROP_THUMBNAIL_SIZE*3;
+
+struct CropSignature {
+    uint64_t hash;
+    int width;
+    int height;
+    alignas(16) uint8_t thumbnail[CROP_THUMBNAIL_BYTES];
+};
+
+// downsamples an rgba crop into its thumbnail and hashes it along with the crop size
+void GetCropSignature(const uint8_t *data, const int width, const int height, const int row_stride, CropSignature &signature);
+
+// hash of the contents of a file, so a persisted cache isn't used with a different model
+// returns 0 if the file can't be read
+uint64_t GetFileHash(const char *filepath);
+
+// raw outputs of a model for the crops it has already seen, keyed by the signature of the crop
+// a crop matches an entry of the same size whose thumbnail is the same, or within the tolerance
+// of every byte when the tolerance isn't 0
+// the least recently used entries are evicted, and the entries can optionally persist to a file
+class CropCache
+{
+private:
+    struct Entry {
+        CropSignature signature;
+        std::vector<uint8_t> output;
+    };
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_map<uint64_t, EntryList::iterator> EntryLookup;
+private:
+    const size_t m_max_entries;
+    const size_t m_output_bytes;
+    std::string m_filepath;
+    uint64_t m_model_hash;
+    EntryList m_entries;
+    EntryLookup m_lookup;
+    // evicted entries and lookup nodes are kept so a full cache doesn't allocate on a miss
+    EntryList m_free_entries;
+    EntryLookup::node_type m_free_node;
+    int m_tolerance;
+
+    int m_total_hits;
+    int m_total_near_hits;
+    int m_total_misses;
+public:
+    // entries are loaded from the file if it was written for the same model
+    CropCache(const size_t max_entries, const size_t output_bytes, const char *filepath=nullptr, const uint64_t model_hash=0);
+    // returns the outputs of the matching entry, or nullptr on a miss
+    const uint8_t *Find(const CropSignature &signature);
+    void Insert(const CropSignature &signature, const uint8_t *output);
+    void Clear();
+    // writes every entry to the file, does nothing without a file and throws if it can't be written
+    void Save() const;
+
+    inline int GetTolerance() const { return m_tolerance; }
+    inline void SetTolerance(const int v) { m_tolerance = v; }
+    inline int GetTotalHits() const { return m_total_hits; }
+    // hits which weren't an exact match of the thumbnail
+    inline int GetTotalNearHits() const { return m_total_near_hits; }
+    inline int GetTotalMisses() const { return m_total_misses; }
+    inline int GetTotalEntries() const { return static_cast<int>(m_entries.size()); }
+private:
+    Entry *FindNearest(const CropSignature &signature);
+    void UnlinkEntry(EntryLookup::iterator it);
+    void Load();
+};
@@ -0,0 +1,155 @@
+#include "crop_sampler.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CROP_SAMPLER_SSE2
+#include <emmintrin.h>
+#endif
+
+CropSampler::CropSampler(const int src_width, const int src_height, const int dst_width, const int dst_height)
+: m_src_width(src_width), m_src_height(src_height),
+  m_dst_width(dst_width), m_dst_height(dst_height)
+{
+    if ((src_width <= 0) || (src_height <= 0) || (dst_width <= 0) || (dst_height <= 0)) {
+        throw std::runtime_error(fmt::format(
+            "Can't sample a crop of ({},{}) into ({},{})",
+            src_width, src_height, dst_width, dst_height));
+    }
+    m_x_axis = CreateAxis(src_width, dst_width, 1.0f, false);
+    // the model expects rows top down, while the capture is bottom up
+    // normalizing to [0,1] is folded into the row weights
+    m_y_axis = CreateAxis(src_height, dst_height, 1.0f/255.0f, true);
+}
+
+CropSampler::Axis CropSampler::CreateAxis(const int src_size, const int dst_size, const float scale, const bool is_flipped) {
+    const float ratio = (float)src_size / (float)dst_size;
+    const float radius = std::max(1.0f, ratio);
+
+    Axis axis;
+    axis.total_taps = (int)ceilf(2.0f*radius) + 1;
+    axis.indices.resize(dst_size*axis.total_taps, 0);
+    axis.weights.resize(dst_size*axis.total_taps, 0.0f);
+
+    for (int i = 0; i < dst_size; i++) {
+        const int j = is_flipped ? (dst_size-i-1) : i;
+        const float center = ((float)j + 0.5f)*ratio - 0.5f;
+        const int first = (int)floorf(center - radius) + 1;
+
+        int *indices = &axis.indices[i*axis.total_taps];
+        float *weights = &axis.weights[i*axis.total_taps];
+        float total_weight = 0.0f;
+        for (int k = 0; k < axis.total_taps; k++) {
+            const int index = first + k;
+            const float weight = std::max(0.0f, 1.0f - fabsf((float)index - center)/radius);
+            // pixels past the edge repeat the edge
+            indices[k] = std::clamp(index, 0, src_size-1);
+            weights[k] = weight;
+            total_weight += weight;
+        }
+        for (int k = 0; k < axis.total_taps; k++) {
+            weights[k] *= scale / total_weight;
+        }
+    }
+    return axis;
+}
+
+template <typename F>
+void CropSampler::ForEachPixel(
+    const uint8_t *data, const int row_stride, 
+    RGBA<uint8_t> *resize_buffer, F &&write) const
+{
+    const int total_x_taps = m_x_axis.total_taps;
+    const int total_y_taps = m_y_axis.total_taps;
+
+    for (int y = 0; y < m_dst_height; y++) {
+        const int *y_indices = &m_y_axis.indices[y*total_y_taps];
+        const float *y_weights = &m_y_axis.weights[y*total_y_taps];
+
+        for (int x = 0; x < m_dst_width; x++) {
+            const int *x_indices = &m_x_axis.indices[x*total_x_taps];
+            const float *x_weights = &m_x_axis.weights[x*total_x_taps];
+            float pixel[4];
+
+#ifdef CROP_SAMPLER_SSE2
+            // all four channels of a pixel are sampled together
+            const __m128i zero = _mm_setzero_si128();
+            __m128 acc = _mm_setzero_ps();
+            for (int ty = 0; ty < total_y_taps; ty++) {
+                const uint8_t *row = data + y_indices[ty]*row_stride;
+                __m128 row_acc = _mm_setzero_ps();
+                for (int tx = 0; tx < total_x_taps; tx++) {
+                    int32_t rgba;
+                    memcpy(&rgba, row + x_indices[tx]*4, sizeof(rgba));
+                    const __m128i v8 = _mm_cvtsi32_si128(rgba);
+                    const __m128i v32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v8, zero), zero);
+                    row_acc = _mm_add_ps(row_acc, _mm_mul_ps(_mm_cvtepi32_ps(v32), _mm_set1_ps(x_weights[tx])));
+                }
+                acc = _mm_add_ps(acc, _mm_mul_ps(row_acc, _mm_set1_ps(y_weights[ty])));
+            }
+            _mm_storeu_ps(pixel, acc);
+#else
+            pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0.0f;
+            for (int ty = 0; ty < total_y_taps; ty++) {
+                const uint8_t *row = data + y_indices[ty]*row_stride;
+                float row_acc[3] = {0.0f, 0.0f, 0.0f};
+                for (int tx = 0; tx < total_x_taps; tx++) {
+                    const uint8_t *p = row + x_indices[tx]*4;
+                    row_acc[0] += (float)p[0] * x_weights[tx];
+                    row_acc[1] += (float)p[1] * x_weights[tx];
+                    row_acc[2] += (float)p[2] * x_weights[tx];
+                }
+                pixel[0] += row_acc[0] * y_weights[ty];
+                pixel[1] += row_acc[1] * y_weights[ty];
+                pixel[2] += row_acc[2] * y_weights[ty];
+            }
+#endif
+            const int i = x + y*m_dst_width;
+            write(i, pixel);
+
+            if (resize_buffer != nullptr) {
+                // kept bottom up like the capture for the model view
+                const auto ToByte = [](const float v) {
+                    return (uint8_t)std::clamp(v*255.0f + 0.5f, 0.0f, 255.0f);
+                };
+                const int j = x + (m_dst_height-y-1)*m_dst_width;
+                resize_buffer[j] = {ToByte(pixel[0]), ToByte(pixel[1]), ToByte(pixel[2]), 255};
+            }
+        }
+    }
+}
+
+void CropSampler::Sample(
+    const uint8_t *data, const int row_stride,
+    RGB<float> *dst, RGBA<uint8_t> *resize_buffer) const
+{
+    ForEachPixel(data, row_stride, resize_buffer, [dst](const int i, const float *pixel) {
+        dst[i] = {pixel[0], pixel[1], pixel[2]};
+    });
+}
+
+void CropSampler::SampleQuantized(
+    const uint8_t *data, const int row_stride,
+    uint8_t *dst, const float scale, const int zero_point, const bool is_signed,
+    RGBA<uint8_t> *resize_buffer) const
+{
+    if (scale <= 0.0f) {
+        throw std::runtime_error(fmt::format("Invalid input quantization scale {}", scale));
+    }
+    // int8 values are written as their two's complement byte
+    const float inv_scale = 1.0f / scale;
+    const float offset = (float)zero_point + 0.5f;
+    const float min_value = is_signed ? -128.0f : 0.0f;
+    const float max_value = is_signed ? 127.0f : 255.0f;
+    ForEachPixel(data, row_stride, resize_buffer, [&](const int i, const float *pixel) {
+        for (int c = 0; c < 3; c++) {
+            const float q = std::clamp(floorf(pixel[c]*inv_scale + offset), min_value, max_value);
+            dst[3*i + c] = (uint8_t)(int8_t)(int)q;
+        }
+    });
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "buffer_graphics.h"
+
+// resamples crops of one size into the input of a model
+// crops are read straight from the bottom up RGBA capture buffer and written top down as floats in [0,1],
+// so resizing, flipping and normalizing is done in a single pass over the crop
+class CropSampler
+{
+private:
+    // source taps of each output coordinate, padded with zero weights to the same count
+    struct Axis {
+        int total_taps;
+        std::vector<int> indices;
+        std::vector<float> weights;
+    };
+    int m_src_width;
+    int m_src_height;
+    int m_dst_width;
+    int m_dst_height;
+    Axis m_x_axis;
+    Axis m_y_axis;
+public:
+    CropSampler(const int src_width, const int src_height, const int dst_width, const int dst_height);
+    // data points to the bottom left pixel of the crop
+    // resize_buffer gets the resized crop as bytes, bottom up like the capture, and can be null
+    void Sample(
+        const uint8_t *data, const int row_stride,
+        RGB<float> *dst, RGBA<uint8_t> *resize_buffer=nullptr) const;
+    // same as above, but written as quantized bytes for models with a uint8 or int8 input
+    // each normalized value v becomes round(v/scale + zero_point), which is the raw pixel when scale=1/255
+    void SampleQuantized(
+        const uint8_t *data, const int row_stride,
+        uint8_t *dst, const float scale, const int zero_point, const bool is_signed,
+        RGBA<uint8_t> *resize_buffer=nullptr) const;
+    inline bool IsSameSize(const int src_width, const int src_height) const {
+        return (m_src_width == src_width) && (m_src_height == src_height);
+    }
+private:
+    // calls write(i, pixel) with the normalized channels of each output pixel, top down
+    template <typename F>
+    void ForEachPixel(
+        const uint8_t *data, const int row_stride, 
+        RGBA<uint8_t> *resize_buffer, F &&write) const;
+    // a tent filter which widens to cover every source pixel when downsampling
+    static Axis CreateAxis(const int src_size, const int dst_size, const float scale, const bool is_flipped);
+};
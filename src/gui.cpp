@@ -7,6 +7,7 @@
 
 
 #include <algorithm>
+#include <utility>
 #include <fmt/core.h>
 #include <ctype.h>
 
@@ -148,6 +149,97 @@ void RenderStatistics(App &app) {
     ImGui::Separator();
     ImGui::Text("node pool size = %d", app.GetNodePoolSize());
     ImGui::Text("node pool capacity = %d", app.GetNodePoolCapacity());
+    ImGui::Separator();
+    {
+        const auto GetSolveLabel = [](wordblitz::SolveType t) {
+            switch (t) {
+            case wordblitz::SolveType::SOLVE_RESCORE:   return "rescore";
+            case wordblitz::SolveType::SOLVE_PARTIAL:   return "partial";
+            case wordblitz::SolveType::SOLVE_FULL:      return "full";
+            case wordblitz::SolveType::SOLVE_NONE:
+            default:
+                return "none";
+            }
+        };
+        auto &solver = app.GetSolver();
+        ImGui::Text("last solve = %s", GetSolveLabel(solver.GetLastSolveType()));
+        ImGui::Text("changed cells = %d", solver.GetLastChangedCells());
+        ImGui::Text("search results = %d", static_cast<int>(solver.GetResults().size()));
+    }
+    {
+        auto &cache = app.GetSolveCache();
+        ImGui::Text("solve cache = %d hits, %d misses", cache.GetTotalHits(), cache.GetTotalMisses());
+        ImGui::Text("solve cache entries = %d", cache.GetTotalEntries());
+    }
+    ImGui::Separator();
+    {
+        auto &model = app.GetModel();
+        const std::pair<const char*, CropCache*> caches[3] = {
+            {"bonuses", model.m_crops_bonuses.get()},
+            {"characters", model.m_crops_characters.get()},
+            {"values", model.m_crops_values.get()},
+        };
+        for (auto &[name, cache]: caches) {
+            if (cache == nullptr) {
+                continue;
+            }
+            const int total = cache->GetTotalHits() + cache->GetTotalMisses();
+            const float hit_rate = (total > 0) ? (100.0f * (float)cache->GetTotalHits() / (float)total) : 0.0f;
+            ImGui::Text("%s crop cache = %.1f%% hits (%d near), %d misses, %d entries", 
+                name, hit_rate, cache->GetTotalNearHits(), cache->GetTotalMisses(), cache->GetTotalEntries());
+        }
+        auto &colours = model.m_bonus_colours;
+        const int total_bonuses = colours.GetTotalFast() + colours.GetTotalFallbacks() + colours.GetTotalAudits();
+        const float fast_rate = (total_bonuses > 0) ? (100.0f * (float)colours.GetTotalFast() / (float)total_bonuses) : 0.0f;
+        const float agreement = (colours.GetTotalAudits() > 0) ? 
+            (100.0f * (float)colours.GetTotalAgreements() / (float)colours.GetTotalAudits()) : 0.0f;
+        ImGui::Text("bonus colours = %.1f%% fast, %d fallbacks, %d/5 calibrated", 
+            fast_rate, colours.GetTotalFallbacks(), colours.GetTotalCalibrated());
+        ImGui::Text("bonus colour audits = %.1f%% agree of %d", agreement, colours.GetTotalAudits());
+        if (ImGui::Button("Clear crop caches")) {
+            for (auto &[name, cache]: caches) {
+                if (cache != nullptr) {
+                    cache->Clear();
+                }
+            }
+        }
+    }
+    ImGui::Separator();
+    for (auto &tuning: app.GetModelTunings()) {
+        const auto &config = tuning.result.config;
+        ImGui::Text("%s = %s, batch %d, %d interpreters, %.0f us", 
+            tuning.model.c_str(), GetModelEngineName(config.engine),
+            config.batch_size, config.total_interpreters, tuning.result.read_us);
+    }
+    ImGui::Separator();
+#ifdef WORDBLITZ_SEARCH_STATS
+    {
+        auto lock = std::shared_lock(app.GetTraceMutex());
+        auto &stats = app.GetSearchStats();
+        ImGui::Text("nodes entered = %llu", static_cast<unsigned long long>(stats.nodes_entered));
+        ImGui::Text("child misses = %llu", static_cast<unsigned long long>(stats.child_misses));
+        ImGui::Text("max depth = %d", stats.max_depth);
+        ImGui::Text("results = %llu", static_cast<unsigned long long>(stats.results));
+        ImGui::Text("duplicates dropped = %llu", static_cast<unsigned long long>(stats.duplicates_dropped));
+        // a slow start cell points at the part of the board which is expensive
+        auto &times = stats.start_cell_us;
+        if (!times.empty()) {
+            const auto it = std::max_element(times.begin(), times.end());
+            const int width = app.GetParams().grid.width;
+            const int i = static_cast<int>(it - times.begin());
+            ImGui::Text("slowest start cell = (%d, %d) %.1f us", i % width, i / width, *it);
+        }
+        if (ImGui::TreeNode("Start cell times (us)")) {
+            const int width = app.GetParams().grid.width;
+            for (int i = 0; i < static_cast<int>(times.size()); i++) {
+                ImGui::Text("(%d, %d) %.1f", i % width, i / width, times[i]);
+            }
+            ImGui::TreePop();
+        }
+    }
+#else
+    ImGui::Text("search stats are off, build with WORDBLITZ_SEARCH_STATS");
+#endif
 
     ImGui::End();
 }
@@ -156,6 +248,7 @@ void RenderBuffers(App &app) {
     const auto screen_size = util::GetScreenSize();
 
     ImGui::Begin("Render");
+    bool is_model_view = false;
     if (ImGui::BeginTabBar("Views")) {
         if (ImGui::BeginTabItem("Screen view")) {
             RenderScreenImage(app);
@@ -164,9 +257,12 @@ void RenderBuffers(App &app) {
         if (ImGui::BeginTabItem("Model view")) {
             RenderModelImage(app);
             ImGui::EndTabItem();
+            is_model_view = true;
         }
         ImGui::EndTabBar();
     }
+    // the crops are only copied for the model view while it is visible
+    app.SetIsModelViewOpen(is_model_view);
     ImGui::End();
 } 
 
@@ -271,10 +367,10 @@ void RenderGridData(App &app) {
     };
 
     ImGuiTableFlags table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg;
-    if (ImGui::BeginTable("##grid_data", g.sqrt_size, table_flags)) {
+    if (ImGui::BeginTable("##grid_data", g.width, table_flags)) {
         ImGui::TableNextRow();
-        for (int y = 0; y < g.sqrt_size; y++) {
-            for (int x = 0; x < g.sqrt_size; x++) {
+        for (int y = 0; y < g.height; y++) {
+            for (int x = 0; x < g.width; x++) {
                 const int i = g.GetIndex(x, y);
                 auto &cell = g.GetCell(i);
 
@@ -327,6 +423,9 @@ void RenderTraces(App &app) {
     ImGui::Begin(label.c_str());
 
     RenderQuickControls(app);
+    if (app.GetIsPlanning()) {
+        ImGui::Text("planned traces = %d", app.GetTotalPlanned());
+    }
 
     // NOTE: we need to acquire lock here, since the controls may call Read
     // Read will try to acquire a unique lock onto the traces mutex, which can cause a deadlock
@@ -336,9 +435,10 @@ void RenderTraces(App &app) {
 
     ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
     ImGui::BeginChild("##traces_list");
-    if (ImGui::BeginTable("Traces", 2, flags)) {
+    if (ImGui::BeginTable("Traces", 3, flags)) {
         ImGui::TableSetupColumn("Word",  ImGuiTableColumnFlags_WidthStretch);
         ImGui::TableSetupColumn("Score", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Confidence", ImGuiTableColumnFlags_WidthStretch);
         ImGui::TableHeadersRow();
 
         TraceCount new_counts;
@@ -366,6 +466,8 @@ void RenderTraces(App &app) {
             ImGui::Text(t.word.c_str());
             ImGui::TableNextColumn();
             ImGui::Text("%d", t.value);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", t.confidence);
         }
 
         counts = new_counts;
@@ -403,6 +505,41 @@ void RenderQuickControls(App &app) {
             app.SetTracerSpeedMillis(ms_tracer);
         }
     }
+    {
+        auto &limits = app.GetSearchLimits();
+        ImGuiSliderFlags flags = ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_ClampOnInput;
+        ImGui::DragInt("Max traces (0 = all)", &limits.max_results, 1, 0, 1000, "%d", flags);
+        int ms_budget = static_cast<int>(limits.time_budget.count() / 1000);
+        if (ImGui::DragInt("Solve budget (ms, 0 = none)", &ms_budget, 1, 0, 1000, "%d", flags)) {
+            limits.time_budget = std::chrono::milliseconds(ms_budget);
+        }
+    }
+    {
+        auto &p = app.GetParams();
+        ImGuiSliderFlags flags = ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_ClampOnInput;
+        ImGui::DragInt("Letter candidates", &p.total_letter_candidates, 1, 1, 5, "%d", flags);
+        ImGui::DragFloat("Min confidence", &p.min_confidence, 0.01f, 0.0f, 1.0f, "%.2f", flags);
+        ImGui::DragFloat("Min trace confidence", &p.min_trace_confidence, 0.01f, 0.0f, 1.0f, "%.2f", flags);
+        ImGui::DragInt("Read threads (0 = auto)", &p.total_read_threads, 1, 0, 64, "%d", flags);
+        ImGui::Checkbox("Cache crops", &p.is_caching_crops);
+        ImGui::DragInt("Crop cache tolerance", &p.crop_cache_tolerance, 1, 0, 64, "%d", flags);
+        ImGui::Checkbox("Bonus colours", &p.is_classifying_bonus_colours);
+        ImGui::DragFloat("Bonus colour margin", &p.bonus_colour_margin, 0.01f, 0.0f, 1.0f, "%.2f", flags);
+        ImGui::DragInt("Bonus colour audits (0 = none)", &p.bonus_colour_audit_interval, 1, 0, 1000, "%d", flags);
+    }
+    {
+        bool v = app.GetIsPlanning();
+        if (ImGui::Checkbox("Plan traces", &v)) {
+            app.SetIsPlanning(v);
+        }
+        auto &plan = app.GetTracePlan();
+        ImGuiSliderFlags flags = ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_ClampOnInput;
+        int seconds_left = plan.time_budget_ms / 1000;
+        if (ImGui::DragInt("Round time left (s, 0 = all)", &seconds_left, 1, 0, 600, "%d", flags)) {
+            plan.time_budget_ms = seconds_left * 1000;
+        }
+        ImGui::DragFloat("Cursor travel (ms/cell)", &plan.travel_ms_per_cell, 0.5f, 0.0f, 500.0f, "%.1f", flags);
+    }
 
     if (ImGui::Button("Read")) {
         app.ReadScreen();
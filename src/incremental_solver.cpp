@@ -0,0 +1,283 @@
+#include "incremental_solver.h"
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+
+using namespace wordtree;
+
+namespace wordblitz {
+
+// state shared by every level of the partial search
+struct PartialSearch {
+    NodePool &pool;
+    const Topology &topology;
+    const char *characters;
+    const ScoreTable &scores;
+    const BoardMasks &masks;
+    const std::vector<uint8_t> &is_changed;
+    const std::vector<int> &changed_cells;
+    // number of moves from the k-th changed cell to cell i is at distances[k*size + i]
+    const std::vector<int> &distances;
+
+    uint8_t *visited;
+    char *word_stack;
+    Cursor *cursor_stack;
+    std::vector<SearchResult> &results;
+    ResultRecycler<SearchResult> &recycler;
+};
+
+// breadth first search over the adjacency since the board doesn't have to be a square grid
+static void GetCellDistances(
+    const Topology &topology, const int source,
+    int *distances, std::vector<int> &queue)
+{
+    const int size = topology.GetSize();
+    for (int i = 0; i < size; i++) {
+        distances[i] = std::numeric_limits<int>::max();
+    }
+
+    queue.clear();
+    queue.push_back(source);
+    distances[source] = 0;
+    for (size_t head = 0; head < queue.size(); head++) {
+        const int i = queue[head];
+        for (int j = topology.offsets[i]; j < topology.offsets[i+1]; j++) {
+            const int k = topology.adjacency[j];
+            if (distances[k] <= distances[i]+1) {
+                continue;
+            }
+            distances[k] = distances[i]+1;
+            queue.push_back(k);
+        }
+    }
+}
+
+// check if an unvisited changed cell can still be used by a word below this node
+// it needs to be within reach of the remaining letters, and its letter has to appear in the subtree
+static bool IsChangedCellReachable(const PartialSearch &s, const Node &node, const int cell_index) {
+    const int size = s.topology.GetSize();
+    for (size_t k = 0; k < s.changed_cells.size(); k++) {
+        const int i = s.changed_cells[k];
+        if (s.visited[i]) {
+            continue;
+        }
+        if (s.distances[k*size + cell_index] > node.max_depth) {
+            continue;
+        }
+        if ((node.subtree_mask >> s.masks.letters[i]) & 1u) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void RecursiveSearchChangedCells(
+    PartialSearch &s, const Node &node,
+    const int cell_index, int total_changed,
+    int depth, int letter_sum, int word_multiplier)
+{
+    // push
+    const int width = s.topology.width;
+    s.word_stack[depth] = s.characters[cell_index];
+    s.cursor_stack[depth] = {cell_index % width, cell_index / width};
+    letter_sum += s.scores.letter_scores[cell_index];
+    word_multiplier *= s.scores.word_multipliers[cell_index];
+    total_changed += s.is_changed[cell_index] ? 1 : 0;
+    const bool has_changed_cell = total_changed > 0;
+    const int length = depth+1;
+    WORDBLITZ_STAT(CountSearchNode(depth));
+
+    // paths which don't use a changed cell are still in the previous results
+    if (node.is_leaf && has_changed_cell) {
+        auto &r = s.recycler.Push(s.results);
+        r.path.assign(s.cursor_stack, s.cursor_stack+length);
+        r.word.assign(s.word_stack, s.word_stack+length);
+        r.value = word_multiplier*letter_sum + length;
+        r.confidence = 1.0f;
+        WORDBLITZ_STAT(GetSearchStats().results++);
+    }
+
+    const uint32_t letters = node.child_mask & s.masks.neighbour_letters[cell_index];
+    if (letters == 0) {
+        WORDBLITZ_STAT(GetSearchStats().child_misses++);
+        return;
+    }
+
+    s.visited[cell_index] = 1;
+    const bool is_searchable = has_changed_cell || IsChangedCellReachable(s, node, cell_index);
+    if (is_searchable) {
+        auto &topology = s.topology;
+        for (int j = topology.offsets[cell_index]; j < topology.offsets[cell_index+1]; j++) {
+            const int next_cell_index = topology.adjacency[j];
+            const uint8_t letter = s.masks.letters[next_cell_index];
+            if (s.visited[next_cell_index]) {
+                continue;
+            }
+            if (((letters >> letter) & 1u) == 0) {
+                WORDBLITZ_STAT(GetSearchStats().child_misses++);
+                continue;
+            }
+            RecursiveSearchChangedCells(
+                s, s.pool[node.children[letter]],
+                next_cell_index, total_changed,
+                depth+1, letter_sum, word_multiplier);
+        }
+    }
+    s.visited[cell_index] = 0;
+}
+
+IncrementalSolver::IncrementalSolver(NodePool &pool)
+: m_pool(pool)
+{
+    Reset();
+}
+
+void IncrementalSolver::Reset() {
+    m_topology = Topology{};
+    m_size = 0;
+    m_is_solved = false;
+    m_characters.clear();
+    m_values.clear();
+    m_modifiers.clear();
+    m_arena.results.Recycle(m_results);
+    m_last_solve = SolveType::SOLVE_NONE;
+    m_last_changed_cells = 0;
+}
+
+SolveType IncrementalSolver::Update(const Grid &grid) {
+    if (!m_is_solved || !IsSameTopology(grid.topology, m_topology)) {
+        Solve(grid);
+        m_last_solve = SolveType::SOLVE_FULL;
+        m_last_changed_cells = grid.size;
+        return m_last_solve;
+    }
+
+    auto &is_letter_changed = m_is_letter_changed;
+    is_letter_changed.assign(m_size, 0);
+    int total_letters_changed = 0;
+    int total_scores_changed = 0;
+    for (int i = 0; i < m_size; i++) {
+        if (grid.characters[i] != m_characters[i]) {
+            is_letter_changed[i] = 1;
+            total_letters_changed++;
+        } else if ((grid.values[i] != m_values[i]) || (grid.modifiers[i] != m_modifiers[i])) {
+            total_scores_changed++;
+        }
+    }
+
+    m_last_changed_cells = total_letters_changed + total_scores_changed;
+    if (m_last_changed_cells == 0) {
+        m_last_solve = SolveType::SOLVE_NONE;
+        return m_last_solve;
+    }
+
+    CopyGrid(grid);
+    FillScoreTable(grid, m_scores);
+    FillBoardMasks(grid, m_masks);
+
+    if (total_letters_changed == 0) {
+        Rescore();
+        m_last_solve = SolveType::SOLVE_RESCORE;
+        return m_last_solve;
+    }
+
+    // invalidate paths which pass through the changed cells
+    // they are partitioned to the back instead of removed so their buffers can be reused
+    auto it = std::partition(m_results.begin(), m_results.end(), [this, &is_letter_changed](const SearchResult &r) {
+        for (auto &c: r.path) {
+            if (is_letter_changed[c.x + c.y*m_topology.width]) {
+                return false;
+            }
+        }
+        return true;
+    });
+    m_arena.results.Recycle(m_results, static_cast<size_t>(it - m_results.begin()));
+
+    // rescore the paths that survived before adding the new ones
+    if (total_scores_changed > 0) {
+        Rescore();
+    }
+    SearchChangedCells(is_letter_changed);
+    m_last_solve = SolveType::SOLVE_PARTIAL;
+    return m_last_solve;
+}
+
+std::vector<TraceResult> IncrementalSolver::GetTraces() {
+    return GetTraceFromSearch(m_results);
+}
+
+void IncrementalSolver::GetTraces(std::vector<TraceResult> &traces) {
+    GetTraceFromSearch(m_results, m_arena, traces);
+}
+
+void IncrementalSolver::Solve(const Grid &grid) {
+    m_topology = grid.topology;
+    m_size = grid.size;
+    CopyGrid(grid);
+    FillScoreTable(grid, m_scores);
+    FillBoardMasks(grid, m_masks);
+    SearchWordTree(m_pool, grid, m_arena, m_results);
+    m_is_solved = true;
+}
+
+void IncrementalSolver::CopyGrid(const Grid &grid) {
+    m_characters.assign(grid.characters, grid.characters+grid.size);
+    m_values.assign(grid.values, grid.values+grid.size);
+    m_modifiers.assign(grid.modifiers, grid.modifiers+grid.size);
+}
+
+void IncrementalSolver::Rescore() {
+    for (auto &r: m_results) {
+        int letter_sum = 0;
+        int word_multiplier = 1;
+        for (auto &c: r.path) {
+            const int i = c.x + c.y*m_topology.width;
+            letter_sum += m_scores.letter_scores[i];
+            word_multiplier *= m_scores.word_multipliers[i];
+        }
+        r.value = word_multiplier*letter_sum + static_cast<int>(r.path.size());
+    }
+}
+
+void IncrementalSolver::SearchChangedCells(const std::vector<uint8_t> &is_changed) {
+    auto &changed_cells = m_changed_cells;
+    changed_cells.clear();
+    for (int i = 0; i < m_size; i++) {
+        if (is_changed[i]) {
+            changed_cells.push_back(i);
+        }
+    }
+
+    auto &distances = m_distances;
+    distances.resize(changed_cells.size()*m_size);
+    for (size_t k = 0; k < changed_cells.size(); k++) {
+        GetCellDistances(m_topology, changed_cells[k], &distances[k*m_size], m_queue);
+    }
+
+    const int max_length = std::min(GetMaxWordLength(m_pool), m_size);
+    m_arena.visited.assign(m_size, 0);
+    m_arena.word_stack.assign(max_length+1, 0);
+    m_arena.cursor_stack.assign(max_length+1, {-1,-1});
+
+    PartialSearch s = {
+        m_pool, m_topology, m_characters.data(), m_scores, m_masks,
+        is_changed, changed_cells, distances,
+        m_arena.visited.data(),
+        m_arena.word_stack.data(), m_arena.cursor_stack.data(),
+        m_results, m_arena.results
+    };
+
+    const Node &root = m_pool[0];
+    for (int i = 0; i < m_size; i++) {
+        const uint8_t letter = m_masks.letters[i];
+        if (((root.child_mask >> letter) & 1u) == 0) {
+            WORDBLITZ_STAT(GetSearchStats().child_misses++);
+            continue;
+        }
+        WORDBLITZ_STAT(const auto cell_start = std::chrono::steady_clock::now());
+        RecursiveSearchChangedCells(s, m_pool[root.children[letter]], i, 0, 0, 0, 1);
+        WORDBLITZ_STAT(AddStartCellTime(i, cell_start));
+    }
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include "wordtree.h"
+#include "wordblitz.h"
+
+namespace wordblitz {
+
+enum SolveType {
+    SOLVE_NONE, SOLVE_RESCORE, SOLVE_PARTIAL, SOLVE_FULL
+};
+
+// keeps the search results of the last board that was solved
+// letter changes only re-search the paths that can pass through the changed cells
+// value and modifier changes rescore the previous results without searching
+class IncrementalSolver
+{
+private:
+    wordtree::NodePool &m_pool;
+    Topology m_topology;
+    int m_size;
+    bool m_is_solved;
+
+    std::vector<char> m_characters;
+    std::vector<int> m_values;
+    std::vector<CellModifier> m_modifiers;
+    ScoreTable m_scores;
+    BoardMasks m_masks;
+    std::vector<SearchResult> m_results;
+
+    // buffers kept between updates so updates don't allocate once they have grown
+    SearchArena m_arena;
+    std::vector<uint8_t> m_is_letter_changed;
+    std::vector<int> m_changed_cells;
+    std::vector<int> m_distances;
+    std::vector<int> m_queue;
+
+    SolveType m_last_solve;
+    int m_last_changed_cells;
+public:
+    IncrementalSolver(wordtree::NodePool &pool);
+    SolveType Update(const Grid &grid);
+    std::vector<TraceResult> GetTraces();
+    // refills traces in place
+    void GetTraces(std::vector<TraceResult> &traces);
+    void Reset();
+
+    inline const std::vector<SearchResult>& GetResults() const { return m_results; }
+    inline SolveType GetLastSolveType() const { return m_last_solve; }
+    inline int GetLastChangedCells() const { return m_last_changed_cells; }
+private:
+    void Solve(const Grid &grid);
+    void CopyGrid(const Grid &grid);
+    void Rescore();
+    void SearchChangedCells(const std::vector<uint8_t> &is_changed);
+};
+
+}
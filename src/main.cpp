@@ -7,6 +7,7 @@
 #include "imgui_impl_dx11.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <memory>
 
@@ -33,13 +34,35 @@ void CreateRenderTarget();
 void CleanupRenderTarget();
 LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
-int run_app();
+int run_app(const AppModelOptions &model_options);
 
 // Main code
 int main(int argc, char **argv)
 {
+    // --builtin-models runs the models without tensorflow lite
+    // --check-models compares both engines before starting
+    // --retune-models times the configurations of every model again
+    // --persist-crop-cache keeps the crops each model has read between launches
+    AppModelOptions model_options;
+    bool is_checking_models = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--builtin-models") == 0) {
+            model_options.is_engine_forced = true;
+            model_options.engine = MODEL_ENGINE_BUILTIN;
+        } else if (strcmp(argv[i], "--check-models") == 0) {
+            is_checking_models = true;
+        } else if (strcmp(argv[i], "--retune-models") == 0) {
+            model_options.is_retuning = true;
+        } else if (strcmp(argv[i], "--persist-crop-cache") == 0) {
+            model_options.is_persisting_crops = true;
+        }
+    }
+
     try {
-        return run_app();
+        if (is_checking_models) {
+            CheckModelEngines();
+        }
+        return run_app(model_options);
     } catch (std::exception &ex) {
         std::cerr << ex.what() << std::endl;
     }
@@ -47,7 +70,7 @@ int main(int argc, char **argv)
     return 1;
 }
 
-int run_app() {
+int run_app(const AppModelOptions &model_options) {
     // Create application window
     //ImGui_ImplWin32_EnableDpiAwareness();
     WNDCLASSEX wc = { sizeof(WNDCLASSEX), CS_CLASSDC, WndProc, 0L, 0L, GetModuleHandle(NULL), NULL, NULL, NULL, NULL, _T("Wordblitz Bot"), NULL };
@@ -118,7 +141,7 @@ int run_app() {
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
     // create app after setting up the dx11 context
-    auto main_app = App(g_pd3dDevice, g_pd3dDeviceContext);
+    auto main_app = App(g_pd3dDevice, g_pd3dDeviceContext, model_options);
 
     // Main loop
     bool done = false;
@@ -1,57 +1,35 @@
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#include "stb/stb_image_resize.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
 #include <stdio.h>
-#include <chrono>
-#include <thread>
+#include <algorithm>
 #include <stdexcept>
 
 #include <fmt/core.h>
 
-#include "tensorflow/lite/c/c_api.h"
-#include "tensorflow/lite/c/common.h"
-
 #include "model.h"
 
-static void PrintTfLiteModelSummary(TfLiteInterpreter *interpreter);
-static void PrintTfLiteTensorSummary(const TfLiteTensor *tensor);
-
-Model::Model(const char *filepath)
+Model::Model(const char *filepath, const ModelEngine engine)
 {
     // load model
-    m_model = TfLiteModelCreateFromFile(filepath);
-    m_options = TfLiteInterpreterOptionsCreate();
-    // const uint32_t num_threads = std::thread::hardware_concurrency();
-    // NOTE: disable threading since the overhead due to multithread is too high
-    const uint32_t num_threads = 1;
-    TfLiteInterpreterOptionsSetNumThreads(m_options, num_threads);
-    // Create the interpreter.
-    m_interp = TfLiteInterpreterCreate(m_model, m_options);
-    // Allocate tensors and populate the input tensor data.
-    TfLiteInterpreterAllocateTensors(m_interp);
+    m_backend = LoadModelBackend(filepath, engine);
+    m_interpreters.push_back(m_backend->CreateSession());
+    m_input_info = m_backend->GetInputInfo();
+    m_output_info = m_backend->GetOutputInfo();
 
     // verify input size matches
-    TfLiteTensor* input_tensor = TfLiteInterpreterGetInputTensor(m_interp, 0);
-    if (input_tensor->dims->size != 4) {
+    const auto &input_dims = m_input_info.dims;
+    if (input_dims.size() != 4) {
         throw std::runtime_error(fmt::format(
             "Model expected input tensor shape of dimension 4, got {}",
-            input_tensor->dims->size
+            input_dims.size()
         ));
     }
 
-    size_t input_size = 1; 
-    {
-        for (int i = 0; i < input_tensor->dims->size; i++) {
-            input_size *= input_tensor->dims->data[i];
-        }
-    }
-
     // format of input tensor shape is: (1,height,width,channels)
-    m_height = input_tensor->dims->data[1];
-    m_width = input_tensor->dims->data[2];
-    m_channels = input_tensor->dims->data[3];
+    m_height = input_dims[1];
+    m_width = input_dims[2];
+    m_channels = input_dims[3];
     m_num_pixels = m_height * m_width;
 
     if (m_channels != 3) {
@@ -61,124 +39,251 @@ Model::Model(const char *filepath)
     }
 
     // verify output size matches
-    const TfLiteTensor* output_tensor = TfLiteInterpreterGetOutputTensor(m_interp, 0);
     m_output_size = 1; 
-    {
-        for (int i = 0; i < output_tensor->dims->size; i++) {
-            m_output_size *= output_tensor->dims->data[i];
-        }
+    for (const int dim: m_output_info.dims) {
+        m_output_size *= dim;
     }
 
     // allocate buffer after all checks completed
-    m_input_buffer = new RGB<float>[m_num_pixels]{0.0f,0.0f,0.0f};
-    m_resize_buffer = new RGBA<uint8_t>[m_num_pixels]{0,0,0,0};
-    m_output_buffer = new float[m_output_size]{0.0f};
+    m_batch_size = 1;
+    m_requested_batch_size = 1;
+    m_interpreter_batch_size = 1;
+    m_is_keeping_resize = false;
+    AllocateBuffers();
 }
 
 Model::~Model() {
-    // Dispose of the model and interpreter objects.
-    TfLiteInterpreterDelete(m_interp);
-    TfLiteInterpreterOptionsDelete(m_options);
-    TfLiteModelDelete(m_model);
-    delete[] m_input_buffer;
+    FreeBuffers();
+}
+
+void Model::AllocateBuffers() {
+    const int total_slots = GetTotalInterpreters()*m_interpreter_batch_size;
+    m_resize_buffer = new RGBA<uint8_t>[m_num_pixels*total_slots]{0,0,0,0};
+    UpdateTensorPointers();
+}
+
+void Model::FreeBuffers() {
     delete[] m_resize_buffer;
-    delete[] m_output_buffer;
 }
 
-void Model::Print() {
-    PrintTfLiteModelSummary(m_interp);
+static size_t GetTypeSize(const TensorType type) {
+    return (type == TENSOR_FLOAT32) ? sizeof(float) : sizeof(uint8_t);
 }
 
-bool Model::CopyDataToInput(const uint8_t *data, const int width, const int height, const int row_stride) {
-    // resize image here
-    stbir_resize_uint8(
-        data, width, height, row_stride,
-        (uint8_t*)m_resize_buffer, m_width, m_height, 0,
-        4);
+void Model::UpdateTensorPointers() {
+    const size_t input_bytes = GetTypeSize(m_input_info.type)*m_num_pixels*m_channels*m_interpreter_batch_size;
+    const size_t output_bytes = GetTypeSize(m_output_info.type)*m_output_size*m_interpreter_batch_size;
+    m_inputs.clear();
+    m_outputs.clear();
+    for (auto &interp: m_interpreters) {
+        if ((interp->GetInputBytes() != input_bytes) || (interp->GetOutputBytes() != output_bytes)) {
+            throw std::runtime_error(fmt::format(
+                "Model tensors of {}+{} bytes don't fit a batch of {}", 
+                interp->GetInputBytes(), interp->GetOutputBytes(), 
+                m_interpreter_batch_size));
+        }
+        m_inputs.push_back(reinterpret_cast<uint8_t*>(interp->GetInputData()));
+        m_outputs.push_back(reinterpret_cast<const uint8_t*>(interp->GetOutputData()));
+    }
+}
 
-    for (int y = 0; y < m_height; y++) {
-        for (int x = 0; x < m_width; x++) {
-            const int i = x + y*m_width;
+uint8_t *Model::GetInputBuffer(const int index) {
+    const int interpreter = index / m_interpreter_batch_size;
+    const int slot = index % m_interpreter_batch_size;
+    const size_t crop_bytes = GetTypeSize(m_input_info.type)*m_num_pixels*m_channels;
+    return m_inputs[interpreter] + slot*crop_bytes;
+}
 
-            // model requires the image to be flipped
-            // channels are also the same order
-            const int j = x + (m_height-y-1)*m_width;
+bool Model::SetBatchSize(const int batch_size) {
+    if (batch_size <= 0) {
+        throw std::runtime_error(fmt::format("Invalid batch size {}", batch_size));
+    }
+    return Configure(batch_size, GetTotalInterpreters());
+}
 
-            m_input_buffer[i].r = ((float)m_resize_buffer[j].r) / 255.0f;
-            m_input_buffer[i].g = ((float)m_resize_buffer[j].g) / 255.0f;
-            m_input_buffer[i].b = ((float)m_resize_buffer[j].b) / 255.0f;
+bool Model::SetTotalInterpreters(const int total_interpreters) {
+    if (total_interpreters <= 0) {
+        throw std::runtime_error(fmt::format("Invalid number of interpreters {}", total_interpreters));
+    }
+    return Configure(m_requested_batch_size, total_interpreters);
+}
+
+bool Model::Configure(const int batch_size, const int total_interpreters) {
+    // an interpreter without any crops would never be invoked
+    const int total = std::min(total_interpreters, batch_size);
+    const int interpreter_batch_size = (batch_size + total - 1) / total;
+    m_requested_batch_size = batch_size;
+    if ((total == GetTotalInterpreters()) && (interpreter_batch_size == m_interpreter_batch_size)) {
+        m_batch_size = batch_size;
+        return true;
+    }
+
+    m_interpreters.resize(std::min(GetTotalInterpreters(), total));
+    while (GetTotalInterpreters() < total) {
+        m_interpreters.push_back(m_backend->CreateSession());
+    }
+
+    const size_t output_bytes = GetTypeSize(m_output_info.type)*m_output_size;
+    const auto Resize = [output_bytes](ModelSession &interp, const int n) {
+        if (!interp.Resize(n)) {
+            return false;
         }
+        // every crop should get its own row of outputs
+        return interp.GetOutputBytes() == (n*output_bytes);
+    };
+
+    bool is_resized = true;
+    for (auto &interp: m_interpreters) {
+        is_resized = is_resized && Resize(*interp, interpreter_batch_size);
     }
-    return true;
-}
-
-void Model::Parse() {
-    TfLiteTensor* input_tensor = TfLiteInterpreterGetInputTensor(m_interp, 0);
-    const TfLiteTensor* output_tensor = TfLiteInterpreterGetOutputTensor(m_interp, 0);
-    // Copy and run
-    const int num_channels = 3;
-    TfLiteTensorCopyFromBuffer(input_tensor, m_input_buffer, m_num_pixels*m_channels*sizeof(float));
-    TfLiteInterpreterInvoke(m_interp);
-    // Extract the output tensor data.
-    TfLiteTensorCopyToBuffer(
-        output_tensor, 
-        m_output_buffer, sizeof(float)*m_output_size);
-}
-
-void Model::RunBenchmark(const int n) {
-    // Time the average duration of an invoke
-    float ms_avg_invoke = 0.0f;
-    for (int i = 0; i < n; i++) {
-        auto timer_start = std::chrono::high_resolution_clock::now();
-        TfLiteInterpreterInvoke(m_interp);
-        auto timer_end = std::chrono::high_resolution_clock::now();
-        long long ms_start = std::chrono::time_point_cast<std::chrono::milliseconds>(timer_start).time_since_epoch().count();
-        long long ms_end = std::chrono::time_point_cast<std::chrono::milliseconds>(timer_end).time_since_epoch().count();
-        long long ms_dt = ms_end-ms_start;
-        ms_avg_invoke += (float)(ms_dt);
-    }
-    ms_avg_invoke /= (float)(n);
-    printf("%.2fms per invoke (N=%d)\n", ms_avg_invoke, n);
-}
-
-void PrintTfLiteModelSummary(TfLiteInterpreter *interpreter) {
-    int input_tensor_count = TfLiteInterpreterGetInputTensorCount(interpreter);
-    int output_tensor_count = TfLiteInterpreterGetOutputTensorCount(interpreter);
-    printf("inputs=%d, output=%d\n", input_tensor_count, output_tensor_count);
-
-    for (int i = 0; i < input_tensor_count; i++) {
-        const TfLiteTensor* input_tensor = TfLiteInterpreterGetInputTensor(interpreter, i);
-        printf("inp_tensor[%d]: ", i);
-        PrintTfLiteTensorSummary(input_tensor);
-    }
-
-    for (int i = 0; i < output_tensor_count; i++) {
-        const TfLiteTensor* output_tensor = TfLiteInterpreterGetOutputTensor(interpreter, i);
-        printf("out_tensor[%d]: ", i);
-        PrintTfLiteTensorSummary(output_tensor);
-    }
-}
-
-void PrintTfLiteTensorSummary(const TfLiteTensor *tensor) {
-    printf("%s (", tensor->name);
-    // size of tensor
-    for (int j = 0; j < tensor->dims->size; j++) {
-        int dim = tensor->dims->data[j];
-        if (j != tensor->dims->size-1) {
-            printf("%d,", dim);
-        } else {
-            printf("%d) ", dim);
+    if (!is_resized) {
+        for (auto &interp: m_interpreters) {
+            if (!Resize(*interp, 1)) {
+                throw std::runtime_error("Failed to restore the interpreter after resizing the batch");
+            }
         }
     }
-    // type of tensor
-    TfLiteType t = TfLiteTensorType(tensor);
-    printf("%s ", TfLiteTypeGetName(t));
-    // quantisation?
-    if (t == kTfLiteUInt8) {
-        TfLiteQuantizationParams qparams = TfLiteTensorQuantizationParams(tensor);
-        printf("[scale=%.2f, zero_point=%d]\n", qparams.scale, qparams.zero_point);
+
+    FreeBuffers();
+    m_interpreter_batch_size = is_resized ? interpreter_batch_size : 1;
+    m_batch_size = is_resized ? batch_size : total;
+    AllocateBuffers();
+    return is_resized;
+}
+
+void Model::GetInterpreterSlots(const int interpreter, int &first, int &count) const {
+    first = interpreter*m_interpreter_batch_size;
+    count = std::max(0, std::min(m_interpreter_batch_size, m_batch_size-first));
+}
+
+void Model::Print() {
+    m_backend->Print();
+}
+
+void Model::CopyDataToInput(const uint8_t *data, const int width, const int height, const int row_stride, const int index) {
+    if ((index < 0) || (index >= m_batch_size)) {
+        throw std::runtime_error(fmt::format(
+            "Crop {} is outside of the batch of {}", index, m_batch_size));
+    }
+    uint8_t *input = GetInputBuffer(index);
+    RGBA<uint8_t> *resize_buffer = m_is_keeping_resize ? (m_resize_buffer + index*m_num_pixels) : nullptr;
+
+    // resize, flip and normalize the crop in one pass
+    // model requires the image to be flipped, channels are also the same order
+    auto sampler = GetCropSampler(width, height);
+    if (m_input_info.type == TENSOR_FLOAT32) {
+        sampler->Sample(data, row_stride, reinterpret_cast<RGB<float>*>(input), resize_buffer);
     } else {
-        printf("\n");
+        sampler->SampleQuantized(
+            data, row_stride, input, 
+            m_input_info.scale, m_input_info.zero_point, m_input_info.type == TENSOR_INT8,
+            resize_buffer);
+    }
+}
+
+std::shared_ptr<const CropSampler> Model::GetCropSampler(const int width, const int height) {
+    // crops can be copied from different threads
+    auto lock = std::unique_lock(m_samplers_mutex);
+    for (auto &sampler: m_samplers) {
+        if (sampler->IsSameSize(width, height)) {
+            return sampler;
+        }
+    }
+    // croppers are resized by dragging them in the gui, so only the latest sizes are kept
+    const size_t MAX_SAMPLERS = 8;
+    if (m_samplers.size() >= MAX_SAMPLERS) {
+        m_samplers.erase(m_samplers.begin());
+    }
+    m_samplers.push_back(std::make_shared<const CropSampler>(width, height, m_width, m_height));
+    return m_samplers.back();
+}
+
+void Model::Invoke(const int interpreter) {
+    auto &interp = *m_interpreters[interpreter];
+    // the share of the batch was written straight into the input tensor
+    interp.Invoke();
+    // invoking can move outputs which are allocated dynamically
+    m_outputs[interpreter] = reinterpret_cast<const uint8_t*>(interp.GetOutputData());
+}
+
+void Model::ParseOutputs(const int total_crops) {
+    const int total = (total_crops < 0) ? m_batch_size : std::min(total_crops, m_batch_size);
+    ModelOutput output = {m_output_info.type, nullptr, m_output_info.scale, m_output_info.zero_point};
+    for (int i = 0; i < total; i++) {
+        output.data = GetOutputData(i);
+        ParseOutput(output, i);
     }
 }
 
+const uint8_t *Model::GetOutputData(const int index) const {
+    const int interpreter = index / m_interpreter_batch_size;
+    const int slot = index % m_interpreter_batch_size;
+    return m_outputs[interpreter] + slot*GetOutputBytes();
+}
+
+void Model::ParseRawOutput(const uint8_t *data, const int index) {
+    if ((index < 0) || (index >= m_batch_size)) {
+        throw std::runtime_error(fmt::format(
+            "Crop {} is outside of the batch of {}", index, m_batch_size));
+    }
+    const ModelOutput output = {m_output_info.type, data, m_output_info.scale, m_output_info.zero_point};
+    ParseOutput(output, index);
+}
+
+size_t Model::GetOutputBytes() const {
+    return GetTypeSize(m_output_info.type)*m_output_size;
+}
+
+void Model::GetOutputScores(const int index, float *scores) const {
+    const ModelOutput output = {m_output_info.type, GetOutputData(index), m_output_info.scale, m_output_info.zero_point};
+    output.Dequantize(0, m_output_size, scores);
+}
+
+void Model::Parse(const int total_crops) {
+    const int total = (total_crops < 0) ? m_batch_size : std::min(total_crops, m_batch_size);
+    for (int k = 0; k < GetTotalInterpreters(); k++) {
+        int first, count;
+        GetInterpreterSlots(k, first, count);
+        if (first < total) {
+            Invoke(k);
+        }
+    }
+    ParseOutputs(total);
+}
+
+template <typename T>
+static int ArgMax(const T *arr, const int N) {
+    T max_val = arr[0];
+    int max_index = 0; 
+    for (int i = 1; i < N; i++) {
+        if (arr[i] > max_val) {
+            max_val = arr[i];
+            max_index = i;
+        }
+    }
+    return max_index;
+}
+
+int ModelOutput::ArgMax(const int offset, const int N) const {
+    switch (type) {
+    case TENSOR_UINT8:  return ::ArgMax(reinterpret_cast<const uint8_t*>(data) + offset, N);
+    case TENSOR_INT8:   return ::ArgMax(reinterpret_cast<const int8_t*>(data) + offset, N);
+    default:            return ::ArgMax(reinterpret_cast<const float*>(data) + offset, N);
+    }
+}
+
+void ModelOutput::Dequantize(const int offset, const int N, float *dst) const {
+    for (int i = 0; i < N; i++) {
+        switch (type) {
+        case TENSOR_UINT8:
+            dst[i] = scale * (float)((int)reinterpret_cast<const uint8_t*>(data)[offset+i] - zero_point);
+            break;
+        case TENSOR_INT8:
+            dst[i] = scale * (float)((int)reinterpret_cast<const int8_t*>(data)[offset+i] - zero_point);
+            break;
+        default:
+            dst[i] = reinterpret_cast<const float*>(data)[offset+i];
+            break;
+        }
+    }
+}
@@ -1,9 +1,24 @@
 #pragma once
 
-#include "tensorflow/lite/c/c_api.h"
-#include "tensorflow/lite/c/common.h"
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "buffer_graphics.h"
+#include "crop_sampler.h"
+#include "model_backend.h"
+
+// scores of one crop, which point into the output tensor and may still be quantized
+struct ModelOutput {
+    TensorType type;
+    const void *data;
+    float scale;
+    int zero_point;
+
+    // raw quantized scores are compared directly, since they order the same as the dequantized scores
+    int ArgMax(const int offset, const int N) const;
+    void Dequantize(const int offset, const int N, float *dst) const;
+};
 
 class Model
 {
@@ -13,29 +28,86 @@ public:
         int y;
     };
 protected:
-    TfLiteModel *m_model;
-    TfLiteInterpreterOptions *m_options;
-    TfLiteInterpreter *m_interp;
+    // model loaded by either tensorflow lite or the builtin engine
+    std::shared_ptr<ModelBackend> m_backend;
+    // interpreters share the loaded model, and each one runs its own share of the batch
+    // so they can be invoked from different threads
+    std::vector<std::unique_ptr<ModelSession>> m_interpreters;
+    int m_interpreter_batch_size;
 
-    RGB<float> *m_input_buffer;
+    // crops are written straight into the input tensor of each interpreter
+    // and predictions are read from its output tensor
+    // the pointers are fetched again whenever the tensors are reallocated
+    std::vector<uint8_t*> m_inputs;
+    std::vector<const uint8_t*> m_outputs;
+    // float inputs and outputs, or uint8 and int8 which are fed and decoded without converting to float
+    TensorInfo m_input_info;
+    TensorInfo m_output_info;
+    // resized crops of the whole batch for the model view
     RGBA<uint8_t> *m_resize_buffer;
-    float *m_output_buffer;
     int m_output_size;
+    // number of crops which are run in a single invoke of every interpreter
+    int m_batch_size;
+    int m_requested_batch_size;
 
     int m_width;
     int m_height;
     int m_num_pixels;
     int m_channels;
+
+    // sampling tables of the most recent crop sizes
+    std::vector<std::shared_ptr<const CropSampler>> m_samplers;
+    std::mutex m_samplers_mutex;
+    // resized crops are only copied to the resize buffer while they are viewed
+    bool m_is_keeping_resize;
 public:
-    Model(const char *filepath);
-    ~Model();
+    Model(const char *filepath, const ModelEngine engine=GetDefaultModelEngine());
+    virtual ~Model();
+    // resizes the interpreters to run this many crops per invoke
+    // returns false if the model can't be resized, which leaves one crop per interpreter
+    // and a batch only as big as the number of interpreters
+    bool SetBatchSize(const int batch_size);
+    inline int GetBatchSize() const { return m_batch_size; }
+    // splits the batch between this many interpreters
+    bool SetTotalInterpreters(const int total_interpreters);
+    inline int GetTotalInterpreters() const { return static_cast<int>(m_interpreters.size()); }
+    // slots of the batch which are run by the interpreter
+    void GetInterpreterSlots(const int interpreter, int &first, int &count) const;
     // need to do a mapping to uint8_t to float
-    bool CopyDataToInput(const uint8_t *data, const int width, const int height, const int row_stride);
-    virtual void Parse();
-    inline RGB<float> *GetInputBuffer() { return m_input_buffer; }
-    inline RGBA<uint8_t> *GetResizeBuffer() { return m_resize_buffer; }
+    // the crop is written into the given slot of the batch
+    // crops in different slots can be copied from different threads, and a slot outside the batch throws
+    void CopyDataToInput(const uint8_t *data, const int width, const int height, const int row_stride, const int index=0);
+    // runs the share of the batch of one interpreter
+    // different interpreters can be invoked from different threads
+    void Invoke(const int interpreter);
+    // decodes the first total_crops predictions, total_crops < 0 decodes the entire batch
+    void ParseOutputs(const int total_crops=-1);
+    // invokes every interpreter then decodes the predictions
+    void Parse(const int total_crops=-1);
+    // raw scores of the crop in the given slot of the batch, which are GetOutputBytes() long
+    const uint8_t *GetOutputData(const int index=0) const;
+    // decodes raw scores which were copied from the output tensor into the given slot of the batch
+    void ParseRawOutput(const uint8_t *data, const int index=0);
+    size_t GetOutputBytes() const;
+    // dequantized scores of the crop in the given slot of the batch, which are GetOutputSize() long
+    void GetOutputScores(const int index, float *scores) const;
+    // input of the crop in the given slot of the batch, whose layout depends on the input type
+    uint8_t *GetInputBuffer(const int index=0);
+    inline TensorType GetInputType() const { return m_input_info.type; }
+    inline TensorType GetOutputType() const { return m_output_info.type; }
+    inline RGBA<uint8_t> *GetResizeBuffer(const int index=0) { return m_resize_buffer + index*m_num_pixels; }
+    inline bool GetIsKeepingResize() const { return m_is_keeping_resize; }
+    inline void SetIsKeepingResize(const bool v) { m_is_keeping_resize = v; }
     inline Vec2D GetInputSize() const { return {m_width, m_height}; }
     inline int GetOutputSize() const { return m_output_size; }
     void Print();
-    void RunBenchmark(const int n=100);
+protected:
+    // decodes the output of the crop in the given slot of the batch
+    virtual void ParseOutput(const ModelOutput &output, const int index) = 0;
+private:
+    std::shared_ptr<const CropSampler> GetCropSampler(const int width, const int height);
+    bool Configure(const int batch_size, const int total_interpreters);
+    void UpdateTensorPointers();
+    void AllocateBuffers();
+    void FreeBuffers();
 };
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "model_backend.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "tiny_cnn.h"
+#ifdef WORDBLITZ_TFLITE
+#include "tflite_backend.h"
+#endif
+
+const char *GetTensorTypeName(const TensorType type) {
+    switch (type) {
+    case TENSOR_FLOAT32:    return "float32";
+    case TENSOR_UINT8:      return "uint8";
+    case TENSOR_INT8:       return "int8";
+    default:                return "unknown";
+    }
+}
+
+const char *GetModelEngineName(const ModelEngine engine) {
+    switch (engine) {
+    case MODEL_ENGINE_TFLITE:   return "tflite";
+    case MODEL_ENGINE_BUILTIN:  return "builtin";
+    default:                    return "unknown";
+    }
+}
+
+bool IsModelEngineAvailable(const ModelEngine engine) {
+    switch (engine) {
+#ifdef WORDBLITZ_TFLITE
+    case MODEL_ENGINE_TFLITE:   return true;
+#endif
+    case MODEL_ENGINE_BUILTIN:  return true;
+    default:                    return false;
+    }
+}
+
+ModelEngine GetDefaultModelEngine() {
+#ifdef WORDBLITZ_TFLITE
+    return MODEL_ENGINE_TFLITE;
+#else
+    return MODEL_ENGINE_BUILTIN;
+#endif
+}
+
+std::shared_ptr<ModelBackend> LoadModelBackend(const char *filepath, const ModelEngine engine) {
+    switch (engine) {
+#ifdef WORDBLITZ_TFLITE
+    case MODEL_ENGINE_TFLITE:
+        return std::make_shared<TfLiteBackend>(filepath);
+#endif
+    case MODEL_ENGINE_BUILTIN:
+        return std::make_shared<tiny_cnn::Backend>(filepath);
+    default:
+        throw std::runtime_error(fmt::format(
+            "Model engine {} isn't built in", GetModelEngineName(engine)));
+    }
+}
+
+static int GetTotalElements(const TensorInfo &info) {
+    int total = 1;
+    for (const int dim: info.dims) {
+        total *= dim;
+    }
+    return total;
+}
+
+static float ReadElement(const TensorInfo &info, const void *data, const int index) {
+    switch (info.type) {
+    case TENSOR_UINT8:  return info.scale * (float)((int)reinterpret_cast<const uint8_t*>(data)[index] - info.zero_point);
+    case TENSOR_INT8:   return info.scale * (float)((int)reinterpret_cast<const int8_t*>(data)[index] - info.zero_point);
+    default:            return reinterpret_cast<const float*>(data)[index];
+    }
+}
+
+ModelParity CheckModelParity(ModelBackend &a, ModelBackend &b, const int total_crops, const unsigned int seed) {
+    const auto &input_info = a.GetInputInfo();
+    const auto &output_info = a.GetOutputInfo();
+    if ((input_info.type != b.GetInputInfo().type) || (input_info.dims != b.GetInputInfo().dims) ||
+        (output_info.dims != b.GetOutputInfo().dims))
+    {
+        throw std::runtime_error("Models don't have the same inputs and outputs");
+    }
+    const int input_size = GetTotalElements(input_info);
+    const int output_size = GetTotalElements(output_info);
+
+    auto session_a = a.CreateSession();
+    auto session_b = b.CreateSession();
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pixel(0.0f, 1.0f);
+    std::vector<uint8_t> input(session_a->GetInputBytes());
+    std::vector<float> scores_a(output_size);
+    std::vector<float> scores_b(output_size);
+
+    ModelParity parity;
+    for (int i = 0; i < total_crops; i++) {
+        // the same crop goes through both, as normalized pixels or raw quantized values
+        if (input_info.type == TENSOR_FLOAT32) {
+            float *values = reinterpret_cast<float*>(input.data());
+            for (int j = 0; j < input_size; j++) {
+                values[j] = pixel(rng);
+            }
+        } else {
+            for (auto &v: input) {
+                v = static_cast<uint8_t>(rng());
+            }
+        }
+        memcpy(session_a->GetInputData(), input.data(), input.size());
+        memcpy(session_b->GetInputData(), input.data(), input.size());
+        session_a->Invoke();
+        session_b->Invoke();
+
+        for (int j = 0; j < output_size; j++) {
+            scores_a[j] = ReadElement(output_info, session_a->GetOutputData(), j);
+            scores_b[j] = ReadElement(b.GetOutputInfo(), session_b->GetOutputData(), j);
+            parity.max_error = std::max(parity.max_error, fabsf(scores_a[j] - scores_b[j]));
+        }
+        const auto best_a = std::max_element(scores_a.begin(), scores_a.end()) - scores_a.begin();
+        const auto best_b = std::max_element(scores_b.begin(), scores_b.end()) - scores_b.begin();
+        parity.total_mismatches += (best_a != best_b) ? 1 : 0;
+        parity.total_crops++;
+    }
+    return parity;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+// element types of the tensors which are fed to and decoded from a model
+enum TensorType {
+    TENSOR_FLOAT32, TENSOR_UINT8, TENSOR_INT8
+};
+
+struct TensorInfo {
+    TensorType type;
+    // shape with a batch of 1
+    std::vector<int> dims;
+    // quantization of uint8 and int8 tensors, where real = scale*(q - zero_point)
+    float scale = 0.0f;
+    int zero_point = 0;
+};
+
+const char *GetTensorTypeName(const TensorType type);
+
+// a copy of a loaded model with its own tensors
+// different sessions of the same model can be invoked from different threads
+class ModelSession
+{
+public:
+    virtual ~ModelSession() {}
+    // resizes the batch of the input tensor
+    // returns false if the model can't be resized, which leaves the previous batch
+    virtual bool Resize(const int batch_size) = 0;
+    // tensor data is only valid until the next resize
+    virtual void *GetInputData() = 0;
+    virtual size_t GetInputBytes() const = 0;
+    virtual const void *GetOutputData() const = 0;
+    virtual size_t GetOutputBytes() const = 0;
+    // throws if the model fails to run
+    virtual void Invoke() = 0;
+};
+
+// a model loaded by one of the inference engines, which is shared by its sessions
+class ModelBackend
+{
+public:
+    virtual ~ModelBackend() {}
+    virtual const TensorInfo& GetInputInfo() const = 0;
+    virtual const TensorInfo& GetOutputInfo() const = 0;
+    virtual std::unique_ptr<ModelSession> CreateSession() = 0;
+    virtual void Print() const = 0;
+};
+
+enum ModelEngine {
+    // tensorflow lite c api, which is only available in builds with WORDBLITZ_TFLITE
+    MODEL_ENGINE_TFLITE,
+    // small convolutional networks run by tiny_cnn, which is always available
+    MODEL_ENGINE_BUILTIN
+};
+
+const char *GetModelEngineName(const ModelEngine engine);
+bool IsModelEngineAvailable(const ModelEngine engine);
+// tensorflow lite when it is built in
+ModelEngine GetDefaultModelEngine();
+// throws if the engine isn't built in or can't run the model
+std::shared_ptr<ModelBackend> LoadModelBackend(const char *filepath, const ModelEngine engine);
+
+// differences between two engines which ran the same random crops
+struct ModelParity {
+    int total_crops = 0;
+    // crops whose highest score isn't the same
+    int total_mismatches = 0;
+    // largest difference of a dequantized score
+    float max_error = 0.0f;
+};
+
+// throws if the backends don't have the same input and output shapes
+ModelParity CheckModelParity(ModelBackend &a, ModelBackend &b, const int total_crops, const unsigned int seed=0);
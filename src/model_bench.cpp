@@ -0,0 +1,524 @@
+// Recognition model benchmark
+// Times reading a batch of crops with each of the recognition models, broken down into
+// sampling the crops into the input tensors, invoking the interpreters and decoding the predictions
+// and sweeps the batch size and the number of interpreters which split the batch
+//
+// Crops are synthetic unless --crop gives a recorded image, which is used for every model
+// --csv and --json write a row per model, engine, batch and interpreter count so runs can be compared
+// --check also reads different crops at each batch and interpreter count and one at a time, and fails
+// if the predictions or scores differ, which checks the batched and multi interpreter paths of each engine
+//
+// --check-allocations reads crops through a crop cache in front of each model like the bot instead,
+// and fails if any round allocates once the buffers and the cache have warmed up
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "stb/stb_image.h"
+
+#include "crop_cache.h"
+#include "model_backend.h"
+#include "model_benchmark.h"
+#include "wordblitz_model.h"
+#include "worker_pool.h"
+
+// every allocation of the program goes through here, and is counted while checking allocations
+static std::atomic<bool> g_is_counting_allocations{false};
+static std::atomic<size_t> g_total_allocations{0};
+
+// allocating and freeing aren't inlined into the operators, otherwise the compiler pairs the
+// malloc of an inlined new with the free of an inlined delete and warns they are mismatched
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE static void *AllocateCounted(const size_t size) noexcept {
+    if (g_is_counting_allocations.load(std::memory_order_relaxed)) {
+        g_total_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return malloc((size > 0) ? size : 1);
+}
+
+BENCH_NOINLINE static void FreeCounted(void *ptr) noexcept {
+    free(ptr);
+}
+
+static void *AllocateOrThrow(const size_t size) {
+    void *ptr = AllocateCounted(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(size_t size) { return AllocateOrThrow(size); }
+void *operator new[](size_t size) { return AllocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t&) noexcept { return AllocateCounted(size); }
+void *operator new[](size_t size, const std::nothrow_t&) noexcept { return AllocateCounted(size); }
+
+void operator delete(void *ptr) noexcept { FreeCounted(ptr); }
+void operator delete[](void *ptr) noexcept { FreeCounted(ptr); }
+void operator delete(void *ptr, size_t) noexcept { FreeCounted(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { FreeCounted(ptr); }
+void operator delete(void *ptr, const std::nothrow_t&) noexcept { FreeCounted(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept { FreeCounted(ptr); }
+
+struct BenchParams {
+    const char *models_dir = "assets/models";
+    const char *crop_filepath = nullptr;
+    const char *csv_filepath = nullptr;
+    const char *json_filepath = nullptr;
+    std::string model_name = "all";
+    std::string engine_name = "all";
+    std::vector<int> batch_sizes = {1, 16};
+    std::vector<int> interpreters = {1, 2, 4};
+    int total_warmup = 20;
+    int total_rounds = 200;
+    bool is_checking = false;
+    int total_check_crops = 64;
+    bool is_checking_allocations = false;
+};
+
+// crops are the size of the default croppers of the bot
+struct ModelEntry {
+    const char *name;
+    const char *filename;
+    int crop_width;
+    int crop_height;
+};
+
+const ModelEntry MODEL_ENTRIES[] = {
+    {"bonuses",     "bonuses.tflite",               23, 17},
+    {"characters",  "characters.tflite",            40, 40},
+    {"values",      "two_digit_classifier.tflite",  20, 16},
+};
+
+// batched kernels can round differently, but only by a couple of steps of an 8 bit score
+constexpr float MAX_BATCH_PARITY_ERROR = 1e-2f;
+
+const ModelEngine MODEL_ENGINES[] = {
+    MODEL_ENGINE_TFLITE, MODEL_ENGINE_BUILTIN
+};
+
+struct BenchResult {
+    const char *model;
+    const char *engine;
+    ModelBenchmarkResult result;
+};
+
+static void PrintUsage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -m, --model <name>      bonuses, characters, values or all (default: all)\n"
+        "  -e, --engine <name>     tflite, builtin or all which are built in (default: all)\n"
+        "  -b, --batch <list>      Comma separated batch sizes (default: 1,16)\n"
+        "  -t, --interpreters <list> Comma separated interpreter counts (default: 1,2,4)\n"
+        "  -w, --warmup <n>        Rounds before measuring (default: 20)\n"
+        "  -r, --rounds <n>        Measured rounds (default: 200)\n"
+        "  -d, --models-dir <dir>  Directory of the models (default: assets/models)\n"
+        "  -c, --crop <file>       Recorded crop to read instead of a synthetic one\n"
+        "      --csv <file>        Write the results as csv\n"
+        "  -j, --json <file>       Write the results as json\n"
+        "      --check             Compare the predictions of each configuration with reading one crop at a time\n"
+        "      --check-allocations Fail if the steady state of reading crops through a crop cache allocates\n"
+        "  -h, --help              Show this message\n",
+        name);
+}
+
+static std::vector<int> ParseList(const char *arg) {
+    std::vector<int> values;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        const int v = atoi(item.c_str());
+        if (v <= 0) {
+            throw std::runtime_error(fmt::format("Invalid value {} in list {}", item, arg));
+        }
+        values.push_back(v);
+    }
+    if (values.empty()) {
+        throw std::runtime_error(fmt::format("Empty list {}", arg));
+    }
+    return values;
+}
+
+static BenchParams ParseArgs(int argc, char **argv) {
+    BenchParams p;
+
+    auto GetValue = [argc, argv](int &i) -> const char * {
+        if ((i+1) >= argc) {
+            throw std::runtime_error(fmt::format("Missing value for argument {}", argv[i]));
+        }
+        return argv[++i];
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const auto IsArg = [arg](const char *s, const char *l) {
+            return (strcmp(arg, s) == 0) || (strcmp(arg, l) == 0);
+        };
+
+        if (IsArg("-h", "--help")) {
+            PrintUsage(argv[0]);
+            exit(0);
+        } else if (IsArg("-m", "--model")) {
+            p.model_name = GetValue(i);
+        } else if (IsArg("-e", "--engine")) {
+            p.engine_name = GetValue(i);
+        } else if (IsArg("-b", "--batch")) {
+            p.batch_sizes = ParseList(GetValue(i));
+        } else if (IsArg("-t", "--interpreters")) {
+            p.interpreters = ParseList(GetValue(i));
+        } else if (IsArg("-w", "--warmup")) {
+            p.total_warmup = std::max(0, atoi(GetValue(i)));
+        } else if (IsArg("-r", "--rounds")) {
+            p.total_rounds = std::max(1, atoi(GetValue(i)));
+        } else if (IsArg("-d", "--models-dir")) {
+            p.models_dir = GetValue(i);
+        } else if (IsArg("-c", "--crop")) {
+            p.crop_filepath = GetValue(i);
+        } else if (strcmp(arg, "--csv") == 0) {
+            p.csv_filepath = GetValue(i);
+        } else if (IsArg("-j", "--json")) {
+            p.json_filepath = GetValue(i);
+        } else if (strcmp(arg, "--check") == 0) {
+            p.is_checking = true;
+        } else if (strcmp(arg, "--check-allocations") == 0) {
+            p.is_checking_allocations = true;
+        } else {
+            throw std::runtime_error(fmt::format("Unknown argument {}", arg));
+        }
+    }
+
+    return p;
+}
+
+// rgba crop, either loaded or synthetic
+struct Crop {
+    std::vector<uint8_t> data;
+    int width;
+    int height;
+};
+
+static Crop LoadCrop(const char *filepath) {
+    int width, height, channels;
+    uint8_t *data = stbi_load(filepath, &width, &height, &channels, 4);
+    if (data == nullptr) {
+        throw std::runtime_error(fmt::format("Failed to load crop {}", filepath));
+    }
+    Crop crop = {std::vector<uint8_t>(data, data + width*height*4), width, height};
+    stbi_image_free(data);
+    return crop;
+}
+
+static std::unique_ptr<Model> CreateModel(const ModelEntry &entry, const char *filepath, const ModelEngine engine) {
+    if (strcmp(entry.name, "bonuses") == 0) {
+        return std::make_unique<BonusesModel>(filepath, engine);
+    }
+    if (strcmp(entry.name, "characters") == 0) {
+        return std::make_unique<CharacterModel>(filepath, engine);
+    }
+    return std::make_unique<ValuesModel>(filepath, engine);
+}
+
+struct AllocationCheck {
+    size_t total_allocations;
+    int total_hits;
+    int total_misses;
+};
+
+// the same read as the bot: crops which hit the cache are decoded from their cached outputs
+// and the rest are copied into the batch, run across the interpreters, decoded and cached
+// each round reads a window of crops which slides over more crops than the cache holds,
+// so every round has hits, misses and evictions
+static AllocationCheck CountSteadyStateAllocations(
+    Model &model, const ModelEntry &entry, const int batch_size, const int total_interpreters)
+{
+    model.SetBatchSize(batch_size);
+    model.SetTotalInterpreters(total_interpreters);
+    const int width = entry.crop_width;
+    const int height = entry.crop_height;
+    const int total_crops = 3*batch_size;
+    std::vector<std::vector<uint8_t>> crops;
+    for (int i = 0; i < total_crops; i++) {
+        crops.push_back(CreateSyntheticCrop(width, height, static_cast<unsigned int>(i)));
+    }
+    CropCache cache(static_cast<size_t>(2*batch_size), model.GetOutputBytes());
+
+    WorkerPool workers(model.GetTotalInterpreters());
+    std::vector<int> interpreters;
+    const WorkerPool::Task invoke = [&model, &interpreters](const size_t i) {
+        model.Invoke(interpreters[i]);
+    };
+    std::vector<const uint8_t*> misses(batch_size);
+    std::vector<CropSignature> signatures(batch_size);
+    int window = 0;
+    const auto RunRound = [&]() {
+        int total_misses = 0;
+        for (int i = 0; i < batch_size; i++) {
+            const uint8_t *crop = crops[(window+i) % total_crops].data();
+            auto &signature = signatures[total_misses];
+            GetCropSignature(crop, width, height, width*4, signature);
+            const uint8_t *output = cache.Find(signature);
+            if (output != nullptr) {
+                model.ParseRawOutput(output, 0);
+                continue;
+            }
+            misses[total_misses] = crop;
+            total_misses++;
+        }
+        window = (window + batch_size/2 + 1) % total_crops;
+        if (total_misses == 0) {
+            return;
+        }
+
+        for (int i = 0; i < total_misses; i++) {
+            model.CopyDataToInput(misses[i], width, height, width*4, i);
+        }
+        interpreters.clear();
+        for (int k = 0; k < model.GetTotalInterpreters(); k++) {
+            int first, count;
+            model.GetInterpreterSlots(k, first, count);
+            if (first < total_misses) {
+                interpreters.push_back(k);
+            }
+        }
+        workers.Run(interpreters.size(), invoke);
+        model.ParseOutputs(total_misses);
+        for (int i = 0; i < total_misses; i++) {
+            cache.Insert(signatures[i], model.GetOutputData(i));
+        }
+    };
+
+    // the window comes back to the same crops after a few rounds, so the warm up covers every crop
+    constexpr int TOTAL_WARMUP_ROUNDS = 32;
+    constexpr int TOTAL_CHECKED_ROUNDS = 64;
+    for (int i = 0; i < TOTAL_WARMUP_ROUNDS; i++) {
+        RunRound();
+    }
+    const int hits_before = cache.GetTotalHits() + cache.GetTotalNearHits();
+    const int misses_before = cache.GetTotalMisses();
+    g_total_allocations = 0;
+    g_is_counting_allocations = true;
+    for (int i = 0; i < TOTAL_CHECKED_ROUNDS; i++) {
+        RunRound();
+    }
+    g_is_counting_allocations = false;
+
+    AllocationCheck check;
+    check.total_allocations = g_total_allocations;
+    check.total_hits = cache.GetTotalHits() + cache.GetTotalNearHits() - hits_before;
+    check.total_misses = cache.GetTotalMisses() - misses_before;
+    return check;
+}
+
+static void WriteFile(const char *filepath, const fmt::memory_buffer &buf) {
+    FILE *fp = fopen(filepath, "w");
+    if (fp == nullptr) {
+        throw std::runtime_error(fmt::format("Failed to open output {}", filepath));
+    }
+    fwrite(buf.data(), 1, buf.size(), fp);
+    fclose(fp);
+}
+
+static void WriteCsv(const char *filepath, const std::vector<BenchResult> &results) {
+    fmt::memory_buffer buf;
+    auto out = std::back_inserter(buf);
+    fmt::format_to(out, "model,engine,batch,interpreters,batched,stage,mean_us,p50_us,p90_us,p99_us,max_us\n");
+    for (auto &r: results) {
+        const auto &m = r.result;
+        for (int i = 0; i < TOTAL_MODEL_STAGES; i++) {
+            const auto &s = m.stages[i];
+            fmt::format_to(out, "{},{},{},{},{},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f}\n",
+                r.model, r.engine, m.batch_size, m.total_interpreters, m.is_batched ? 1 : 0,
+                GetModelStageName(static_cast<ModelStage>(i)),
+                s.mean, s.p50, s.p90, s.p99, s.max);
+        }
+    }
+    WriteFile(filepath, buf);
+}
+
+static void WriteJson(const char *filepath, const BenchParams &params, const std::vector<BenchResult> &results) {
+    fmt::memory_buffer buf;
+    auto out = std::back_inserter(buf);
+    fmt::format_to(out, "{{\"warmup\":{},\"rounds\":{},\"crop\":\"{}\",\"results\":[",
+        params.total_warmup, params.total_rounds,
+        (params.crop_filepath != nullptr) ? params.crop_filepath : "synthetic");
+    bool is_first = true;
+    for (auto &r: results) {
+        const auto &m = r.result;
+        fmt::format_to(out, "{}{{\"model\":\"{}\",\"engine\":\"{}\",\"batch\":{},\"interpreters\":{},\"batched\":{},\"stages_us\":{{",
+            is_first ? "" : ",", r.model, r.engine, m.batch_size, m.total_interpreters, m.is_batched ? "true" : "false");
+        for (int i = 0; i < TOTAL_MODEL_STAGES; i++) {
+            const auto &s = m.stages[i];
+            fmt::format_to(out, "{}\"{}\":{{\"mean\":{:.3f},\"p50\":{:.3f},\"p90\":{:.3f},\"p99\":{:.3f},\"max\":{:.3f}}}",
+                (i == 0) ? "" : ",", GetModelStageName(static_cast<ModelStage>(i)),
+                s.mean, s.p50, s.p90, s.p99, s.max);
+        }
+        fmt::format_to(out, "}}}}");
+        is_first = false;
+    }
+    fmt::format_to(out, "]}}\n");
+    WriteFile(filepath, buf);
+}
+
+int run_bench(int argc, char **argv) {
+    const auto params = ParseArgs(argc, argv);
+
+    std::vector<ModelEngine> engines;
+    for (auto engine: MODEL_ENGINES) {
+        const bool is_selected = (params.engine_name == "all") || (params.engine_name == GetModelEngineName(engine));
+        if (is_selected && IsModelEngineAvailable(engine)) {
+            engines.push_back(engine);
+        } else if (is_selected && (params.engine_name != "all")) {
+            throw std::runtime_error(fmt::format("Model engine {} isn't built in", params.engine_name));
+        }
+    }
+    if (engines.empty()) {
+        throw std::runtime_error(fmt::format("Unknown model engine {}", params.engine_name));
+    }
+
+    if (params.is_checking_allocations) {
+        int total_failed = 0;
+        bool is_model_found = false;
+        for (auto &entry: MODEL_ENTRIES) {
+            if ((params.model_name != "all") && (params.model_name != entry.name)) {
+                continue;
+            }
+            is_model_found = true;
+            const std::string filepath = fmt::format("{}/{}", params.models_dir, entry.filename);
+            for (auto engine: engines) {
+                auto model = CreateModel(entry, filepath.c_str(), engine);
+                for (const int batch_size: params.batch_sizes) {
+                    for (const int total_interpreters: params.interpreters) {
+                        if (total_interpreters > batch_size) {
+                            continue;
+                        }
+                        const auto check = CountSteadyStateAllocations(*model, entry, batch_size, total_interpreters);
+                        printf("%-11s %-8s %6d %7d allocations: %zu (hits=%d, misses=%d)\n",
+                            entry.name, GetModelEngineName(engine), model->GetBatchSize(), model->GetTotalInterpreters(),
+                            check.total_allocations, check.total_hits, check.total_misses);
+                        total_failed += (check.total_allocations > 0) ? 1 : 0;
+                    }
+                }
+            }
+        }
+        if (!is_model_found) {
+            throw std::runtime_error(fmt::format("Unknown model {}", params.model_name));
+        }
+        if (total_failed > 0) {
+            throw std::runtime_error(fmt::format(
+                "Reading crops allocates in the steady state of {} configurations", total_failed));
+        }
+        return 0;
+    }
+
+    std::unique_ptr<Crop> recorded_crop;
+    if (params.crop_filepath != nullptr) {
+        recorded_crop = std::make_unique<Crop>(LoadCrop(params.crop_filepath));
+    }
+
+    printf("%-11s %-8s %6s %7s %10s %10s %10s %10s %10s %10s %10s\n",
+        "model", "engine", "batch", "interp", "sample us", "invoke us", "decode us",
+        "total p50", "p90", "p99", "max");
+
+    std::vector<BenchResult> results;
+    int total_failed_checks = 0;
+    bool is_model_found = false;
+    for (auto &entry: MODEL_ENTRIES) {
+        if ((params.model_name != "all") && (params.model_name != entry.name)) {
+            continue;
+        }
+        is_model_found = true;
+        const std::string filepath = fmt::format("{}/{}", params.models_dir, entry.filename);
+        const Crop crop = (recorded_crop != nullptr) ? *recorded_crop :
+            Crop{CreateSyntheticCrop(entry.crop_width, entry.crop_height), entry.crop_width, entry.crop_height};
+
+        for (auto engine: engines) {
+            auto model = CreateModel(entry, filepath.c_str(), engine);
+            std::unique_ptr<Model> reference;
+            if (params.is_checking) {
+                reference = CreateModel(entry, filepath.c_str(), engine);
+            }
+            for (const int batch_size: params.batch_sizes) {
+                for (const int total_interpreters: params.interpreters) {
+                    // interpreters past the batch size would be left without crops
+                    if (total_interpreters > batch_size) {
+                        continue;
+                    }
+                    ModelBenchmarkConfig config;
+                    config.batch_size = batch_size;
+                    config.total_interpreters = total_interpreters;
+                    config.total_warmup = params.total_warmup;
+                    config.total_rounds = params.total_rounds;
+                    const auto result = RunModelBenchmark(
+                        *model, config, crop.data.data(), crop.width, crop.height, crop.width*4);
+                    results.push_back({entry.name, GetModelEngineName(engine), result});
+
+                    const auto &s = result.stages;
+                    printf("%-11s %-8s %6d %7d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f%s\n",
+                        entry.name, GetModelEngineName(engine), result.batch_size, result.total_interpreters,
+                        s[MODEL_STAGE_SAMPLE].p50, s[MODEL_STAGE_INVOKE].p50, s[MODEL_STAGE_DECODE].p50,
+                        s[MODEL_STAGE_TOTAL].p50, s[MODEL_STAGE_TOTAL].p90, s[MODEL_STAGE_TOTAL].p99,
+                        s[MODEL_STAGE_TOTAL].max,
+                        result.is_batched ? "" : " (not batched)");
+
+                    if (reference == nullptr) {
+                        continue;
+                    }
+                    const auto check = CheckModelBatchParity(
+                        *model, *reference, config, entry.crop_width, entry.crop_height, params.total_check_crops);
+                    printf("%-11s %-8s %6d %7d check: max_error=%.2e, mismatches=%d/%d\n",
+                        entry.name, GetModelEngineName(engine), check.batch_size, check.total_interpreters,
+                        check.parity.max_error, check.parity.total_mismatches, check.parity.total_crops);
+                    const bool is_failed = 
+                        (check.parity.total_mismatches > 0) || 
+                        (check.parity.max_error > MAX_BATCH_PARITY_ERROR);
+                    total_failed_checks += is_failed ? 1 : 0;
+                }
+            }
+        }
+    }
+    if (!is_model_found) {
+        throw std::runtime_error(fmt::format("Unknown model {}", params.model_name));
+    }
+
+    if (params.csv_filepath != nullptr) {
+        WriteCsv(params.csv_filepath, results);
+    }
+    if (params.json_filepath != nullptr) {
+        WriteJson(params.json_filepath, params, results);
+    }
+    if (total_failed_checks > 0) {
+        throw std::runtime_error(fmt::format(
+            "Predictions of {} configurations differ from reading one crop at a time", total_failed_checks));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    try {
+        return run_bench(argc, argv);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+    }
+
+    return 1;
+}
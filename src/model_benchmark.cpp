@@ -0,0 +1,201 @@
+#include "model_benchmark.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "worker_pool.h"
+
+const char *GetModelStageName(const ModelStage stage) {
+    switch (stage) {
+    case MODEL_STAGE_SAMPLE:    return "sample";
+    case MODEL_STAGE_INVOKE:    return "invoke";
+    case MODEL_STAGE_DECODE:    return "decode";
+    case MODEL_STAGE_TOTAL:     return "total";
+    default:                    return "unknown";
+    }
+}
+
+static StageSummary GetStageSummary(std::vector<int64_t> &nanos) {
+    StageSummary summary = {0.0, 0.0, 0.0, 0.0, 0.0};
+    if (nanos.empty()) {
+        return summary;
+    }
+    std::sort(nanos.begin(), nanos.end());
+    const auto GetPercentile = [&nanos](const double p) {
+        const size_t i = static_cast<size_t>(p * static_cast<double>(nanos.size()-1) + 0.5);
+        return static_cast<double>(nanos[std::min(i, nanos.size()-1)]) / 1000.0;
+    };
+    double total = 0.0;
+    for (const int64_t v: nanos) {
+        total += static_cast<double>(v);
+    }
+    summary.mean = total / static_cast<double>(nanos.size()) / 1000.0;
+    summary.p50 = GetPercentile(0.50);
+    summary.p90 = GetPercentile(0.90);
+    summary.p99 = GetPercentile(0.99);
+    summary.max = static_cast<double>(nanos.back()) / 1000.0;
+    return summary;
+}
+
+ModelBenchmarkResult RunModelBenchmark(
+    Model &model, const ModelBenchmarkConfig &config,
+    const uint8_t *crop, const int width, const int height, const int row_stride)
+{
+    if ((config.batch_size <= 0) || (config.total_interpreters <= 0) || (config.total_rounds <= 0)) {
+        throw std::runtime_error(fmt::format(
+            "Invalid benchmark of a batch of {} on {} interpreters for {} rounds",
+            config.batch_size, config.total_interpreters, config.total_rounds));
+    }
+
+    ModelBenchmarkResult result;
+    result.config = config;
+    result.is_batched = model.SetBatchSize(config.batch_size);
+    result.is_batched = model.SetTotalInterpreters(config.total_interpreters) && result.is_batched;
+    result.batch_size = model.GetBatchSize();
+    result.total_interpreters = model.GetTotalInterpreters();
+
+    const int batch_size = result.batch_size;
+    // the last interpreters can be left without crops when the batch doesn't split evenly
+    int total_interpreters = 0;
+    for (int k = 0; k < result.total_interpreters; k++) {
+        int first, count;
+        model.GetInterpreterSlots(k, first, count);
+        total_interpreters += (count > 0) ? 1 : 0;
+    }
+    // interpreters run on workers which are kept between rounds, the same as the read threads of the bot
+    WorkerPool workers(total_interpreters);
+    const WorkerPool::Task invoke = [&model](const size_t k) {
+        model.Invoke(static_cast<int>(k));
+    };
+    const auto InvokeAll = [&workers, &invoke, total_interpreters]() {
+        workers.Run(static_cast<size_t>(total_interpreters), invoke);
+    };
+
+    std::vector<int64_t> nanos[TOTAL_MODEL_STAGES];
+    for (auto &v: nanos) {
+        v.reserve(config.total_rounds);
+    }
+    using clock = std::chrono::steady_clock;
+    const auto GetNanos = [](const clock::time_point start, const clock::time_point end) {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count());
+    };
+
+    for (int round = 0; round < (config.total_warmup + config.total_rounds); round++) {
+        const auto t0 = clock::now();
+        for (int i = 0; i < batch_size; i++) {
+            model.CopyDataToInput(crop, width, height, row_stride, i);
+        }
+        const auto t1 = clock::now();
+        InvokeAll();
+        const auto t2 = clock::now();
+        model.ParseOutputs(batch_size);
+        const auto t3 = clock::now();
+
+        if (round < config.total_warmup) {
+            continue;
+        }
+        nanos[MODEL_STAGE_SAMPLE].push_back(GetNanos(t0, t1));
+        nanos[MODEL_STAGE_INVOKE].push_back(GetNanos(t1, t2));
+        nanos[MODEL_STAGE_DECODE].push_back(GetNanos(t2, t3));
+        nanos[MODEL_STAGE_TOTAL].push_back(GetNanos(t0, t3));
+    }
+
+    for (int i = 0; i < TOTAL_MODEL_STAGES; i++) {
+        result.stages[i] = GetStageSummary(nanos[i]);
+    }
+    return result;
+}
+
+std::vector<uint8_t> CreateSyntheticCrop(const int width, const int height, const unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> noise(-24, 24);
+    std::vector<uint8_t> crop(width*height*4);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t *px = &crop[(y*width + x)*4];
+            const int v = (x*255) / width;
+            px[0] = static_cast<uint8_t>(std::clamp(v + noise(rng), 0, 255));
+            px[1] = static_cast<uint8_t>(std::clamp(((y*255) / height) + noise(rng), 0, 255));
+            px[2] = static_cast<uint8_t>(std::clamp(255 - v + noise(rng), 0, 255));
+            px[3] = 255;
+        }
+    }
+    return crop;
+}
+
+ModelBatchParity CheckModelBatchParity(
+    Model &model, Model &reference, const ModelBenchmarkConfig &config,
+    const int width, const int height, const int total_crops, const unsigned int seed)
+{
+    if ((config.batch_size <= 0) || (config.total_interpreters <= 0)) {
+        throw std::runtime_error(fmt::format(
+            "Invalid parity check of a batch of {} on {} interpreters",
+            config.batch_size, config.total_interpreters));
+    }
+    if (model.GetOutputSize() != reference.GetOutputSize()) {
+        throw std::runtime_error("Models don't have the same outputs");
+    }
+
+    ModelBatchParity result;
+    result.is_batched = model.SetBatchSize(config.batch_size);
+    result.is_batched = model.SetTotalInterpreters(config.total_interpreters) && result.is_batched;
+    result.batch_size = model.GetBatchSize();
+    result.total_interpreters = model.GetTotalInterpreters();
+    reference.SetBatchSize(1);
+    reference.SetTotalInterpreters(1);
+
+    std::vector<std::vector<uint8_t>> crops;
+    crops.reserve(total_crops);
+    for (int i = 0; i < total_crops; i++) {
+        crops.push_back(CreateSyntheticCrop(width, height, seed+static_cast<unsigned int>(i)));
+    }
+
+    // interpreters run on their own workers, the same as the read threads of the bot
+    WorkerPool workers(result.total_interpreters);
+    std::vector<int> interpreters;
+    const WorkerPool::Task invoke = [&model, &interpreters](const size_t i) {
+        model.Invoke(interpreters[i]);
+    };
+
+    const int output_size = model.GetOutputSize();
+    std::vector<float> scores(output_size);
+    std::vector<float> reference_scores(output_size);
+    auto &parity = result.parity;
+    for (int start = 0; start < total_crops; start += result.batch_size) {
+        const int total = std::min(result.batch_size, total_crops-start);
+        for (int i = 0; i < total; i++) {
+            model.CopyDataToInput(crops[start+i].data(), width, height, width*4, i);
+        }
+        interpreters.clear();
+        for (int k = 0; k < result.total_interpreters; k++) {
+            int first, count;
+            model.GetInterpreterSlots(k, first, count);
+            if (first < total) {
+                interpreters.push_back(k);
+            }
+        }
+        workers.Run(interpreters.size(), invoke);
+
+        for (int i = 0; i < total; i++) {
+            reference.CopyDataToInput(crops[start+i].data(), width, height, width*4, 0);
+            reference.Invoke(0);
+            model.GetOutputScores(i, scores.data());
+            reference.GetOutputScores(0, reference_scores.data());
+            for (int j = 0; j < output_size; j++) {
+                parity.max_error = std::max(parity.max_error, fabsf(scores[j] - reference_scores[j]));
+            }
+            const auto best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+            const auto reference_best = std::max_element(reference_scores.begin(), reference_scores.end()) - reference_scores.begin();
+            parity.total_mismatches += (best != reference_best) ? 1 : 0;
+            parity.total_crops++;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "model.h"
+
+// stages of reading a batch of crops with a model
+// sampling resizes, flips and normalizes each crop straight into the input tensor in a single pass
+enum ModelStage {
+    MODEL_STAGE_SAMPLE, MODEL_STAGE_INVOKE, MODEL_STAGE_DECODE, MODEL_STAGE_TOTAL,
+    TOTAL_MODEL_STAGES
+};
+
+const char *GetModelStageName(const ModelStage stage);
+
+struct ModelBenchmarkConfig {
+    int batch_size = 16;
+    // interpreters which share the batch, each invoked on its own thread like the read threads of the bot
+    int total_interpreters = 1;
+    // rounds which aren't measured, so buffers, samplers and caches are warm
+    int total_warmup = 20;
+    int total_rounds = 200;
+};
+
+// microseconds per round of the whole batch
+struct StageSummary {
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+};
+
+struct ModelBenchmarkResult {
+    ModelBenchmarkConfig config;
+    // batch and interpreters the model actually ran with, since models which can't be resized
+    // fall back to a crop per interpreter
+    int batch_size;
+    int total_interpreters;
+    bool is_batched;
+    StageSummary stages[TOTAL_MODEL_STAGES];
+};
+
+// reads the same rgba crop into every slot of the batch for each round
+ModelBenchmarkResult RunModelBenchmark(
+    Model &model, const ModelBenchmarkConfig &config,
+    const uint8_t *crop, const int width, const int height, const int row_stride);
+
+// rgba crop of noise over a gradient, so the models don't see a flat image
+std::vector<uint8_t> CreateSyntheticCrop(const int width, const int height, const unsigned int seed=1234);
+
+// differences between reading crops at the batch size and interpreters of the config
+// and reading the same crops one at a time with a single interpreter of the reference
+struct ModelBatchParity {
+    int batch_size;
+    int total_interpreters;
+    bool is_batched;
+    ModelParity parity;
+};
+
+// both models should be loaded from the same file, the reference is left with a batch of one
+// every crop is a different synthetic crop of the given size
+ModelBatchParity CheckModelBatchParity(
+    Model &model, Model &reference, const ModelBenchmarkConfig &config,
+    const int width, const int height, const int total_crops, const unsigned int seed=0);
@@ -0,0 +1,200 @@
+#include "model_tuner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <fmt/core.h>
+
+#include "model_benchmark.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MODEL_TUNER_CPUID
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define MODEL_TUNER_CPUID
+#endif
+
+ModelTuneResult TuneModel(const ModelFactory &create, const ModelTuneParams &params) {
+    const int total_crops = std::max(1, params.total_crops);
+
+    // the whole grid in one round, a round per interpreter thread and a crop per invoke
+    std::vector<int> batch_sizes = {total_crops, (total_crops+3) / 4, 1};
+    std::sort(batch_sizes.begin(), batch_sizes.end());
+    batch_sizes.erase(std::unique(batch_sizes.begin(), batch_sizes.end()), batch_sizes.end());
+    std::vector<int> interpreters;
+    for (int n = 1; n <= std::max(1, params.max_interpreters); n *= 2) {
+        interpreters.push_back(n);
+    }
+
+    const auto crop = CreateSyntheticCrop(params.crop_width, params.crop_height);
+    bool is_found = false;
+    ModelTuneResult best = {{MODEL_ENGINE_BUILTIN, total_crops, 1}, 0.0};
+    std::string errors;
+
+    for (auto engine: params.engines) {
+        std::unique_ptr<Model> model;
+        try {
+            model = create(engine);
+        } catch (std::exception &ex) {
+            errors += fmt::format("\n{}: {}", GetModelEngineName(engine), ex.what());
+            continue;
+        }
+        for (const int batch_size: batch_sizes) {
+            for (const int total_interpreters: interpreters) {
+                if (total_interpreters > batch_size) {
+                    continue;
+                }
+                ModelBenchmarkConfig config;
+                config.batch_size = batch_size;
+                config.total_interpreters = total_interpreters;
+                config.total_warmup = params.total_warmup;
+                config.total_rounds = params.total_rounds;
+                const auto r = RunModelBenchmark(
+                    *model, config, crop.data(), params.crop_width, params.crop_height, params.crop_width*4);
+
+                // models which can't be resized run fewer crops per round than asked for
+                const int total_reads = (total_crops + r.batch_size - 1) / r.batch_size;
+                const double read_us = r.stages[MODEL_STAGE_TOTAL].p50 * (double)total_reads;
+                if (!is_found || (read_us < best.read_us)) {
+                    best = {{engine, r.batch_size, r.total_interpreters}, read_us};
+                    is_found = true;
+                }
+            }
+        }
+    }
+
+    if (!is_found) {
+        throw std::runtime_error(fmt::format("No model engine could run the model{}", errors));
+    }
+    return best;
+}
+
+std::string GetCpuName() {
+    char brand[49] = {0};
+#if defined(MODEL_TUNER_CPUID) && defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0x80000000);
+    if (static_cast<unsigned int>(regs[0]) >= 0x80000004) {
+        for (int i = 0; i < 3; i++) {
+            __cpuid(regs, 0x80000002 + i);
+            memcpy(brand + 16*i, regs, sizeof(regs));
+        }
+    }
+#elif defined(MODEL_TUNER_CPUID)
+    unsigned int regs[4];
+    if (__get_cpuid_max(0x80000000, nullptr) >= 0x80000004) {
+        for (unsigned int i = 0; i < 3; i++) {
+            __get_cpuid(0x80000002 + i, &regs[0], &regs[1], &regs[2], &regs[3]);
+            memcpy(brand + 16*i, regs, sizeof(regs));
+        }
+    }
+#endif
+    // brand strings are padded with spaces, and tabs would break the lines of the tuning file
+    std::string name;
+    for (const char *c = brand; *c != 0; c++) {
+        const char v = (*c == '\t') ? ' ' : *c;
+        if ((v != ' ') || (!name.empty() && (name.back() != ' '))) {
+            name.push_back(v);
+        }
+    }
+    while (!name.empty() && (name.back() == ' ')) {
+        name.pop_back();
+    }
+    if (name.empty()) {
+        name = "unknown";
+    }
+    return fmt::format("{} ({} threads)", name, std::thread::hardware_concurrency());
+}
+
+static bool ParseModelEngine(const std::string &name, ModelEngine &engine) {
+    for (auto e: {MODEL_ENGINE_TFLITE, MODEL_ENGINE_BUILTIN}) {
+        if (name == GetModelEngineName(e)) {
+            engine = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+ModelTuning::ModelTuning(const char *filepath)
+: m_filepath(filepath)
+{
+    std::ifstream fp(filepath);
+    if (!fp.is_open()) {
+        return;
+    }
+    std::string line;
+    while (std::getline(fp, line)) {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.size() != 7) {
+            continue;
+        }
+        Entry entry;
+        entry.cpu = fields[0];
+        entry.model = fields[1];
+        entry.model_hash = strtoull(fields[2].c_str(), nullptr, 16);
+        auto &config = entry.result.config;
+        if (!ParseModelEngine(fields[3], config.engine) || !IsModelEngineAvailable(config.engine)) {
+            continue;
+        }
+        config.batch_size = atoi(fields[4].c_str());
+        config.total_interpreters = atoi(fields[5].c_str());
+        entry.result.read_us = atof(fields[6].c_str());
+        if ((config.batch_size <= 0) || (config.total_interpreters <= 0)) {
+            continue;
+        }
+        m_entries.push_back(entry);
+    }
+}
+
+bool ModelTuning::Find(const std::string &cpu, const std::string &model, const uint64_t model_hash, ModelTuneResult &result) const {
+    for (auto &entry: m_entries) {
+        if ((entry.cpu == cpu) && (entry.model == model)) {
+            if (entry.model_hash != model_hash) {
+                return false;
+            }
+            result = entry.result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// replaces the configuration of the model even if it was tuned for an older model file
+void ModelTuning::Set(const std::string &cpu, const std::string &model, const uint64_t model_hash, const ModelTuneResult &result) {
+    for (auto &entry: m_entries) {
+        if ((entry.cpu == cpu) && (entry.model == model)) {
+            entry.model_hash = model_hash;
+            entry.result = result;
+            return;
+        }
+    }
+    m_entries.push_back({cpu, model, model_hash, result});
+}
+
+void ModelTuning::Save() const {
+    FILE *fp = fopen(m_filepath.c_str(), "w");
+    if (fp == nullptr) {
+        throw std::runtime_error(fmt::format("Failed to write model tuning to {}", m_filepath));
+    }
+    for (auto &entry: m_entries) {
+        const auto &config = entry.result.config;
+        fprintf(fp, "%s\t%s\t%016llx\t%s\t%d\t%d\t%.1f\n",
+            entry.cpu.c_str(), entry.model.c_str(),
+            static_cast<unsigned long long>(entry.model_hash), GetModelEngineName(config.engine),
+            config.batch_size, config.total_interpreters, entry.result.read_us);
+    }
+    fclose(fp);
+}
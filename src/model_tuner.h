@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "model.h"
+#include "model_backend.h"
+
+// how a recognition model is run, which the autotuner picks for each host
+struct ModelConfig {
+    ModelEngine engine;
+    // crops per round, where a read takes as many rounds as it needs for every cell
+    int batch_size;
+    // interpreters which split each round, each on its own read thread
+    int total_interpreters;
+};
+
+struct ModelTuneResult {
+    ModelConfig config;
+    // median time to read every crop of the grid
+    double read_us;
+};
+
+struct ModelTuneParams {
+    // engines which are tried
+    std::vector<ModelEngine> engines;
+    // crops of the model in a read, one per cell
+    int total_crops = 16;
+    int max_interpreters = 1;
+    // size of the synthetic crop, which should match the cropper
+    int crop_width = 32;
+    int crop_height = 32;
+    int total_warmup = 3;
+    int total_rounds = 10;
+};
+
+typedef std::function<std::unique_ptr<Model> (const ModelEngine engine)> ModelFactory;
+
+// times a small grid of engines, batch sizes and interpreter counts and returns the fastest
+// engines which fail to load the model are skipped, and throws if none of them can
+ModelTuneResult TuneModel(const ModelFactory &create, const ModelTuneParams &params);
+
+// brand string of the processor and its number of threads, which the tuned configurations are stored under
+std::string GetCpuName();
+
+// fastest configuration of each model on each processor, kept in a small text file
+// with a line of tab separated fields per model:
+//     <cpu> <model> <model hash> <engine> <batch size> <interpreters> <read us>
+// the hash is of the contents of the model file, so a replaced model is tuned again
+class ModelTuning
+{
+public:
+    struct Entry {
+        std::string cpu;
+        std::string model;
+        uint64_t model_hash;
+        ModelTuneResult result;
+    };
+private:
+    std::string m_filepath;
+    std::vector<Entry> m_entries;
+public:
+    // a missing file is empty, and lines which can't be parsed or use an engine which isn't built in are skipped
+    ModelTuning(const char *filepath);
+    // only finds the configuration if it was tuned for a model file with the same hash
+    bool Find(const std::string &cpu, const std::string &model, const uint64_t model_hash, ModelTuneResult &result) const;
+    void Set(const std::string &cpu, const std::string &model, const uint64_t model_hash, const ModelTuneResult &result);
+    // throws if the file can't be written
+    void Save() const;
+    inline const std::vector<Entry>& GetEntries() const { return m_entries; }
+};
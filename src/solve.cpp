@@ -0,0 +1,528 @@
+// Headless batch solver
+// Streams boards from a file or stdin, solves them across all cores
+// and writes the ranked traces as json lines or binary
+//
+// Each input line is one board laid out row by row, '#' starts a comment
+//     <letters> [values] [modifiers]
+//     letters:   one lowercase letter per cell
+//     values:    comma separated integer per cell (defaults to 1)
+//     modifiers: comma separated modifier per cell out of -,2L,3L,2W,3W (defaults to -)
+// Boards are square unless a width is given, and all boards share the same topology
+//
+// Binary output is little endian with one record per board
+//     uint32 board index, uint32 total traces
+//     per trace: uint8 word length, word, int32 value, uint8 path length, uint16 x, uint16 y per cursor
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "wordtree.h"
+#include "wordblitz.h"
+#include "solve_cache.h"
+#include "word_signatures.h"
+#include "batch_search.h"
+#include "board_input.h"
+
+enum OutputFormat {
+    FORMAT_JSON, FORMAT_BINARY
+};
+
+enum EngineChoice {
+    ENGINE_AUTO, ENGINE_TREE, ENGINE_SIGNATURES, ENGINE_BATCH
+};
+
+struct SolveParams {
+    const char *input_filepath = nullptr;
+    const char *output_filepath = nullptr;
+    const char *dict_filepath = "assets/dicts/en.txt";
+    const char *cache_directory = nullptr;
+    OutputFormat format = OutputFormat::FORMAT_JSON;
+    EngineChoice engine = EngineChoice::ENGINE_AUTO;
+    int total_threads = 0;
+    int chunk_size = 4096;
+    int total_lanes = 256;
+    wordblitz::TopologyType topology = wordblitz::TopologyType::TOPOLOGY_GRID;
+    int width = 0;
+    wordblitz::SearchLimits limits;
+};
+
+struct BoardInput: wordblitz::BoardInput {
+    int index;
+};
+
+struct BoardOutput {
+    std::vector<wordblitz::TraceResult> traces;
+    double latency_us;
+};
+
+static void PrintUsage(const char *name) {
+    fprintf(stderr,
+        "Usage: %s [options] [input]\n"
+        "  input                   File of boards, reads stdin if not given\n"
+        "  -o, --output <file>     Write traces to file instead of stdout\n"
+        "  -d, --dict <file>       Dictionary (default: assets/dicts/en.txt)\n"
+        "  -f, --format <fmt>      Output format of json or binary (default: json)\n"
+        "  -j, --threads <n>       Number of solver threads (default: all cores)\n"
+        "  -k, --max-results <n>   Only keep the best n traces of each board\n"
+        "  -t, --budget-us <n>     Time budget per board in microseconds\n"
+        "  -c, --cache-dir <dir>   Persist solved boards to a directory\n"
+        "  -e, --engine <type>     Search engine of auto, tree, signatures or batch (default: auto)\n"
+        "  -l, --lanes <n>         Number of boards solved in lockstep by the batch engine (default: 256)\n"
+        "  -g, --topology <type>   Board topology of grid, torus or hex (default: grid)\n"
+        "  -w, --width <n>         Number of cells in each row (default: square boards)\n"
+        "  -h, --help              Show this message\n",
+        name);
+}
+
+static SolveParams ParseArgs(int argc, char **argv) {
+    SolveParams p;
+
+    auto GetValue = [argc, argv](int &i) -> const char * {
+        if ((i+1) >= argc) {
+            throw std::runtime_error(fmt::format("Missing value for argument {}", argv[i]));
+        }
+        return argv[++i];
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const auto IsArg = [arg](const char *s, const char *l) {
+            return (strcmp(arg, s) == 0) || (strcmp(arg, l) == 0);
+        };
+
+        if (IsArg("-h", "--help")) {
+            PrintUsage(argv[0]);
+            exit(0);
+        } else if (IsArg("-o", "--output")) {
+            p.output_filepath = GetValue(i);
+        } else if (IsArg("-d", "--dict")) {
+            p.dict_filepath = GetValue(i);
+        } else if (IsArg("-f", "--format")) {
+            const char *v = GetValue(i);
+            if (strcmp(v, "json") == 0) {
+                p.format = OutputFormat::FORMAT_JSON;
+            } else if (strcmp(v, "binary") == 0) {
+                p.format = OutputFormat::FORMAT_BINARY;
+            } else {
+                throw std::runtime_error(fmt::format("Unknown output format {}", v));
+            }
+        } else if (IsArg("-j", "--threads")) {
+            p.total_threads = atoi(GetValue(i));
+        } else if (IsArg("-k", "--max-results")) {
+            p.limits.max_results = atoi(GetValue(i));
+        } else if (IsArg("-t", "--budget-us")) {
+            p.limits.time_budget = std::chrono::microseconds(atoi(GetValue(i)));
+        } else if (IsArg("-c", "--cache-dir")) {
+            p.cache_directory = GetValue(i);
+        } else if (IsArg("-e", "--engine")) {
+            const char *v = GetValue(i);
+            if (strcmp(v, "auto") == 0) {
+                p.engine = EngineChoice::ENGINE_AUTO;
+            } else if (strcmp(v, "tree") == 0) {
+                p.engine = EngineChoice::ENGINE_TREE;
+            } else if (strcmp(v, "signatures") == 0) {
+                p.engine = EngineChoice::ENGINE_SIGNATURES;
+            } else if (strcmp(v, "batch") == 0) {
+                p.engine = EngineChoice::ENGINE_BATCH;
+            } else {
+                throw std::runtime_error(fmt::format("Unknown engine {}", v));
+            }
+        } else if (IsArg("-l", "--lanes")) {
+            p.total_lanes = std::max(1, atoi(GetValue(i)));
+        } else if (IsArg("-g", "--topology")) {
+            const char *v = GetValue(i);
+            if (strcmp(v, "grid") == 0) {
+                p.topology = wordblitz::TopologyType::TOPOLOGY_GRID;
+            } else if (strcmp(v, "torus") == 0) {
+                p.topology = wordblitz::TopologyType::TOPOLOGY_TORUS;
+            } else if (strcmp(v, "hex") == 0) {
+                p.topology = wordblitz::TopologyType::TOPOLOGY_HEX;
+            } else {
+                throw std::runtime_error(fmt::format("Unknown topology {}", v));
+            }
+        } else if (IsArg("-w", "--width")) {
+            p.width = atoi(GetValue(i));
+        } else if ((arg[0] == '-') && (arg[1] != 0)) {
+            throw std::runtime_error(fmt::format("Unknown argument {}", arg));
+        } else {
+            p.input_filepath = arg;
+        }
+    }
+
+    if (p.total_threads <= 0) {
+        p.total_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const bool is_bounded = (p.limits.max_results > 0) || (p.limits.time_budget.count() > 0);
+    if (is_bounded && (p.cache_directory != nullptr)) {
+        throw std::runtime_error("Solve cache only stores complete solves, it can't be used with a result limit or time budget");
+    }
+
+    return p;
+}
+
+// returns the hash of the dictionary file
+static uint64_t LoadDictionary(const char *filepath, wordtree::NodePool &pool) {
+    std::ifstream fp;
+    fp.open(filepath, std::ios::binary);
+    if (!fp.is_open()) {
+        throw std::runtime_error(fmt::format("Failed to load dictionary {}", filepath));
+    }
+    std::stringstream ss;
+    ss << fp.rdbuf();
+    fp.close();
+
+    const auto &buf = ss.str();
+    wordtree::ReadWordTree(buf.c_str(), static_cast<int>(buf.length()), pool, 20);
+    return wordblitz::GetDictionaryHash(buf.c_str(), buf.length());
+}
+
+class BatchSolver
+{
+private:
+    wordtree::NodePool &m_pool;
+    const SolveParams &m_params;
+    std::unique_ptr<wordblitz::SolveCache> m_cache;
+    std::mutex m_cache_mutex;
+    std::unique_ptr<wordblitz::WordSignatures> m_signatures;
+public:
+    BatchSolver(wordtree::NodePool &pool, const uint64_t dictionary_hash, const SolveParams &params)
+    : m_pool(pool), m_params(params)
+    {
+        if (params.cache_directory != nullptr) {
+            m_cache = std::make_unique<wordblitz::SolveCache>(4096, params.cache_directory, dictionary_hash);
+        }
+        const bool is_signatures_used = 
+            (params.engine == EngineChoice::ENGINE_AUTO) || 
+            (params.engine == EngineChoice::ENGINE_SIGNATURES);
+        if (is_signatures_used) {
+            m_signatures = std::make_unique<wordblitz::WordSignatures>(pool);
+        }
+    }
+
+    // solve all the boards using a shared work index between threads
+    // each thread takes a group of boards so they can be solved in lockstep
+    void Solve(const std::vector<BoardInput> &boards, std::vector<BoardOutput> &outputs) {
+        outputs.resize(boards.size());
+        std::atomic<size_t> next_index = 0;
+        const size_t group_size = IsBatched() ? static_cast<size_t>(m_params.total_lanes) : 1;
+        std::exception_ptr error = nullptr;
+        std::mutex error_mutex;
+
+        auto SolveGroups = [&]() {
+            std::vector<std::unique_ptr<wordblitz::Grid>> grids;
+            while (true) {
+                const size_t start = next_index.fetch_add(group_size);
+                if (start >= boards.size()) {
+                    break;
+                }
+                const size_t end = std::min(start+group_size, boards.size());
+                grids.resize(end-start);
+                for (size_t i = start; i < end; i++) {
+                    auto &board = boards[i];
+                    auto &grid = grids[i-start];
+                    if (!grid || (grid->width != board.width) || (grid->height != board.height)) {
+                        grid = std::make_unique<wordblitz::Grid>(CreateTopology(board.width, board.height));
+                    }
+                    wordblitz::CopyBoard(board, *grid);
+                }
+                SolveGroup(grids, &outputs[start]);
+            }
+        };
+
+        // the first error stops every thread from taking more boards, and is rethrown once they have finished
+        auto Worker = [&]() {
+            try {
+                SolveGroups();
+            } catch (...) {
+                next_index = boards.size();
+                auto lock = std::unique_lock(error_mutex);
+                if (error == nullptr) {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        const int total_threads = std::min(m_params.total_threads, static_cast<int>(boards.size()));
+        std::vector<std::thread> threads;
+        for (int i = 1; i < total_threads; i++) {
+            threads.emplace_back(Worker);
+        }
+        Worker();
+        for (auto &t: threads) {
+            t.join();
+        }
+
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+private:
+    wordblitz::Topology CreateTopology(const int width, const int height) const {
+        switch (m_params.topology) {
+        case wordblitz::TopologyType::TOPOLOGY_TORUS:
+            return wordblitz::CreateTorusTopology(width, height);
+        case wordblitz::TopologyType::TOPOLOGY_HEX:
+            return wordblitz::CreateHexTopology(width, height);
+        default:
+            return wordblitz::CreateGridTopology(width, height);
+        }
+    }
+
+    bool IsBounded() const {
+        const auto &limits = m_params.limits;
+        return (limits.max_results > 0) || (limits.time_budget.count() > 0);
+    }
+
+    bool IsBatched() const {
+        if (IsBounded()) {
+            return false;
+        }
+        return (m_params.engine == EngineChoice::ENGINE_AUTO) || (m_params.engine == EngineChoice::ENGINE_BATCH);
+    }
+
+    // boards which aren't solved on their own are left to the lockstep batch search
+    bool SolveBoard(wordblitz::Grid &grid, std::vector<wordblitz::TraceResult> &traces) {
+        if (IsBounded()) {
+            traces = wordblitz::SearchWordTreeTopK(m_pool, grid, m_params.limits);
+            return true;
+        }
+
+        if (m_cache) {
+            auto lock = std::unique_lock(m_cache_mutex);
+            if (m_cache->Find(grid, traces)) {
+                return true;
+            }
+        }
+
+        std::vector<wordblitz::SearchResult> searches;
+        switch (m_params.engine) {
+        case EngineChoice::ENGINE_TREE:
+            searches = wordblitz::SearchWordTree(m_pool, grid);
+            break;
+        case EngineChoice::ENGINE_SIGNATURES:
+            searches = m_signatures->Search(grid);
+            break;
+        case EngineChoice::ENGINE_AUTO:
+            // the batch engine is faster than either single board engine on boards it can hold
+            if (grid.size <= wordblitz::MAX_BATCH_CELLS) {
+                return false;
+            }
+            searches = wordblitz::SearchBoard(m_pool, *m_signatures, grid, wordblitz::ChooseSearchEngine(grid));
+            break;
+        default:
+            return false;
+        }
+        traces = wordblitz::GetTraceFromSearch(searches);
+        InsertCache(grid, traces);
+        return true;
+    }
+
+    void SolveGroup(std::vector<std::unique_ptr<wordblitz::Grid>> &grids, BoardOutput *outputs) {
+        std::vector<const wordblitz::Grid*> batch_grids;
+        std::vector<BoardOutput*> batch_outputs;
+        for (size_t i = 0; i < grids.size(); i++) {
+            const auto start = std::chrono::steady_clock::now();
+            const bool is_solved = SolveBoard(*grids[i], outputs[i].traces);
+            const auto end = std::chrono::steady_clock::now();
+            outputs[i].latency_us = std::chrono::duration<double, std::micro>(end-start).count();
+            if (!is_solved) {
+                batch_grids.push_back(grids[i].get());
+                batch_outputs.push_back(&outputs[i]);
+            }
+        }
+
+        if (batch_grids.empty()) {
+            return;
+        }
+
+        // no board of the batch is solved until the whole batch is, so each one waits for all of it
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<wordblitz::TraceResult>> batch_traces;
+        wordblitz::SearchWordTreeBatch(m_pool, batch_grids, batch_traces);
+        const auto end = std::chrono::steady_clock::now();
+        const double latency_us = std::chrono::duration<double, std::micro>(end-start).count();
+        for (size_t i = 0; i < batch_grids.size(); i++) {
+            batch_outputs[i]->traces = std::move(batch_traces[i]);
+            batch_outputs[i]->latency_us += latency_us;
+            InsertCache(*batch_grids[i], batch_outputs[i]->traces);
+        }
+    }
+
+    void InsertCache(const wordblitz::Grid &grid, const std::vector<wordblitz::TraceResult> &traces) {
+        if (m_cache) {
+            auto lock = std::unique_lock(m_cache_mutex);
+            m_cache->Insert(grid, traces);
+        }
+    }
+};
+
+static void WriteBoardOutput(FILE *fp, const OutputFormat format, const int index, const BoardOutput &output) {
+    if (format == OutputFormat::FORMAT_JSON) {
+        fmt::memory_buffer buf;
+        fmt::format_to(std::back_inserter(buf), "{{\"board\":{},\"latency_us\":{:.1f},\"traces\":[", index, output.latency_us);
+        bool is_first_trace = true;
+        for (auto &trace: output.traces) {
+            fmt::format_to(std::back_inserter(buf),
+                "{}{{\"word\":\"{}\",\"value\":{},\"path\":[",
+                is_first_trace ? "" : ",", trace.word, trace.value);
+            is_first_trace = false;
+            bool is_first_cursor = true;
+            for (auto &c: trace.path) {
+                fmt::format_to(std::back_inserter(buf), "{}[{},{}]", is_first_cursor ? "" : ",", c.x, c.y);
+                is_first_cursor = false;
+            }
+            fmt::format_to(std::back_inserter(buf), "]}}");
+        }
+        fmt::format_to(std::back_inserter(buf), "]}}\n");
+        fwrite(buf.data(), 1, buf.size(), fp);
+        return;
+    }
+
+    std::vector<uint8_t> buf;
+    auto WriteU32 = [&buf](const uint32_t v) {
+        for (int i = 0; i < 4; i++) buf.push_back(static_cast<uint8_t>(v >> (8*i)));
+    };
+    auto WriteU16 = [&buf](const uint16_t v) {
+        for (int i = 0; i < 2; i++) buf.push_back(static_cast<uint8_t>(v >> (8*i)));
+    };
+    WriteU32(static_cast<uint32_t>(index));
+    WriteU32(static_cast<uint32_t>(output.traces.size()));
+    for (auto &trace: output.traces) {
+        buf.push_back(static_cast<uint8_t>(trace.word.length()));
+        buf.insert(buf.end(), trace.word.begin(), trace.word.end());
+        WriteU32(static_cast<uint32_t>(trace.value));
+        buf.push_back(static_cast<uint8_t>(trace.path.size()));
+        for (auto &c: trace.path) {
+            WriteU16(static_cast<uint16_t>(c.x));
+            WriteU16(static_cast<uint16_t>(c.y));
+        }
+    }
+    fwrite(buf.data(), 1, buf.size(), fp);
+}
+
+static double GetPercentile(const std::vector<double> &sorted, const double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t i = static_cast<size_t>(p * static_cast<double>(sorted.size()-1) + 0.5);
+    return sorted[std::min(i, sorted.size()-1)];
+}
+
+int run_solver(int argc, char **argv) {
+    const auto params = ParseArgs(argc, argv);
+
+    wordtree::NodePool pool;
+    uint64_t dictionary_hash = 0;
+    {
+        const auto start = std::chrono::steady_clock::now();
+        dictionary_hash = LoadDictionary(params.dict_filepath, pool);
+        const auto end = std::chrono::steady_clock::now();
+        fprintf(stderr, "loaded dictionary with %d nodes in %.1fms\n",
+            static_cast<int>(pool.size()),
+            std::chrono::duration<double, std::milli>(end-start).count());
+    }
+
+    std::ifstream input_file;
+    if (params.input_filepath != nullptr) {
+        input_file.open(params.input_filepath);
+        if (!input_file.is_open()) {
+            throw std::runtime_error(fmt::format("Failed to open input {}", params.input_filepath));
+        }
+    }
+    std::istream &input = (params.input_filepath != nullptr) ? input_file : std::cin;
+
+    FILE *output = stdout;
+    if (params.output_filepath != nullptr) {
+        const char *mode = (params.format == OutputFormat::FORMAT_BINARY) ? "wb" : "w";
+        output = fopen(params.output_filepath, mode);
+        if (output == nullptr) {
+            throw std::runtime_error(fmt::format("Failed to open output {}", params.output_filepath));
+        }
+    }
+
+    BatchSolver solver(pool, dictionary_hash, params);
+    std::vector<BoardInput> boards;
+    std::vector<BoardOutput> outputs;
+    std::vector<double> latencies;
+    double total_solve_seconds = 0.0;
+    int total_boards = 0;
+    int line_number = 0;
+
+    auto SolveChunk = [&]() {
+        const auto start = std::chrono::steady_clock::now();
+        solver.Solve(boards, outputs);
+        const auto end = std::chrono::steady_clock::now();
+        total_solve_seconds += std::chrono::duration<double>(end-start).count();
+
+        for (size_t i = 0; i < boards.size(); i++) {
+            WriteBoardOutput(output, params.format, boards[i].index, outputs[i]);
+            latencies.push_back(outputs[i].latency_us);
+        }
+        boards.clear();
+    };
+
+    // read boards in chunks so we don't need to hold the entire input in memory
+    std::string line;
+    while (std::getline(input, line)) {
+        line_number++;
+        BoardInput board;
+        if (!wordblitz::ParseBoard(line, line_number, params.width, board)) {
+            continue;
+        }
+        board.index = total_boards++;
+        boards.push_back(std::move(board));
+        if (static_cast<int>(boards.size()) >= params.chunk_size) {
+            SolveChunk();
+        }
+    }
+    if (!boards.empty()) {
+        SolveChunk();
+    }
+
+    if (output != stdout) {
+        fclose(output);
+    } else {
+        fflush(output);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const double boards_per_second = (total_solve_seconds > 0.0) ? (total_boards / total_solve_seconds) : 0.0;
+    fprintf(stderr, "solved %d boards on %d threads in %.3fs (%.1f boards/s)\n",
+        total_boards, params.total_threads, total_solve_seconds, boards_per_second);
+    fprintf(stderr, "latency_us p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+        GetPercentile(latencies, 0.50),
+        GetPercentile(latencies, 0.90),
+        GetPercentile(latencies, 0.99),
+        latencies.empty() ? 0.0 : latencies.back());
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    try {
+        return run_solver(argc, argv);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+    }
+
+    return 1;
+}
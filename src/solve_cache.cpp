@@ -0,0 +1,388 @@
+#include "solve_cache.h"
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <fmt/core.h>
+
+namespace wordblitz {
+
+constexpr int TOTAL_TRANSFORMS = 8;
+// transform i is undone by transform INVERSE_TRANSFORM[i]
+constexpr int INVERSE_TRANSFORM[TOTAL_TRANSFORMS] = {0, 3, 2, 1, 4, 5, 6, 7};
+
+constexpr uint32_t CACHE_FILE_MAGIC = 0x43534257; // "WBSC"
+constexpr uint32_t CACHE_FILE_VERSION = 3;
+
+// the key starts with the topology type, width and height
+constexpr int KEY_HEADER_SIZE = 3;
+
+// rotations and reflections of a cursor on a width*height grid
+// transforms 1, 3, 6 and 7 swap the axes so they are only valid on square grids
+static Cursor TransformCursor(const Cursor c, const int transform, const int width, const int height) {
+    switch (transform) {
+    case 0: return {c.x, c.y};
+    case 1: return {width-1-c.y, c.x};
+    case 2: return {width-1-c.x, height-1-c.y};
+    case 3: return {c.y, height-1-c.x};
+    case 4: return {width-1-c.x, c.y};
+    case 5: return {c.x, height-1-c.y};
+    case 6: return {c.y, c.x};
+    case 7: return {width-1-c.y, height-1-c.x};
+    default:
+        return c;
+    }
+}
+
+// check if the transform maps the adjacency of the board onto itself
+static bool IsSymmetry(const Topology &topology, const int transform) {
+    switch (topology.type) {
+    case TopologyType::TOPOLOGY_GRID:
+    case TopologyType::TOPOLOGY_TORUS:
+        if (topology.width == topology.height) {
+            return true;
+        }
+        return (transform == 0) || (transform == 2) || (transform == 4) || (transform == 5);
+    // hex rows are staggered, and custom adjacency has no known symmetries
+    default:
+        return transform == 0;
+    }
+}
+
+// each cell is packed as |letter:5|modifier:3|value:8|
+static bool PackCell(const char c, const int value, const CellModifier modifier, uint16_t &packed) {
+    const int letter = c - 'a';
+    if ((letter < 0) || (letter >= 26)) return false;
+    if ((value < 0) || (value > 0xFF)) return false;
+    packed = static_cast<uint16_t>((letter << 11) | ((static_cast<int>(modifier) & 0x7) << 8) | value);
+    return true;
+}
+
+// FNV-1a
+static uint64_t HashKey(const std::vector<uint16_t> &key) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint16_t v: key) {
+        hash = (hash ^ (v & 0xFF)) * 0x100000001b3ull;
+        hash = (hash ^ (v >> 8))   * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// copies the traces into a vector whose buffers are reused
+static void CopyTraces(
+    const std::vector<TraceResult> &src, std::vector<TraceResult> &dst,
+    ResultRecycler<TraceResult> &recycler)
+{
+    size_t max_length = 0;
+    for (auto &trace: src) {
+        max_length = std::max(max_length, trace.path.size());
+    }
+    recycler.SetReserveLength(max_length);
+    recycler.Recycle(dst, std::min(src.size(), dst.size()));
+    for (size_t i = 0; i < src.size(); i++) {
+        auto &trace = (i < dst.size()) ? dst[i] : recycler.Push(dst);
+        trace.path.reserve(recycler.GetReserveLength());
+        trace.word.reserve(recycler.GetReserveLength());
+        trace.path.assign(src[i].path.begin(), src[i].path.end());
+        trace.word.assign(src[i].word);
+        trace.value = src[i].value;
+        trace.status = src[i].status;
+        trace.confidence = src[i].confidence;
+    }
+}
+
+// FNV-1a over 64bit words
+uint64_t GetDictionaryHash(const char *buffer, const size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; (i+8) <= length; i += 8) {
+        uint64_t v;
+        memcpy(&v, buffer+i, sizeof(v));
+        hash = (hash ^ v) * 0x100000001b3ull;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ static_cast<uint8_t>(buffer[i])) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+SolveCache::SolveCache(const size_t max_entries, const char *directory, const uint64_t dictionary_hash)
+: m_max_entries(max_entries), m_dictionary_hash(dictionary_hash)
+{
+    m_lookup.reserve(max_entries+1);
+    m_total_hits = 0;
+    m_total_misses = 0;
+    if (directory != nullptr) {
+        m_directory = directory;
+        std::filesystem::create_directories(m_directory);
+    }
+}
+
+bool SolveCache::GetCanonicalBoard(const Grid &grid, CanonicalBoard &board) {
+    // custom adjacency isn't part of the key
+    auto &topology = grid.topology;
+    if (topology.type == TopologyType::TOPOLOGY_CUSTOM) {
+        return false;
+    }
+
+    auto &cells = m_cells;
+    cells.resize(grid.size);
+    for (int i = 0; i < grid.size; i++) {
+        if (!PackCell(grid.characters[i], grid.values[i], grid.modifiers[i], cells[i])) {
+            return false;
+        }
+    }
+
+    // pick the orientation with the lexicographically smallest key
+    auto &key = m_key;
+    key.resize(KEY_HEADER_SIZE + grid.size);
+    key[0] = static_cast<uint16_t>(topology.type);
+    key[1] = static_cast<uint16_t>(grid.width);
+    key[2] = static_cast<uint16_t>(grid.height);
+    board.key.clear();
+    board.transform = 0;
+    for (int t = 0; t < TOTAL_TRANSFORMS; t++) {
+        if (!IsSymmetry(topology, t)) {
+            continue;
+        }
+        for (int x = 0; x < grid.width; x++) {
+            for (int y = 0; y < grid.height; y++) {
+                const auto c = TransformCursor({x, y}, t, grid.width, grid.height);
+                key[KEY_HEADER_SIZE + grid.GetIndex(c.x, c.y)] = cells[grid.GetIndex(x, y)];
+            }
+        }
+        if (board.key.empty() || (key < board.key)) {
+            board.key = key;
+            board.transform = t;
+        }
+    }
+
+    board.hash = HashKey(board.key);
+    return true;
+}
+
+bool SolveCache::Find(const Grid &grid, std::vector<TraceResult> &traces) {
+    auto &board = m_board;
+    if (!GetCanonicalBoard(grid, board)) {
+        m_total_misses++;
+        return false;
+    }
+
+    const std::vector<TraceResult> *canonical_traces = nullptr;
+    auto it = m_lookup.find(board.hash);
+    if ((it != m_lookup.end()) && (it->second->key == board.key)) {
+        // move to the front since it is the most recently used
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        canonical_traces = &m_entries.front().traces;
+    } else {
+        Entry entry;
+        if (!ReadEntry(board, entry)) {
+            m_total_misses++;
+            return false;
+        }
+        PushFrontEntry() = std::move(entry);
+        LinkFrontEntry();
+        if (m_entries.empty()) {
+            m_total_misses++;
+            return false;
+        }
+        canonical_traces = &m_entries.front().traces;
+    }
+
+    // transform paths back into the orientation of the grid
+    const int inverse = INVERSE_TRANSFORM[board.transform];
+    CopyTraces(*canonical_traces, traces, m_traces);
+    for (auto &trace: traces) {
+        for (auto &c: trace.path) {
+            c = TransformCursor(c, inverse, grid.width, grid.height);
+        }
+        trace.status = TraceStatus::INCOMPLETE;
+    }
+
+    m_total_hits++;
+    return true;
+}
+
+void SolveCache::Insert(const Grid &grid, const std::vector<TraceResult> &traces) {
+    auto &board = m_board;
+    if (!GetCanonicalBoard(grid, board)) {
+        return;
+    }
+
+    auto &entry = PushFrontEntry();
+    entry.hash = board.hash;
+    entry.key = board.key;
+    CopyTraces(traces, entry.traces, m_traces);
+    for (auto &trace: entry.traces) {
+        for (auto &c: trace.path) {
+            c = TransformCursor(c, board.transform, grid.width, grid.height);
+        }
+        trace.status = TraceStatus::INCOMPLETE;
+    }
+
+    if (!m_directory.empty()) {
+        WriteEntry(entry);
+    }
+    LinkFrontEntry();
+}
+
+void SolveCache::Clear() {
+    m_entries.clear();
+    m_lookup.clear();
+    m_free_entries.clear();
+    m_free_node = EntryLookup::node_type();
+    m_total_hits = 0;
+    m_total_misses = 0;
+}
+
+// an unlinked entry at the front, which reuses an evicted entry if there is one
+SolveCache::Entry& SolveCache::PushFrontEntry() {
+    if (m_free_entries.empty()) {
+        m_free_entries.emplace_back();
+    }
+    m_entries.splice(m_entries.begin(), m_free_entries, m_free_entries.begin());
+    return m_entries.front();
+}
+
+// adds the front entry to the lookup, replacing an older entry of the same board
+void SolveCache::LinkFrontEntry() {
+    const uint64_t hash = m_entries.front().hash;
+    auto it = m_lookup.find(hash);
+    const bool is_replaced = it != m_lookup.end();
+    if (is_replaced) {
+        m_free_entries.splice(m_free_entries.end(), m_entries, it->second);
+        it->second = m_entries.begin();
+    }
+
+    // evict the least recently used
+    while (m_entries.size() > m_max_entries) {
+        EvictEntry();
+    }
+    if (m_entries.empty() || is_replaced) {
+        return;
+    }
+
+    if (m_free_node.empty()) {
+        m_lookup[hash] = m_entries.begin();
+    } else {
+        m_free_node.key() = hash;
+        m_free_node.mapped() = m_entries.begin();
+        m_lookup.insert(std::move(m_free_node));
+    }
+}
+
+void SolveCache::EvictEntry() {
+    auto last = std::prev(m_entries.end());
+    auto it = m_lookup.find(last->hash);
+    if ((it != m_lookup.end()) && (it->second == last)) {
+        m_free_node = m_lookup.extract(it);
+    }
+    m_free_entries.splice(m_free_entries.end(), m_entries, last);
+}
+
+std::string SolveCache::GetEntryPath(const uint64_t hash) const {
+    return fmt::format("{}/{:016x}.bin", m_directory, hash);
+}
+
+template <typename T>
+static void WriteValue(std::ofstream &fp, const T &v) {
+    fp.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+static bool ReadValue(std::ifstream &fp, T &v) {
+    fp.read(reinterpret_cast<char*>(&v), sizeof(T));
+    return fp.good();
+}
+
+void SolveCache::WriteEntry(const Entry &entry) {
+    // renamed over the old entry once written, so a failed write never leaves a truncated entry
+    const std::string filepath = GetEntryPath(entry.hash);
+    const std::string temp_filepath = filepath + ".tmp";
+    std::ofstream fp(temp_filepath, std::ios::binary);
+    if (!fp.is_open()) {
+        throw std::runtime_error(fmt::format(
+            "Failed to write solve cache entry to {}", filepath));
+    }
+
+    WriteValue(fp, CACHE_FILE_MAGIC);
+    WriteValue(fp, CACHE_FILE_VERSION);
+    WriteValue(fp, m_dictionary_hash);
+    WriteValue(fp, static_cast<uint32_t>(entry.key.size()));
+    fp.write(reinterpret_cast<const char*>(entry.key.data()), entry.key.size()*sizeof(uint16_t));
+    WriteValue(fp, static_cast<uint32_t>(entry.traces.size()));
+    for (auto &trace: entry.traces) {
+        WriteValue(fp, static_cast<uint32_t>(trace.word.length()));
+        fp.write(trace.word.data(), trace.word.length());
+        WriteValue(fp, static_cast<int32_t>(trace.value));
+        WriteValue(fp, static_cast<uint32_t>(trace.path.size()));
+        for (auto &c: trace.path) {
+            WriteValue(fp, static_cast<int32_t>(c.x));
+            WriteValue(fp, static_cast<int32_t>(c.y));
+        }
+    }
+    fp.close();
+
+    std::error_code error;
+    if (!fp.good()) {
+        std::filesystem::remove(temp_filepath, error);
+        throw std::runtime_error(fmt::format(
+            "Failed to write solve cache entry to {}", filepath));
+    }
+    std::filesystem::rename(temp_filepath, filepath, error);
+    if (error) {
+        const std::string message = error.message();
+        std::filesystem::remove(temp_filepath, error);
+        throw std::runtime_error(fmt::format(
+            "Failed to replace solve cache entry {}: {}", filepath, message));
+    }
+}
+
+bool SolveCache::ReadEntry(const CanonicalBoard &board, Entry &entry) {
+    if (m_directory.empty()) {
+        return false;
+    }
+
+    std::ifstream fp(GetEntryPath(board.hash), std::ios::binary);
+    if (!fp.is_open()) {
+        return false;
+    }
+
+    uint32_t magic, version, key_size, total_traces;
+    uint64_t dictionary_hash;
+    if (!ReadValue(fp, magic) || (magic != CACHE_FILE_MAGIC)) return false;
+    if (!ReadValue(fp, version) || (version != CACHE_FILE_VERSION)) return false;
+    // solved with another dictionary
+    if (!ReadValue(fp, dictionary_hash) || (dictionary_hash != m_dictionary_hash)) return false;
+    if (!ReadValue(fp, key_size) || (key_size != board.key.size())) return false;
+
+    entry.hash = board.hash;
+    entry.key.resize(key_size);
+    fp.read(reinterpret_cast<char*>(entry.key.data()), key_size*sizeof(uint16_t));
+    // different board with a colliding hash
+    if (!fp.good() || (entry.key != board.key)) return false;
+
+    if (!ReadValue(fp, total_traces)) return false;
+    entry.traces.resize(total_traces);
+    for (auto &trace: entry.traces) {
+        uint32_t word_length, path_length;
+        int32_t value;
+        if (!ReadValue(fp, word_length)) return false;
+        trace.word.resize(word_length);
+        fp.read(trace.word.data(), word_length);
+        if (!ReadValue(fp, value)) return false;
+        if (!ReadValue(fp, path_length) || (path_length > board.key.size())) return false;
+        trace.value = value;
+        trace.status = TraceStatus::INCOMPLETE;
+        trace.path.resize(path_length);
+        for (auto &c: trace.path) {
+            int32_t x, y;
+            if (!ReadValue(fp, x) || !ReadValue(fp, y)) return false;
+            c = {x, y};
+        }
+    }
+    return true;
+}
+
+}
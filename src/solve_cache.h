@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "wordblitz.h"
+
+namespace wordblitz {
+
+// hash of the contents of a dictionary, so persisted entries aren't used with a different dictionary
+uint64_t GetDictionaryHash(const char *buffer, const size_t length);
+
+// caches the traces of solved boards
+// boards are canonicalised over the rotations and reflections which preserve their topology
+// so a rotated or mirrored board hits the same entry
+// hot entries are kept in memory, and entries can optionally persist to a directory
+class SolveCache
+{
+private:
+    struct Entry {
+        uint64_t hash;
+        std::vector<uint16_t> key;
+        std::vector<TraceResult> traces;
+    };
+    // a board packed into its canonical orientation
+    struct CanonicalBoard {
+        uint64_t hash;
+        std::vector<uint16_t> key;
+        int transform;
+    };
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_map<uint64_t, EntryList::iterator> EntryLookup;
+private:
+    const size_t m_max_entries;
+    std::string m_directory;
+    const uint64_t m_dictionary_hash;
+    EntryList m_entries;
+    EntryLookup m_lookup;
+
+    // evicted entries and lookup nodes are kept so a full cache doesn't allocate on a miss
+    EntryList m_free_entries;
+    EntryLookup::node_type m_free_node;
+    ResultRecycler<TraceResult> m_traces;
+    // scratch buffers for canonicalising a board
+    CanonicalBoard m_board;
+    std::vector<uint16_t> m_cells;
+    std::vector<uint16_t> m_key;
+
+    int m_total_hits;
+    int m_total_misses;
+public:
+    // persisted entries are only read back with the same dictionary hash they were written with
+    SolveCache(const size_t max_entries, const char *directory=nullptr, const uint64_t dictionary_hash=0);
+    // on a hit the traces are transformed back into the orientation of the grid
+    bool Find(const Grid &grid, std::vector<TraceResult> &traces);
+    void Insert(const Grid &grid, const std::vector<TraceResult> &traces);
+    void Clear();
+
+    inline int GetTotalHits() const { return m_total_hits; }
+    inline int GetTotalMisses() const { return m_total_misses; }
+    inline int GetTotalEntries() const { return static_cast<int>(m_entries.size()); }
+private:
+    bool GetCanonicalBoard(const Grid &grid, CanonicalBoard &board);
+    Entry& PushFrontEntry();
+    void LinkFrontEntry();
+    void EvictEntry();
+    std::string GetEntryPath(const uint64_t hash) const;
+    bool ReadEntry(const CanonicalBoard &board, Entry &entry);
+    void WriteEntry(const Entry &entry);
+};
+
+}
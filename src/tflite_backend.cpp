@@ -0,0 +1,171 @@
+#include "tflite_backend.h"
+
+#include <stdio.h>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+static void PrintTfLiteModelSummary(TfLiteInterpreter *interpreter);
+static void PrintTfLiteTensorSummary(const TfLiteTensor *tensor);
+
+static TensorInfo GetTensorInfo(const TfLiteTensor *tensor, const char *name) {
+    TensorInfo info;
+    switch (TfLiteTensorType(tensor)) {
+    case kTfLiteFloat32:    info.type = TENSOR_FLOAT32; break;
+    case kTfLiteUInt8:      info.type = TENSOR_UINT8; break;
+    case kTfLiteInt8:       info.type = TENSOR_INT8; break;
+    default:
+        throw std::runtime_error(fmt::format(
+            "Model expected a float, uint8 or int8 {} tensor, got {}",
+            name, TfLiteTypeGetName(TfLiteTensorType(tensor))));
+    }
+    for (int i = 0; i < TfLiteTensorNumDims(tensor); i++) {
+        info.dims.push_back(TfLiteTensorDim(tensor, i));
+    }
+    const TfLiteQuantizationParams params = TfLiteTensorQuantizationParams(tensor);
+    info.scale = params.scale;
+    info.zero_point = params.zero_point;
+    return info;
+}
+
+// interpreter whose tensors are read from and written to directly
+class TfLiteSession: public ModelSession
+{
+private:
+    TfLiteInterpreter *m_interp;
+    TfLiteTensor *m_input_tensor;
+    const TfLiteTensor *m_output_tensor;
+public:
+    TfLiteSession(TfLiteModel *model, TfLiteInterpreterOptions *options) {
+        m_interp = TfLiteInterpreterCreate(model, options);
+        if (m_interp == nullptr) {
+            throw std::runtime_error("Failed to create an interpreter");
+        }
+        if (TfLiteInterpreterAllocateTensors(m_interp) != kTfLiteOk) {
+            TfLiteInterpreterDelete(m_interp);
+            throw std::runtime_error("Failed to allocate the tensors of an interpreter");
+        }
+        UpdateTensors();
+    }
+
+    ~TfLiteSession() override {
+        TfLiteInterpreterDelete(m_interp);
+    }
+
+    bool Resize(const int batch_size) override {
+        const int total_dims = TfLiteTensorNumDims(m_input_tensor);
+        const int old_batch_size = TfLiteTensorDim(m_input_tensor, 0);
+        std::vector<int> dims(total_dims);
+        for (int i = 0; i < total_dims; i++) {
+            dims[i] = TfLiteTensorDim(m_input_tensor, i);
+        }
+        const auto TryResize = [this, &dims](const int n) {
+            dims[0] = n;
+            if (TfLiteInterpreterResizeInputTensor(m_interp, 0, dims.data(), static_cast<int>(dims.size())) != kTfLiteOk) {
+                return false;
+            }
+            return TfLiteInterpreterAllocateTensors(m_interp) == kTfLiteOk;
+        };
+        const bool is_resized = TryResize(batch_size);
+        if (!is_resized && !TryResize(old_batch_size)) {
+            throw std::runtime_error("Failed to restore the interpreter after resizing the batch");
+        }
+        UpdateTensors();
+        return is_resized;
+    }
+
+    void *GetInputData() override { return TfLiteTensorData(m_input_tensor); }
+    size_t GetInputBytes() const override { return TfLiteTensorByteSize(m_input_tensor); }
+    const void *GetOutputData() const override { return TfLiteTensorData(m_output_tensor); }
+    size_t GetOutputBytes() const override { return TfLiteTensorByteSize(m_output_tensor); }
+
+    void Invoke() override {
+        if (TfLiteInterpreterInvoke(m_interp) != kTfLiteOk) {
+            throw std::runtime_error("Failed to invoke the model");
+        }
+        // invoking can move outputs which are allocated dynamically
+        m_output_tensor = TfLiteInterpreterGetOutputTensor(m_interp, 0);
+    }
+private:
+    void UpdateTensors() {
+        m_input_tensor = TfLiteInterpreterGetInputTensor(m_interp, 0);
+        m_output_tensor = TfLiteInterpreterGetOutputTensor(m_interp, 0);
+    }
+};
+
+TfLiteBackend::TfLiteBackend(const char *filepath) {
+    // load model
+    m_model = TfLiteModelCreateFromFile(filepath);
+    if (m_model == nullptr) {
+        throw std::runtime_error(fmt::format("Failed to load model from {}", filepath));
+    }
+    m_options = TfLiteInterpreterOptionsCreate();
+    // const uint32_t num_threads = std::thread::hardware_concurrency();
+    // NOTE: disable threading since the overhead due to multithread is too high
+    // crops are run in parallel on separate interpreters instead, whose number is tuned per host
+    const uint32_t num_threads = 1;
+    TfLiteInterpreterOptionsSetNumThreads(m_options, num_threads);
+    // Create the interpreter.
+    m_interp = TfLiteInterpreterCreate(m_model, m_options);
+    // Allocate tensors and populate the input tensor data.
+    TfLiteInterpreterAllocateTensors(m_interp);
+
+    m_input_info = GetTensorInfo(TfLiteInterpreterGetInputTensor(m_interp, 0), "input");
+    m_output_info = GetTensorInfo(TfLiteInterpreterGetOutputTensor(m_interp, 0), "output");
+}
+
+TfLiteBackend::~TfLiteBackend() {
+    // Dispose of the model and interpreter objects.
+    TfLiteInterpreterDelete(m_interp);
+    TfLiteInterpreterOptionsDelete(m_options);
+    TfLiteModelDelete(m_model);
+}
+
+std::unique_ptr<ModelSession> TfLiteBackend::CreateSession() {
+    return std::make_unique<TfLiteSession>(m_model, m_options);
+}
+
+void TfLiteBackend::Print() const {
+    PrintTfLiteModelSummary(m_interp);
+}
+
+void PrintTfLiteModelSummary(TfLiteInterpreter *interpreter) {
+    int input_tensor_count = TfLiteInterpreterGetInputTensorCount(interpreter);
+    int output_tensor_count = TfLiteInterpreterGetOutputTensorCount(interpreter);
+    printf("inputs=%d, output=%d\n", input_tensor_count, output_tensor_count);
+
+    for (int i = 0; i < input_tensor_count; i++) {
+        const TfLiteTensor* input_tensor = TfLiteInterpreterGetInputTensor(interpreter, i);
+        printf("inp_tensor[%d]: ", i);
+        PrintTfLiteTensorSummary(input_tensor);
+    }
+
+    for (int i = 0; i < output_tensor_count; i++) {
+        const TfLiteTensor* output_tensor = TfLiteInterpreterGetOutputTensor(interpreter, i);
+        printf("out_tensor[%d]: ", i);
+        PrintTfLiteTensorSummary(output_tensor);
+    }
+}
+
+void PrintTfLiteTensorSummary(const TfLiteTensor *tensor) {
+    printf("%s (", TfLiteTensorName(tensor));
+    // size of tensor
+    for (int j = 0; j < TfLiteTensorNumDims(tensor); j++) {
+        int dim = TfLiteTensorDim(tensor, j);
+        if (j != TfLiteTensorNumDims(tensor)-1) {
+            printf("%d,", dim);
+        } else {
+            printf("%d) ", dim);
+        }
+    }
+    // type of tensor
+    TfLiteType t = TfLiteTensorType(tensor);
+    printf("%s ", TfLiteTypeGetName(t));
+    // quantisation?
+    if ((t == kTfLiteUInt8) || (t == kTfLiteInt8)) {
+        TfLiteQuantizationParams qparams = TfLiteTensorQuantizationParams(tensor);
+        printf("[scale=%.2f, zero_point=%d]\n", qparams.scale, qparams.zero_point);
+    } else {
+        printf("\n");
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "tensorflow/lite/c/c_api.h"
+#include "tensorflow/lite/c/common.h"
+
+#include "model_backend.h"
+
+// runs a model with the tensorflow lite c api
+// each session is an interpreter which shares the loaded model
+class TfLiteBackend: public ModelBackend
+{
+private:
+    TfLiteModel *m_model;
+    TfLiteInterpreterOptions *m_options;
+    TensorInfo m_input_info;
+    TensorInfo m_output_info;
+    // interpreter which describes the tensors of the model
+    TfLiteInterpreter *m_interp;
+public:
+    TfLiteBackend(const char *filepath);
+    ~TfLiteBackend() override;
+    const TensorInfo& GetInputInfo() const override { return m_input_info; }
+    const TensorInfo& GetOutputInfo() const override { return m_output_info; }
+    std::unique_ptr<ModelSession> CreateSession() override;
+    void Print() const override;
+};
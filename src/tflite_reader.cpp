@@ -0,0 +1,299 @@
+#include "tflite_reader.h"
+
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+namespace tiny_cnn {
+
+// table of a flatbuffer where every read is bounds checked
+class FlatTable
+{
+private:
+    const uint8_t *m_buf;
+    size_t m_size;
+    size_t m_pos;
+    size_t m_vtable;
+    uint16_t m_vtable_size;
+public:
+    FlatTable(const uint8_t *buf, const size_t size, const size_t pos)
+    : m_buf(buf), m_size(size), m_pos(pos)
+    {
+        const int64_t vtable = (int64_t)pos - (int64_t)Read<int32_t>(pos);
+        if ((vtable < 0) || ((size_t)vtable >= size)) {
+            throw std::runtime_error("Model file has a table outside of the file");
+        }
+        m_vtable = (size_t)vtable;
+        m_vtable_size = Read<uint16_t>(m_vtable);
+    }
+
+    template <typename T>
+    T Read(const size_t pos) const {
+        if ((pos > m_size) || (sizeof(T) > (m_size-pos))) {
+            throw std::runtime_error("Model file ends in the middle of a table");
+        }
+        T v;
+        memcpy(&v, m_buf+pos, sizeof(T));
+        return v;
+    }
+
+    // position of a field, which is 0 if the field isn't set
+    size_t GetField(const int field) const {
+        const size_t entry = 4 + 2*field;
+        if (entry >= m_vtable_size) {
+            return 0;
+        }
+        const uint16_t offset = Read<uint16_t>(m_vtable + entry);
+        return (offset == 0) ? 0 : (m_pos + offset);
+    }
+
+    template <typename T>
+    T GetScalar(const int field, const T default_value) const {
+        const size_t pos = GetField(field);
+        return (pos == 0) ? default_value : Read<T>(pos);
+    }
+
+    bool HasField(const int field) const {
+        return GetField(field) != 0;
+    }
+
+    // position after the offset stored in a field
+    size_t GetIndirect(const int field) const {
+        const size_t pos = GetField(field);
+        if (pos == 0) {
+            return 0;
+        }
+        return pos + Read<uint32_t>(pos);
+    }
+
+    FlatTable GetTable(const int field) const {
+        const size_t pos = GetIndirect(field);
+        if (pos == 0) {
+            throw std::runtime_error(fmt::format("Model file is missing table field {}", field));
+        }
+        return FlatTable(m_buf, m_size, pos);
+    }
+
+    // start of the elements and their count, which is 0 if the vector isn't set
+    size_t GetVector(const int field, const size_t element_size, uint32_t &count) const {
+        const size_t pos = GetIndirect(field);
+        if (pos == 0) {
+            count = 0;
+            return 0;
+        }
+        count = Read<uint32_t>(pos);
+        const size_t start = pos + 4;
+        if ((start > m_size) || (((size_t)count*element_size) > (m_size-start))) {
+            throw std::runtime_error("Model file has a vector outside of the file");
+        }
+        return start;
+    }
+
+    template <typename T>
+    std::vector<T> GetScalars(const int field) const {
+        uint32_t count;
+        const size_t start = GetVector(field, sizeof(T), count);
+        std::vector<T> values(count);
+        for (uint32_t i = 0; i < count; i++) {
+            values[i] = Read<T>(start + i*sizeof(T));
+        }
+        return values;
+    }
+
+    std::vector<FlatTable> GetTables(const int field) const {
+        uint32_t count;
+        const size_t start = GetVector(field, 4, count);
+        std::vector<FlatTable> tables;
+        tables.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            const size_t pos = start + 4*i;
+            tables.emplace_back(m_buf, m_size, pos + Read<uint32_t>(pos));
+        }
+        return tables;
+    }
+
+    std::string GetString(const int field) const {
+        uint32_t count;
+        const size_t start = GetVector(field, 1, count);
+        return std::string((const char*)m_buf + start, count);
+    }
+};
+
+// field ids of the tables in the tflite schema
+namespace schema {
+    enum Model { MODEL_OPERATOR_CODES = 1, MODEL_SUBGRAPHS = 2, MODEL_BUFFERS = 4 };
+    enum OperatorCode { OPCODE_DEPRECATED_BUILTIN_CODE = 0, OPCODE_BUILTIN_CODE = 3 };
+    enum SubGraph { SUBGRAPH_TENSORS = 0, SUBGRAPH_INPUTS = 1, SUBGRAPH_OUTPUTS = 2, SUBGRAPH_OPERATORS = 3 };
+    enum Tensor { TENSOR_SHAPE = 0, TENSOR_TYPE = 1, TENSOR_BUFFER = 2, TENSOR_NAME = 3, TENSOR_QUANTIZATION = 4 };
+    enum Quantization { QUANTIZATION_SCALE = 2, QUANTIZATION_ZERO_POINT = 3, QUANTIZATION_DIMENSION = 6 };
+    enum Buffer { BUFFER_DATA = 0, BUFFER_OFFSET = 1, BUFFER_SIZE = 2 };
+    enum Operator { OPERATOR_OPCODE_INDEX = 0, OPERATOR_INPUTS = 1, OPERATOR_OUTPUTS = 2, OPERATOR_OPTIONS = 4 };
+}
+
+static void ReadOptions(const FlatTable &op, FileOperator &o) {
+    if (!op.HasField(schema::OPERATOR_OPTIONS)) {
+        return;
+    }
+    const FlatTable opts = op.GetTable(schema::OPERATOR_OPTIONS);
+    switch (o.code) {
+    case BUILTIN_CONV_2D:
+        o.padding           = opts.GetScalar<int8_t>(0, PADDING_SAME);
+        o.stride_w          = opts.GetScalar<int32_t>(1, 0);
+        o.stride_h          = opts.GetScalar<int32_t>(2, 0);
+        o.activation        = opts.GetScalar<int8_t>(3, ACTIVATION_NONE);
+        o.dilation_w        = opts.GetScalar<int32_t>(4, 1);
+        o.dilation_h        = opts.GetScalar<int32_t>(5, 1);
+        break;
+    case BUILTIN_DEPTHWISE_CONV_2D:
+        o.padding           = opts.GetScalar<int8_t>(0, PADDING_SAME);
+        o.stride_w          = opts.GetScalar<int32_t>(1, 0);
+        o.stride_h          = opts.GetScalar<int32_t>(2, 0);
+        o.depth_multiplier  = opts.GetScalar<int32_t>(3, 0);
+        o.activation        = opts.GetScalar<int8_t>(4, ACTIVATION_NONE);
+        o.dilation_w        = opts.GetScalar<int32_t>(5, 1);
+        o.dilation_h        = opts.GetScalar<int32_t>(6, 1);
+        break;
+    case BUILTIN_AVERAGE_POOL_2D:
+    case BUILTIN_MAX_POOL_2D:
+        o.padding           = opts.GetScalar<int8_t>(0, PADDING_SAME);
+        o.stride_w          = opts.GetScalar<int32_t>(1, 0);
+        o.stride_h          = opts.GetScalar<int32_t>(2, 0);
+        o.filter_w          = opts.GetScalar<int32_t>(3, 0);
+        o.filter_h          = opts.GetScalar<int32_t>(4, 0);
+        o.activation        = opts.GetScalar<int8_t>(5, ACTIVATION_NONE);
+        break;
+    case BUILTIN_FULLY_CONNECTED:
+        o.activation        = opts.GetScalar<int8_t>(0, ACTIVATION_NONE);
+        o.weights_format    = opts.GetScalar<int8_t>(1, 0);
+        o.keep_num_dims     = opts.GetScalar<uint8_t>(2, 0) != 0;
+        break;
+    case BUILTIN_SOFTMAX:
+        o.beta              = opts.GetScalar<float>(0, 0.0f);
+        break;
+    case BUILTIN_CONCATENATION:
+        o.axis              = opts.GetScalar<int32_t>(0, 0);
+        o.activation        = opts.GetScalar<int8_t>(1, ACTIVATION_NONE);
+        break;
+    case BUILTIN_LEAKY_RELU:
+        o.alpha             = opts.GetScalar<float>(0, 0.0f);
+        break;
+    default:
+        break;
+    }
+}
+
+void ReadTfLiteBuffer(std::vector<uint8_t> &&bytes, FileModel &model) {
+    model.bytes = std::move(bytes);
+    const uint8_t *buf = model.bytes.data();
+    const size_t size = model.bytes.size();
+    if (size < 8) {
+        throw std::runtime_error("Model file is too small");
+    }
+    uint32_t root;
+    memcpy(&root, buf, sizeof(root));
+    const FlatTable m(buf, size, root);
+
+    std::vector<int> codes;
+    for (auto &c: m.GetTables(schema::MODEL_OPERATOR_CODES)) {
+        // newer files keep codes past 127 in a separate field
+        const int deprecated_code = c.GetScalar<int8_t>(schema::OPCODE_DEPRECATED_BUILTIN_CODE, 0);
+        const int code = c.GetScalar<int32_t>(schema::OPCODE_BUILTIN_CODE, 0);
+        codes.push_back(std::max(deprecated_code, code));
+    }
+
+    const auto buffers = m.GetTables(schema::MODEL_BUFFERS);
+    const auto subgraphs = m.GetTables(schema::MODEL_SUBGRAPHS);
+    if (subgraphs.size() != 1) {
+        throw std::runtime_error(fmt::format("Model has {} subgraphs, expected 1", subgraphs.size()));
+    }
+    const FlatTable &sg = subgraphs[0];
+
+    for (auto &t: sg.GetTables(schema::SUBGRAPH_TENSORS)) {
+        FileTensor tensor;
+        tensor.name = t.GetString(schema::TENSOR_NAME);
+        tensor.shape = t.GetScalars<int32_t>(schema::TENSOR_SHAPE);
+        tensor.type = t.GetScalar<int8_t>(schema::TENSOR_TYPE, ELEMENT_FLOAT32);
+
+        const uint32_t buffer_index = t.GetScalar<uint32_t>(schema::TENSOR_BUFFER, 0);
+        if (buffer_index >= buffers.size()) {
+            throw std::runtime_error(fmt::format("Tensor {} has no buffer {}", tensor.name, buffer_index));
+        }
+        const FlatTable &b = buffers[buffer_index];
+        uint32_t count;
+        const size_t start = b.GetVector(schema::BUFFER_DATA, 1, count);
+        if (count > 0) {
+            tensor.data = buf + start;
+            tensor.data_size = count;
+        } else if (b.HasField(schema::BUFFER_OFFSET)) {
+            // large models keep their buffers after the flatbuffer
+            const uint64_t offset = b.GetScalar<uint64_t>(schema::BUFFER_OFFSET, 0);
+            const uint64_t length = b.GetScalar<uint64_t>(schema::BUFFER_SIZE, 0);
+            if ((offset > size) || (length > (size-offset))) {
+                throw std::runtime_error(fmt::format("Tensor {} has data outside of the file", tensor.name));
+            }
+            if (length > 0) {
+                tensor.data = buf + offset;
+                tensor.data_size = static_cast<size_t>(length);
+            }
+        }
+
+        if (t.HasField(schema::TENSOR_QUANTIZATION)) {
+            const FlatTable q = t.GetTable(schema::TENSOR_QUANTIZATION);
+            tensor.scales = q.GetScalars<float>(schema::QUANTIZATION_SCALE);
+            tensor.zero_points = q.GetScalars<int64_t>(schema::QUANTIZATION_ZERO_POINT);
+            tensor.quantized_dimension = q.GetScalar<int32_t>(schema::QUANTIZATION_DIMENSION, 0);
+        }
+        model.tensors.push_back(std::move(tensor));
+    }
+
+    const int total_tensors = static_cast<int>(model.tensors.size());
+    const auto CheckTensors = [total_tensors](const std::vector<int> &ids, const bool is_optional) {
+        for (const int id: ids) {
+            if ((id >= total_tensors) || (id < (is_optional ? -1 : 0))) {
+                throw std::runtime_error(fmt::format("Model refers to a missing tensor {}", id));
+            }
+        }
+    };
+
+    model.inputs = sg.GetScalars<int32_t>(schema::SUBGRAPH_INPUTS);
+    model.outputs = sg.GetScalars<int32_t>(schema::SUBGRAPH_OUTPUTS);
+    CheckTensors(model.inputs, false);
+    CheckTensors(model.outputs, false);
+
+    for (auto &op: sg.GetTables(schema::SUBGRAPH_OPERATORS)) {
+        FileOperator o;
+        const uint32_t code_index = op.GetScalar<uint32_t>(schema::OPERATOR_OPCODE_INDEX, 0);
+        if (code_index >= codes.size()) {
+            throw std::runtime_error(fmt::format("Operator has no code {}", code_index));
+        }
+        o.code = codes[code_index];
+        o.inputs = op.GetScalars<int32_t>(schema::OPERATOR_INPUTS);
+        o.outputs = op.GetScalars<int32_t>(schema::OPERATOR_OUTPUTS);
+        CheckTensors(o.inputs, true);
+        CheckTensors(o.outputs, false);
+        ReadOptions(op, o);
+        model.operators.push_back(std::move(o));
+    }
+}
+
+FileModel ReadTfLiteFile(const char *filepath) {
+    std::ifstream fp;
+    fp.open(filepath, std::ios::binary);
+    if (!fp.is_open()) {
+        throw std::runtime_error(fmt::format("Failed to load model from {}", filepath));
+    }
+    std::stringstream ss;
+    ss << fp.rdbuf();
+    fp.close();
+    const auto &s = ss.str();
+
+    FileModel model;
+    ReadTfLiteBuffer(std::vector<uint8_t>(s.begin(), s.end()), model);
+    return model;
+}
+
+}
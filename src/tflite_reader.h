@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace tiny_cnn {
+
+// builtin operator codes of the tflite schema
+enum BuiltinOperator {
+    BUILTIN_AVERAGE_POOL_2D     = 1,
+    BUILTIN_CONCATENATION       = 2,
+    BUILTIN_CONV_2D             = 3,
+    BUILTIN_DEPTHWISE_CONV_2D   = 4,
+    BUILTIN_FULLY_CONNECTED     = 9,
+    BUILTIN_MAX_POOL_2D         = 17,
+    BUILTIN_RELU                = 19,
+    BUILTIN_RELU6               = 21,
+    BUILTIN_RESHAPE             = 22,
+    BUILTIN_SOFTMAX             = 25,
+    BUILTIN_LEAKY_RELU          = 98
+};
+
+// element types of the tflite schema
+enum ElementType {
+    ELEMENT_FLOAT32 = 0,
+    ELEMENT_FLOAT16 = 1,
+    ELEMENT_INT32   = 2,
+    ELEMENT_UINT8   = 3,
+    ELEMENT_INT64   = 4,
+    ELEMENT_INT8    = 9
+};
+
+enum Padding {
+    PADDING_SAME = 0, PADDING_VALID = 1
+};
+
+// fused activations of the tflite schema
+enum Activation {
+    ACTIVATION_NONE = 0, ACTIVATION_RELU = 1, ACTIVATION_RELU_N1_TO_1 = 2, ACTIVATION_RELU6 = 3
+};
+
+struct FileTensor {
+    std::string name;
+    std::vector<int> shape;
+    int type;
+    // constant data inside the file, which is null for activations
+    const uint8_t *data = nullptr;
+    size_t data_size = 0;
+    // quantization, with a scale per slice of quantized_dimension or a single scale
+    std::vector<float> scales;
+    std::vector<int64_t> zero_points;
+    int quantized_dimension = 0;
+};
+
+// operator and its builtin options, where only the options of its code are set
+struct FileOperator {
+    int code;
+    // optional inputs are -1
+    std::vector<int> inputs;
+    std::vector<int> outputs;
+    int padding = PADDING_VALID;
+    int stride_w = 1;
+    int stride_h = 1;
+    int dilation_w = 1;
+    int dilation_h = 1;
+    int filter_w = 1;
+    int filter_h = 1;
+    int depth_multiplier = 1;
+    int activation = ACTIVATION_NONE;
+    int weights_format = 0;
+    bool keep_num_dims = false;
+    int axis = 0;
+    float alpha = 0.0f;
+    float beta = 1.0f;
+};
+
+// first subgraph of a tflite model
+struct FileModel {
+    std::vector<uint8_t> bytes;
+    std::vector<FileTensor> tensors;
+    std::vector<FileOperator> operators;
+    std::vector<int> inputs;
+    std::vector<int> outputs;
+};
+
+// minimal reader of the tflite flatbuffer, which only reads what the engine runs
+// throws if the file is malformed
+FileModel ReadTfLiteFile(const char *filepath);
+void ReadTfLiteBuffer(std::vector<uint8_t> &&bytes, FileModel &model);
+
+}
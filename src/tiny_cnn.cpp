@@ -0,0 +1,835 @@
+#include "tiny_cnn.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define TINY_CNN_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tiny_cnn {
+
+static const char *GetLayerName(const LayerType type) {
+    switch (type) {
+    case LAYER_CONV:            return "conv";
+    case LAYER_DEPTHWISE_CONV:  return "depthwise_conv";
+    case LAYER_MAX_POOL:        return "max_pool";
+    case LAYER_AVERAGE_POOL:    return "average_pool";
+    case LAYER_FULLY_CONNECTED: return "fully_connected";
+    case LAYER_ACTIVATION:      return "activation";
+    case LAYER_SOFTMAX:         return "softmax";
+    case LAYER_CONCATENATION:   return "concatenation";
+    case LAYER_RESHAPE:         return "reshape";
+    default:                    return "unknown";
+    }
+}
+
+static int GetTotalBlocks(const int channels) {
+    return (channels + CHANNEL_BLOCK - 1) / CHANNEL_BLOCK;
+}
+
+// kernels
+
+// acc[0..CHANNEL_BLOCK) += x[r*row_stride + i] * w[r*n + i][0..CHANNEL_BLOCK) for every row r and i < n
+// so a window of the input is accumulated without leaving the registers
+static inline void AccumulateWindow(const float *x, const int row_stride, const int rows, const int n, const float *w, float *acc) {
+    static_assert(CHANNEL_BLOCK == 16, "Kernels keep a block in four registers");
+#ifdef TINY_CNN_SSE2
+    __m128 a0 = _mm_loadu_ps(acc);
+    __m128 a1 = _mm_loadu_ps(acc+4);
+    __m128 a2 = _mm_loadu_ps(acc+8);
+    __m128 a3 = _mm_loadu_ps(acc+12);
+    for (int r = 0; r < rows; r++, x += row_stride) {
+        for (int i = 0; i < n; i++, w += CHANNEL_BLOCK) {
+            const __m128 v = _mm_set1_ps(x[i]);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(v, _mm_loadu_ps(w)));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(v, _mm_loadu_ps(w+4)));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(v, _mm_loadu_ps(w+8)));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(v, _mm_loadu_ps(w+12)));
+        }
+    }
+    _mm_storeu_ps(acc, a0);
+    _mm_storeu_ps(acc+4, a1);
+    _mm_storeu_ps(acc+8, a2);
+    _mm_storeu_ps(acc+12, a3);
+#else
+    for (int r = 0; r < rows; r++, x += row_stride) {
+        for (int i = 0; i < n; i++, w += CHANNEL_BLOCK) {
+            for (int j = 0; j < CHANNEL_BLOCK; j++) {
+                acc[j] += x[i] * w[j];
+            }
+        }
+    }
+#endif
+}
+
+// same as AccumulateWindow for two output pixels whose windows are pixel_step apart
+// each weight is loaded once for both, and the eight accumulators hide the latency of the adds
+static inline void AccumulateWindowPair(const float *x, const int pixel_step, const int row_stride, const int rows, const int n, const float *w, float *acc) {
+#ifdef TINY_CNN_SSE2
+    __m128 a0 = _mm_loadu_ps(acc);
+    __m128 a1 = _mm_loadu_ps(acc+4);
+    __m128 a2 = _mm_loadu_ps(acc+8);
+    __m128 a3 = _mm_loadu_ps(acc+12);
+    __m128 b0 = _mm_loadu_ps(acc+16);
+    __m128 b1 = _mm_loadu_ps(acc+20);
+    __m128 b2 = _mm_loadu_ps(acc+24);
+    __m128 b3 = _mm_loadu_ps(acc+28);
+    for (int r = 0; r < rows; r++, x += row_stride) {
+        const float *y = x + pixel_step;
+        for (int i = 0; i < n; i++, w += CHANNEL_BLOCK) {
+            const __m128 u = _mm_set1_ps(x[i]);
+            const __m128 v = _mm_set1_ps(y[i]);
+            const __m128 w0 = _mm_loadu_ps(w);
+            const __m128 w1 = _mm_loadu_ps(w+4);
+            const __m128 w2 = _mm_loadu_ps(w+8);
+            const __m128 w3 = _mm_loadu_ps(w+12);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(u, w0));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(u, w1));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(u, w2));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(u, w3));
+            b0 = _mm_add_ps(b0, _mm_mul_ps(v, w0));
+            b1 = _mm_add_ps(b1, _mm_mul_ps(v, w1));
+            b2 = _mm_add_ps(b2, _mm_mul_ps(v, w2));
+            b3 = _mm_add_ps(b3, _mm_mul_ps(v, w3));
+        }
+    }
+    _mm_storeu_ps(acc, a0);
+    _mm_storeu_ps(acc+4, a1);
+    _mm_storeu_ps(acc+8, a2);
+    _mm_storeu_ps(acc+12, a3);
+    _mm_storeu_ps(acc+16, b0);
+    _mm_storeu_ps(acc+20, b1);
+    _mm_storeu_ps(acc+24, b2);
+    _mm_storeu_ps(acc+28, b3);
+#else
+    AccumulateWindow(x, row_stride, rows, n, w, acc);
+    AccumulateWindow(x + pixel_step, row_stride, rows, n, w, acc + CHANNEL_BLOCK);
+#endif
+}
+
+// y[i] += a[i]*b[i]
+static inline void MultiplyAdd(float *y, const float *a, const float *b, const int n) {
+    int i = 0;
+#ifdef TINY_CNN_SSE2
+    for (; i+4 <= n; i += 4) {
+        const __m128 v = _mm_add_ps(_mm_loadu_ps(y+i), _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+        _mm_storeu_ps(y+i, v);
+    }
+#endif
+    for (; i < n; i++) {
+        y[i] += a[i]*b[i];
+    }
+}
+
+// y[i] = max(y[i], a[i])
+static inline void MaxInto(float *y, const float *a, const int n) {
+    int i = 0;
+#ifdef TINY_CNN_SSE2
+    for (; i+4 <= n; i += 4) {
+        _mm_storeu_ps(y+i, _mm_max_ps(_mm_loadu_ps(y+i), _mm_loadu_ps(a+i)));
+    }
+#endif
+    for (; i < n; i++) {
+        y[i] = std::max(y[i], a[i]);
+    }
+}
+
+static inline void AddInto(float *y, const float *a, const int n) {
+    int i = 0;
+#ifdef TINY_CNN_SSE2
+    for (; i+4 <= n; i += 4) {
+        _mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i), _mm_loadu_ps(a+i)));
+    }
+#endif
+    for (; i < n; i++) {
+        y[i] += a[i];
+    }
+}
+
+static inline void Activate(float *y, const int n, const LayerActivation activation, const float alpha) {
+    switch (activation) {
+    case LAYER_ACTIVATION_RELU:
+        for (int i = 0; i < n; i++) y[i] = std::max(y[i], 0.0f);
+        break;
+    case LAYER_ACTIVATION_RELU6:
+        for (int i = 0; i < n; i++) y[i] = std::clamp(y[i], 0.0f, 6.0f);
+        break;
+    case LAYER_ACTIVATION_RELU_N1_TO_1:
+        for (int i = 0; i < n; i++) y[i] = std::clamp(y[i], -1.0f, 1.0f);
+        break;
+    case LAYER_ACTIVATION_LEAKY_RELU:
+        {
+            // without branches, since the signs are as good as random
+            int i = 0;
+#ifdef TINY_CNN_SSE2
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 slope = _mm_set1_ps(alpha);
+            for (; i+4 <= n; i += 4) {
+                const __m128 v = _mm_loadu_ps(y+i);
+                _mm_storeu_ps(y+i, _mm_add_ps(_mm_max_ps(v, zero), _mm_mul_ps(slope, _mm_min_ps(v, zero))));
+            }
+#endif
+            for (; i < n; i++) {
+                y[i] = std::max(y[i], 0.0f) + alpha*std::min(y[i], 0.0f);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void RunConv(const Layer &l, const Shape &in, const Shape &out, const float *x, float *y) {
+    const int C = in.channels;
+    const int row_stride = in.width*C;
+    const int tap_size = C*CHANNEL_BLOCK;
+    const int block_size = l.kernel_height*l.kernel_width*tap_size;
+    const int total_blocks = GetTotalBlocks(out.channels);
+    float acc[2*CHANNEL_BLOCK];
+
+    const auto Store = [&l, &out](float *src, float *dst, const int b) {
+        const int total = std::min(CHANNEL_BLOCK, out.channels - b*CHANNEL_BLOCK);
+        Activate(src, total, l.activation, l.alpha);
+        memcpy(dst + b*CHANNEL_BLOCK, src, total*sizeof(float));
+    };
+
+    for (int oy = 0; oy < out.height; oy++) {
+        const int iy0 = oy*l.stride_y - l.pad_top;
+        const bool is_inside_y = (iy0 >= 0) && ((iy0 + l.kernel_height) <= in.height);
+        for (int ox = 0; ox < out.width;) {
+            const int ix0 = ox*l.stride_x - l.pad_left;
+            // windows which don't hang over an edge are read as whole rows of the input
+            const bool is_inside = is_inside_y && (ix0 >= 0) && ((ix0 + l.kernel_width) <= in.width);
+            const bool is_pair = is_inside && ((ox+1) < out.width) && ((ix0 + l.stride_x + l.kernel_width) <= in.width);
+            const float *src = x + (iy0*in.width + ix0)*C;
+            float *dst = y + (oy*out.width + ox)*out.channels;
+
+            for (int b = 0; b < total_blocks; b++) {
+                const float *bias = &l.bias[b*CHANNEL_BLOCK];
+                const float *wb = &l.weights[b*block_size];
+                memcpy(acc, bias, CHANNEL_BLOCK*sizeof(float));
+                if (is_pair) {
+                    memcpy(acc + CHANNEL_BLOCK, bias, CHANNEL_BLOCK*sizeof(float));
+                    AccumulateWindowPair(src, l.stride_x*C, row_stride, l.kernel_height, l.kernel_width*C, wb, acc);
+                    Store(acc, dst, b);
+                    Store(acc + CHANNEL_BLOCK, dst + out.channels, b);
+                    continue;
+                }
+                if (is_inside) {
+                    AccumulateWindow(src, row_stride, l.kernel_height, l.kernel_width*C, wb, acc);
+                    Store(acc, dst, b);
+                    continue;
+                }
+                // taps which fall in the padding are skipped
+                for (int ky = 0; ky < l.kernel_height; ky++) {
+                    const int iy = iy0 + ky;
+                    if ((iy < 0) || (iy >= in.height)) {
+                        continue;
+                    }
+                    for (int kx = 0; kx < l.kernel_width; kx++) {
+                        const int ix = ix0 + kx;
+                        if ((ix >= 0) && (ix < in.width)) {
+                            AccumulateWindow(x + iy*row_stride + ix*C, 0, 1, C, wb + (ky*l.kernel_width + kx)*tap_size, acc);
+                        }
+                    }
+                }
+                Store(acc, dst, b);
+            }
+            ox += is_pair ? 2 : 1;
+        }
+    }
+}
+
+static void RunDepthwiseConv(const Layer &l, const Shape &in, const Shape &out, const float *x, float *y) {
+    const int C = in.channels;
+    for (int oy = 0; oy < out.height; oy++) {
+        const int iy0 = oy*l.stride_y - l.pad_top;
+        for (int ox = 0; ox < out.width; ox++) {
+            const int ix0 = ox*l.stride_x - l.pad_left;
+            float *dst = y + (oy*out.width + ox)*C;
+            memcpy(dst, l.bias.data(), C*sizeof(float));
+            for (int ky = 0; ky < l.kernel_height; ky++) {
+                const int iy = iy0 + ky;
+                if ((iy < 0) || (iy >= in.height)) {
+                    continue;
+                }
+                for (int kx = 0; kx < l.kernel_width; kx++) {
+                    const int ix = ix0 + kx;
+                    if ((ix < 0) || (ix >= in.width)) {
+                        continue;
+                    }
+                    MultiplyAdd(dst, x + (iy*in.width + ix)*C, &l.weights[(ky*l.kernel_width + kx)*C], C);
+                }
+            }
+            Activate(dst, C, l.activation, l.alpha);
+        }
+    }
+}
+
+static void RunPool(const Layer &l, const Shape &in, const Shape &out, const float *x, float *y) {
+    const int C = in.channels;
+    const bool is_max = l.type == LAYER_MAX_POOL;
+    for (int oy = 0; oy < out.height; oy++) {
+        const int iy0 = oy*l.stride_y - l.pad_top;
+        for (int ox = 0; ox < out.width; ox++) {
+            const int ix0 = ox*l.stride_x - l.pad_left;
+            float *dst = y + (oy*out.width + ox)*C;
+            std::fill(dst, dst+C, is_max ? -std::numeric_limits<float>::infinity() : 0.0f);
+            int total = 0;
+            for (int ky = 0; ky < l.kernel_height; ky++) {
+                const int iy = iy0 + ky;
+                if ((iy < 0) || (iy >= in.height)) {
+                    continue;
+                }
+                for (int kx = 0; kx < l.kernel_width; kx++) {
+                    const int ix = ix0 + kx;
+                    if ((ix < 0) || (ix >= in.width)) {
+                        continue;
+                    }
+                    const float *src = x + (iy*in.width + ix)*C;
+                    if (is_max) {
+                        MaxInto(dst, src, C);
+                    } else {
+                        AddInto(dst, src, C);
+                    }
+                    total++;
+                }
+            }
+            // padding isn't counted in the average
+            if (!is_max && (total > 0)) {
+                for (int c = 0; c < C; c++) {
+                    dst[c] /= (float)total;
+                }
+            }
+            Activate(dst, C, l.activation, l.alpha);
+        }
+    }
+}
+
+static void RunFullyConnected(const Layer &l, const Shape &in, const Shape &out, const float *x, float *y) {
+    const int K = in.GetSize();
+    const int N = out.channels;
+    float acc[CHANNEL_BLOCK];
+    for (int b = 0; b < GetTotalBlocks(N); b++) {
+        memcpy(acc, &l.bias[b*CHANNEL_BLOCK], sizeof(acc));
+        AccumulateWindow(x, 0, 1, K, &l.weights[b*K*CHANNEL_BLOCK], acc);
+        const int total = std::min(CHANNEL_BLOCK, N - b*CHANNEL_BLOCK);
+        Activate(acc, total, l.activation, l.alpha);
+        memcpy(y + b*CHANNEL_BLOCK, acc, total*sizeof(float));
+    }
+}
+
+static void RunSoftmax(const Layer &l, const Shape &in, const float *x, float *y) {
+    const int C = in.channels;
+    for (int p = 0; p < in.height*in.width; p++) {
+        const float *src = x + p*C;
+        float *dst = y + p*C;
+        const float max_val = *std::max_element(src, src+C);
+        float total = 0.0f;
+        for (int c = 0; c < C; c++) {
+            dst[c] = expf(l.beta*(src[c] - max_val));
+            total += dst[c];
+        }
+        for (int c = 0; c < C; c++) {
+            dst[c] /= total;
+        }
+    }
+}
+
+void RunNetwork(const Network &network, const float *input, float *output, const int batch_size, float *scratch) {
+    const int input_size = network.shapes[network.input].GetSize();
+    const int output_size = network.shapes[network.output].GetSize();
+
+    // every layer of a crop runs before the next crop, so its tensors stay in cache
+    for (int n = 0; n < batch_size; n++) {
+        const float *x = input + n*input_size;
+        float *y = output + n*output_size;
+        const auto GetTensor = [&](const int id) -> float* {
+            if (id == network.input) return const_cast<float*>(x);
+            if (id == network.output) return y;
+            return scratch + network.offsets[id];
+        };
+
+        for (auto &l: network.layers) {
+            const Shape &in = network.shapes[l.inputs[0]];
+            const Shape &out = network.shapes[l.output];
+            const float *src = GetTensor(l.inputs[0]);
+            float *dst = GetTensor(l.output);
+            switch (l.type) {
+            case LAYER_CONV:
+                RunConv(l, in, out, src, dst);
+                break;
+            case LAYER_DEPTHWISE_CONV:
+                RunDepthwiseConv(l, in, out, src, dst);
+                break;
+            case LAYER_MAX_POOL:
+            case LAYER_AVERAGE_POOL:
+                RunPool(l, in, out, src, dst);
+                break;
+            case LAYER_FULLY_CONNECTED:
+                RunFullyConnected(l, in, out, src, dst);
+                break;
+            case LAYER_ACTIVATION:
+                if (dst != src) {
+                    memcpy(dst, src, in.GetSize()*sizeof(float));
+                }
+                Activate(dst, in.GetSize(), l.activation, l.alpha);
+                break;
+            case LAYER_SOFTMAX:
+                RunSoftmax(l, in, src, dst);
+                break;
+            case LAYER_CONCATENATION:
+                {
+                    // joined along the channels of each pixel
+                    int offset = 0;
+                    for (const int id: l.inputs) {
+                        const Shape &s = network.shapes[id];
+                        const float *part = GetTensor(id);
+                        for (int p = 0; p < s.height*s.width; p++) {
+                            memcpy(dst + p*out.channels + offset, part + p*s.channels, s.channels*sizeof(float));
+                        }
+                        offset += s.channels;
+                    }
+                    Activate(dst, out.GetSize(), l.activation, l.alpha);
+                }
+                break;
+            case LAYER_RESHAPE:
+                memcpy(dst, src, in.GetSize()*sizeof(float));
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+// loading
+
+static std::vector<float> ReadConstant(const FileTensor &t) {
+    size_t count = 1;
+    for (const int d: t.shape) {
+        count *= static_cast<size_t>(d);
+    }
+    if (t.data == nullptr) {
+        throw std::runtime_error(fmt::format("Tensor {} was expected to be a constant", t.name));
+    }
+
+    std::vector<float> values(count);
+    if (t.type == ELEMENT_FLOAT32) {
+        if (t.data_size != count*sizeof(float)) {
+            throw std::runtime_error(fmt::format("Tensor {} has {} bytes, expected {}", t.name, t.data_size, count*sizeof(float)));
+        }
+        memcpy(values.data(), t.data, t.data_size);
+        return values;
+    }
+    if ((t.type != ELEMENT_INT8) && (t.type != ELEMENT_UINT8)) {
+        throw std::runtime_error(fmt::format("Tensor {} has unsupported type {}", t.name, t.type));
+    }
+    if (t.data_size != count) {
+        throw std::runtime_error(fmt::format("Tensor {} has {} bytes, expected {}", t.name, t.data_size, count));
+    }
+    if (t.scales.empty()) {
+        throw std::runtime_error(fmt::format("Tensor {} is quantized without a scale", t.name));
+    }
+
+    // weights which are quantized per channel have a scale per slice of the quantized dimension
+    size_t inner = 1;
+    size_t total_slices = 1;
+    if (t.scales.size() > 1) {
+        const int dim = t.quantized_dimension;
+        if ((dim < 0) || (dim >= static_cast<int>(t.shape.size())) || (t.scales.size() != static_cast<size_t>(t.shape[dim]))) {
+            throw std::runtime_error(fmt::format("Tensor {} has {} scales which don't match its shape", t.name, t.scales.size()));
+        }
+        total_slices = t.scales.size();
+        for (size_t i = dim+1; i < t.shape.size(); i++) {
+            inner *= static_cast<size_t>(t.shape[i]);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        const size_t slice = (i / inner) % total_slices;
+        const float scale = t.scales[slice];
+        const int64_t zero_point = (slice < t.zero_points.size()) ? t.zero_points[slice] : 0;
+        const int q = (t.type == ELEMENT_INT8) ? (int)((const int8_t*)t.data)[i] : (int)t.data[i];
+        values[i] = scale * (float)(q - zero_point);
+    }
+    return values;
+}
+
+static Shape ReadShape(const FileTensor &t) {
+    const auto &s = t.shape;
+    if ((s.size() == 4) && (s[0] == 1)) {
+        return {s[1], s[2], s[3]};
+    }
+    if ((s.size() == 2) && (s[0] == 1)) {
+        return {1, 1, s[1]};
+    }
+    throw std::runtime_error(fmt::format(
+        "Tensor {} has a shape of {} dimensions, expected (1,h,w,c) or (1,n)", t.name, s.size()));
+}
+
+static LayerActivation ReadActivation(const FileOperator &op) {
+    switch (op.activation) {
+    case ACTIVATION_NONE:           return LAYER_ACTIVATION_NONE;
+    case ACTIVATION_RELU:           return LAYER_ACTIVATION_RELU;
+    case ACTIVATION_RELU6:          return LAYER_ACTIVATION_RELU6;
+    case ACTIVATION_RELU_N1_TO_1:   return LAYER_ACTIVATION_RELU_N1_TO_1;
+    default:
+        throw std::runtime_error(fmt::format("Fused activation {} isn't supported", op.activation));
+    }
+}
+
+// windows of convolutions and pooling, where same padding puts the extra row or column at the end
+static void SetWindow(Layer &l, const FileOperator &op, const Shape &in, const Shape &out) {
+    if ((op.stride_w <= 0) || (op.stride_h <= 0) || (op.dilation_w != 1) || (op.dilation_h != 1)) {
+        throw std::runtime_error(fmt::format(
+            "Window with stride ({},{}) and dilation ({},{}) isn't supported",
+            op.stride_w, op.stride_h, op.dilation_w, op.dilation_h));
+    }
+    l.stride_x = op.stride_w;
+    l.stride_y = op.stride_h;
+    int width, height;
+    if (op.padding == PADDING_VALID) {
+        width = (in.width - l.kernel_width) / l.stride_x + 1;
+        height = (in.height - l.kernel_height) / l.stride_y + 1;
+        l.pad_left = 0;
+        l.pad_top = 0;
+    } else {
+        width = (in.width + l.stride_x - 1) / l.stride_x;
+        height = (in.height + l.stride_y - 1) / l.stride_y;
+        l.pad_left = std::max((width-1)*l.stride_x + l.kernel_width - in.width, 0) / 2;
+        l.pad_top = std::max((height-1)*l.stride_y + l.kernel_height - in.height, 0) / 2;
+    }
+    if ((width != out.width) || (height != out.height)) {
+        throw std::runtime_error(fmt::format(
+            "Window gives an output of ({},{}), but the model expects ({},{})",
+            width, height, out.width, out.height));
+    }
+}
+
+static std::vector<float> ReadBias(const FileModel &model, const FileOperator &op, const int index, const int size) {
+    std::vector<float> bias(size, 0.0f);
+    if ((static_cast<int>(op.inputs.size()) > index) && (op.inputs[index] >= 0)) {
+        const auto values = ReadConstant(model.tensors[op.inputs[index]]);
+        if (static_cast<int>(values.size()) > size) {
+            throw std::runtime_error("Bias is larger than the output");
+        }
+        std::copy(values.begin(), values.end(), bias.begin());
+    }
+    return bias;
+}
+
+static Layer CreateLayer(const FileModel &model, const FileOperator &op, const std::vector<Shape> &shapes) {
+    const auto &tensors = model.tensors;
+    if (op.inputs.empty() || (op.inputs[0] < 0) || (op.outputs.size() != 1)) {
+        throw std::runtime_error(fmt::format("Operator {} has unexpected inputs or outputs", op.code));
+    }
+    Layer l;
+    l.output = op.outputs[0];
+    l.inputs.push_back(op.inputs[0]);
+    const Shape &in = shapes[op.inputs[0]];
+    const Shape &out = shapes[l.output];
+
+    switch (op.code) {
+    case BUILTIN_CONV_2D:
+        {
+            l.type = LAYER_CONV;
+            const FileTensor &w = tensors.at(op.inputs.at(1));
+            if ((w.shape.size() != 4) || (w.shape[0] != out.channels) || (w.shape[3] != in.channels)) {
+                throw std::runtime_error(fmt::format("Convolution {} has unexpected weights", w.name));
+            }
+            l.kernel_height = w.shape[1];
+            l.kernel_width = w.shape[2];
+            SetWindow(l, op, in, out);
+            l.activation = ReadActivation(op);
+
+            // [oc][ky][kx][ic] to [block][ky][kx][ic][oc of the block]
+            const auto values = ReadConstant(w);
+            const int taps = l.kernel_height*l.kernel_width*in.channels;
+            const int total_blocks = GetTotalBlocks(out.channels);
+            l.weights.assign(total_blocks*taps*CHANNEL_BLOCK, 0.0f);
+            for (int oc = 0; oc < out.channels; oc++) {
+                const int b = oc / CHANNEL_BLOCK;
+                const int j = oc % CHANNEL_BLOCK;
+                for (int t = 0; t < taps; t++) {
+                    l.weights[(b*taps + t)*CHANNEL_BLOCK + j] = values[oc*taps + t];
+                }
+            }
+            l.bias = ReadBias(model, op, 2, total_blocks*CHANNEL_BLOCK);
+        }
+        break;
+    case BUILTIN_DEPTHWISE_CONV_2D:
+        {
+            l.type = LAYER_DEPTHWISE_CONV;
+            const FileTensor &w = tensors.at(op.inputs.at(1));
+            if ((op.depth_multiplier > 1) || (out.channels != in.channels)) {
+                throw std::runtime_error("Depthwise convolution with a depth multiplier isn't supported");
+            }
+            if ((w.shape.size() != 4) || (w.shape[0] != 1) || (w.shape[3] != in.channels)) {
+                throw std::runtime_error(fmt::format("Depthwise convolution {} has unexpected weights", w.name));
+            }
+            l.kernel_height = w.shape[1];
+            l.kernel_width = w.shape[2];
+            SetWindow(l, op, in, out);
+            l.activation = ReadActivation(op);
+            // [1][ky][kx][c] is already the order of the kernel
+            l.weights = ReadConstant(w);
+            l.bias = ReadBias(model, op, 2, in.channels);
+        }
+        break;
+    case BUILTIN_MAX_POOL_2D:
+    case BUILTIN_AVERAGE_POOL_2D:
+        l.type = (op.code == BUILTIN_MAX_POOL_2D) ? LAYER_MAX_POOL : LAYER_AVERAGE_POOL;
+        l.kernel_width = op.filter_w;
+        l.kernel_height = op.filter_h;
+        if ((l.kernel_width <= 0) || (l.kernel_height <= 0) || (out.channels != in.channels)) {
+            throw std::runtime_error("Pooling has an unexpected filter");
+        }
+        SetWindow(l, op, in, out);
+        l.activation = ReadActivation(op);
+        break;
+    case BUILTIN_FULLY_CONNECTED:
+        {
+            l.type = LAYER_FULLY_CONNECTED;
+            const FileTensor &w = tensors.at(op.inputs.at(1));
+            const int K = in.GetSize();
+            if ((op.weights_format != 0) || (w.shape.size() != 2) || (w.shape[0] != out.channels) || (w.shape[1] != K)) {
+                throw std::runtime_error(fmt::format("Fully connected layer {} has unexpected weights", w.name));
+            }
+            if (out.GetSize() != out.channels) {
+                throw std::runtime_error("Fully connected layer which keeps its dimensions isn't supported");
+            }
+            l.activation = ReadActivation(op);
+
+            // [n][k] to [block][k][n of the block]
+            const auto values = ReadConstant(w);
+            const int total_blocks = GetTotalBlocks(out.channels);
+            l.weights.assign(total_blocks*K*CHANNEL_BLOCK, 0.0f);
+            for (int n = 0; n < out.channels; n++) {
+                const int b = n / CHANNEL_BLOCK;
+                const int j = n % CHANNEL_BLOCK;
+                for (int k = 0; k < K; k++) {
+                    l.weights[(b*K + k)*CHANNEL_BLOCK + j] = values[n*K + k];
+                }
+            }
+            l.bias = ReadBias(model, op, 2, total_blocks*CHANNEL_BLOCK);
+        }
+        break;
+    case BUILTIN_LEAKY_RELU:
+    case BUILTIN_RELU:
+    case BUILTIN_RELU6:
+        l.type = LAYER_ACTIVATION;
+        l.activation =
+            (op.code == BUILTIN_LEAKY_RELU) ? LAYER_ACTIVATION_LEAKY_RELU :
+            (op.code == BUILTIN_RELU) ? LAYER_ACTIVATION_RELU :
+            LAYER_ACTIVATION_RELU6;
+        l.alpha = op.alpha;
+        break;
+    case BUILTIN_SOFTMAX:
+        l.type = LAYER_SOFTMAX;
+        l.beta = op.beta;
+        break;
+    case BUILTIN_CONCATENATION:
+        {
+            l.type = LAYER_CONCATENATION;
+            const int rank = static_cast<int>(tensors[l.output].shape.size());
+            if ((op.axis != -1) && (op.axis != (rank-1))) {
+                throw std::runtime_error(fmt::format("Concatenation along axis {} isn't supported", op.axis));
+            }
+            l.inputs.clear();
+            int total_channels = 0;
+            for (const int id: op.inputs) {
+                const Shape &s = shapes[id];
+                if ((s.height != out.height) || (s.width != out.width)) {
+                    throw std::runtime_error("Concatenation of tensors with different sizes isn't supported");
+                }
+                total_channels += s.channels;
+                l.inputs.push_back(id);
+            }
+            if (total_channels != out.channels) {
+                throw std::runtime_error("Concatenation doesn't add up to its output");
+            }
+            l.activation = ReadActivation(op);
+        }
+        break;
+    case BUILTIN_RESHAPE:
+        l.type = LAYER_RESHAPE;
+        break;
+    default:
+        throw std::runtime_error(fmt::format("Operator {} isn't supported by the builtin engine", op.code));
+    }
+
+    const bool is_elementwise = (l.type == LAYER_ACTIVATION) || (l.type == LAYER_SOFTMAX) || (l.type == LAYER_RESHAPE);
+    if (is_elementwise && (out.GetSize() != in.GetSize())) {
+        throw std::runtime_error(fmt::format("{} changes the size of its input", GetLayerName(l.type)));
+    }
+    return l;
+}
+
+std::shared_ptr<const Network> CreateNetwork(const FileModel &model) {
+    if ((model.inputs.size() != 1) || (model.outputs.size() != 1)) {
+        throw std::runtime_error(fmt::format(
+            "Model has {} inputs and {} outputs, expected 1 and 1", model.inputs.size(), model.outputs.size()));
+    }
+
+    auto network = std::make_shared<Network>();
+    const int total_tensors = static_cast<int>(model.tensors.size());
+    network->input = model.inputs[0];
+    network->output = model.outputs[0];
+
+    // every tensor which isn't a constant is an activation, which must be float
+    std::vector<bool> is_activation(total_tensors, false);
+    is_activation[network->input] = true;
+    for (auto &op: model.operators) {
+        for (const int id: op.outputs) {
+            is_activation[id] = true;
+        }
+    }
+    network->shapes.assign(total_tensors, {0, 0, 0});
+    for (int i = 0; i < total_tensors; i++) {
+        if (!is_activation[i]) {
+            continue;
+        }
+        const FileTensor &t = model.tensors[i];
+        if (t.type != ELEMENT_FLOAT32) {
+            throw std::runtime_error(fmt::format(
+                "Tensor {} isn't float, only networks with float activations are supported", t.name));
+        }
+        network->shapes[i] = ReadShape(t);
+    }
+
+    for (auto &op: model.operators) {
+        for (const int id: op.inputs) {
+            if ((id >= 0) && !is_activation[id] && (model.tensors[id].data == nullptr)) {
+                throw std::runtime_error(fmt::format("Tensor {} is used before it is computed", model.tensors[id].name));
+            }
+        }
+        network->layers.push_back(CreateLayer(model, op, network->shapes));
+    }
+
+    // activations which directly follow a convolution or dense layer are applied when its outputs are stored
+    std::vector<int> total_uses(total_tensors, 0);
+    for (auto &l: network->layers) {
+        for (const int id: l.inputs) {
+            total_uses[id]++;
+        }
+    }
+    std::vector<Layer> layers;
+    for (auto &l: network->layers) {
+        const bool is_fusable =
+            (l.type == LAYER_ACTIVATION) && !layers.empty() &&
+            (layers.back().output == l.inputs[0]) &&
+            (total_uses[l.inputs[0]] == 1) && (l.inputs[0] != network->output) &&
+            (layers.back().activation == LAYER_ACTIVATION_NONE) &&
+            ((layers.back().type == LAYER_CONV) || (layers.back().type == LAYER_DEPTHWISE_CONV) || (layers.back().type == LAYER_FULLY_CONNECTED));
+        if (is_fusable) {
+            auto &prev = layers.back();
+            prev.activation = l.activation;
+            prev.alpha = l.alpha;
+            prev.output = l.output;
+        } else {
+            layers.push_back(std::move(l));
+        }
+    }
+    network->layers = std::move(layers);
+
+    bool is_output_computed = false;
+    network->offsets.assign(total_tensors, -1);
+    for (auto &l: network->layers) {
+        const int id = l.output;
+        is_output_computed = is_output_computed || (id == network->output);
+        if ((id != network->input) && (id != network->output) && (network->offsets[id] < 0)) {
+            network->offsets[id] = network->scratch_size;
+            // keep every tensor aligned to a cache line
+            network->scratch_size += (network->shapes[id].GetSize() + 15) & ~15;
+        }
+    }
+    if (!is_output_computed) {
+        throw std::runtime_error("Model output isn't computed by any operator");
+    }
+
+    const auto GetInfo = [&model](const int id) {
+        TensorInfo info;
+        info.type = TENSOR_FLOAT32;
+        info.dims = model.tensors[id].shape;
+        return info;
+    };
+    network->input_info = GetInfo(network->input);
+    network->output_info = GetInfo(network->output);
+    return network;
+}
+
+// session
+
+// tensors of a batch of crops, and the scratch for the intermediate tensors of one crop
+class Session: public ModelSession
+{
+private:
+    std::shared_ptr<const Network> m_network;
+    int m_batch_size;
+    std::vector<float> m_input;
+    std::vector<float> m_output;
+    std::vector<float> m_scratch;
+public:
+    Session(std::shared_ptr<const Network> network)
+    : m_network(network), m_batch_size(0)
+    {
+        m_scratch.resize(m_network->scratch_size);
+        Resize(1);
+    }
+
+    bool Resize(const int batch_size) override {
+        if (batch_size <= 0) {
+            return false;
+        }
+        m_batch_size = batch_size;
+        m_input.resize(batch_size*m_network->shapes[m_network->input].GetSize(), 0.0f);
+        m_output.resize(batch_size*m_network->shapes[m_network->output].GetSize(), 0.0f);
+        return true;
+    }
+
+    void *GetInputData() override { return m_input.data(); }
+    size_t GetInputBytes() const override { return m_input.size()*sizeof(float); }
+    const void *GetOutputData() const override { return m_output.data(); }
+    size_t GetOutputBytes() const override { return m_output.size()*sizeof(float); }
+
+    void Invoke() override {
+        RunNetwork(*m_network, m_input.data(), m_output.data(), m_batch_size, m_scratch.data());
+    }
+};
+
+Backend::Backend(const char *filepath)
+: m_filepath(filepath)
+{
+    const FileModel model = ReadTfLiteFile(filepath);
+    try {
+        m_network = CreateNetwork(model);
+    } catch (std::exception &ex) {
+        throw std::runtime_error(fmt::format("Failed to load {} with the builtin engine: {}", filepath, ex.what()));
+    }
+}
+
+std::unique_ptr<ModelSession> Backend::CreateSession() {
+    return std::make_unique<Session>(m_network);
+}
+
+void Backend::Print() const {
+    const auto &n = *m_network;
+    printf("%s: %d layers, %d floats of scratch per crop\n", m_filepath.c_str(), (int)n.layers.size(), n.scratch_size);
+    for (auto &l: n.layers) {
+        const Shape &in = n.shapes[l.inputs[0]];
+        const Shape &out = n.shapes[l.output];
+        printf("%s %dx%d (%d,%d,%d) -> (%d,%d,%d)\n",
+            GetLayerName(l.type), l.kernel_width, l.kernel_height,
+            in.height, in.width, in.channels, out.height, out.width, out.channels);
+    }
+}
+
+}
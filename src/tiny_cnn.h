@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "model_backend.h"
+#include "tflite_reader.h"
+
+// small inference engine for the convolutional networks of the recognizer
+// runs float networks of convolutions, pooling and dense layers read from a tflite file,
+// where int8 or uint8 weights are dequantized when the file is loaded
+namespace tiny_cnn {
+
+enum LayerType {
+    LAYER_CONV, LAYER_DEPTHWISE_CONV, LAYER_MAX_POOL, LAYER_AVERAGE_POOL,
+    LAYER_FULLY_CONNECTED, LAYER_ACTIVATION, LAYER_SOFTMAX, LAYER_CONCATENATION, LAYER_RESHAPE
+};
+
+enum LayerActivation {
+    LAYER_ACTIVATION_NONE, LAYER_ACTIVATION_RELU, LAYER_ACTIVATION_RELU6,
+    LAYER_ACTIVATION_RELU_N1_TO_1, LAYER_ACTIVATION_LEAKY_RELU
+};
+
+// per crop shape of a tensor, where dense tensors are 1x1xc
+struct Shape {
+    int height;
+    int width;
+    int channels;
+
+    int GetSize() const { return height*width*channels; }
+};
+
+// outputs of convolutions and dense layers are computed this many channels at a time
+constexpr int CHANNEL_BLOCK = 16;
+
+// a layer of the network with its weights packed for the kernels
+struct Layer {
+    LayerType type;
+    std::vector<int> inputs;
+    int output;
+    LayerActivation activation = LAYER_ACTIVATION_NONE;
+    float alpha = 0.0f;
+    int kernel_width = 1;
+    int kernel_height = 1;
+    int stride_x = 1;
+    int stride_y = 1;
+    int pad_left = 0;
+    int pad_top = 0;
+    float beta = 1.0f;
+    // convolutions are packed as [block][ky][kx][in_channel][CHANNEL_BLOCK]
+    // dense layers as [block][input][CHANNEL_BLOCK], and depthwise convolutions as [ky][kx][channel]
+    std::vector<float> weights;
+    // padded to whole blocks
+    std::vector<float> bias;
+};
+
+// layers in the order they run, and the shape and place of every tensor they use
+struct Network {
+    std::vector<Layer> layers;
+    std::vector<Shape> shapes;
+    // offset of each intermediate tensor in the scratch of a crop, or -1 for the input and output
+    std::vector<int> offsets;
+    int scratch_size = 0;
+    int input;
+    int output;
+    TensorInfo input_info;
+    TensorInfo output_info;
+};
+
+// builds the network, and throws if the model uses a layer or option which isn't supported
+std::shared_ptr<const Network> CreateNetwork(const FileModel &model);
+// runs a batch of crops, where input and output hold the tensors of every crop back to back
+void RunNetwork(const Network &network, const float *input, float *output, const int batch_size, float *scratch);
+
+class Backend: public ModelBackend
+{
+private:
+    std::shared_ptr<const Network> m_network;
+    std::string m_filepath;
+public:
+    Backend(const char *filepath);
+    const TensorInfo& GetInputInfo() const override { return m_network->input_info; }
+    const TensorInfo& GetOutputInfo() const override { return m_network->output_info; }
+    std::unique_ptr<ModelSession> CreateSession() override;
+    void Print() const override;
+};
+
+}
@@ -0,0 +1,264 @@
+#include "trace_planner.h"
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+namespace wordblitz {
+
+// knapsacks with more entries than this pick words by their points per second instead
+constexpr size_t MAX_KNAPSACK_ENTRIES = 1 << 24;
+
+// a word with all of its best paths
+struct PlanWord {
+    int value;
+    int length;
+    std::vector<int> paths;
+    // time spent on the word, including the expected travel to its start
+    float cost_ms;
+};
+
+static float GetDistance(const Cursor &a, const Cursor &b) {
+    const float dx = static_cast<float>(a.x - b.x);
+    const float dy = static_cast<float>(a.y - b.y);
+    return sqrtf(dx*dx + dy*dy);
+}
+
+std::vector<TraceResult> GetTraceCandidates(const std::vector<SearchResult> &searches) {
+    std::unordered_map<std::string, int> best_values;
+    for (auto &search: searches) {
+        auto it = best_values.find(search.word);
+        if (it == best_values.end()) {
+            best_values.insert({search.word, search.value});
+        } else {
+            it->second = std::max(it->second, search.value);
+        }
+    }
+
+    std::vector<TraceResult> candidates;
+    for (auto &search: searches) {
+        if (search.value != best_values.at(search.word)) {
+            continue;
+        }
+        candidates.push_back({search.path, search.word, search.value, TraceStatus::INCOMPLETE, search.confidence});
+    }
+    return candidates;
+}
+
+static std::vector<PlanWord> GetPlanWords(const std::vector<TraceResult> &candidates, const TracePlan &plan) {
+    std::vector<PlanWord> words;
+    std::unordered_map<std::string, int> lookup;
+    for (int i = 0; i < static_cast<int>(candidates.size()); i++) {
+        auto &candidate = candidates[i];
+        if (candidate.path.empty()) {
+            continue;
+        }
+        auto it = lookup.find(candidate.word);
+        if (it == lookup.end()) {
+            lookup.insert({candidate.word, static_cast<int>(words.size())});
+            words.push_back({candidate.value, static_cast<int>(candidate.path.size()), {i}, 0.0f});
+            continue;
+        }
+        auto &word = words[it->second];
+        if (candidate.value > word.value) {
+            word.value = candidate.value;
+            word.paths.clear();
+        }
+        if (candidate.value == word.value) {
+            word.paths.push_back(i);
+        }
+    }
+
+    // the word before is unknown while picking words, so the travel to a word is
+    // its average distance from where every other word ends
+    std::vector<Cursor> ends;
+    for (auto &word: words) {
+        ends.push_back(candidates[word.paths[0]].path.back());
+    }
+    for (auto &word: words) {
+        float travel_ms = 0.0f;
+        if ((plan.travel_ms_per_cell > 0.0f) && !ends.empty()) {
+            const Cursor &start = candidates[word.paths[0]].path.front();
+            float total_distance = 0.0f;
+            for (auto &end: ends) {
+                total_distance += GetDistance(end, start);
+            }
+            travel_ms = plan.travel_ms_per_cell * total_distance / static_cast<float>(ends.size());
+        }
+        word.cost_ms = static_cast<float>(word.length * plan.cell_ms) + travel_ms;
+    }
+    return words;
+}
+
+// 0/1 knapsack over the time budget, in units of the time spent on a cell
+static std::vector<bool> SelectWords(const std::vector<PlanWord> &words, const TracePlan &plan) {
+    const int total_words = static_cast<int>(words.size());
+    std::vector<bool> is_selected(total_words, true);
+    if (plan.time_budget_ms <= 0) {
+        return is_selected;
+    }
+
+    float total_cost_ms = 0.0f;
+    for (auto &word: words) {
+        total_cost_ms += word.cost_ms;
+    }
+    if (total_cost_ms <= static_cast<float>(plan.time_budget_ms)) {
+        return is_selected;
+    }
+
+    const int tick_ms = std::max(1, plan.cell_ms);
+    const int capacity = plan.time_budget_ms / tick_ms;
+    std::vector<int> weights(total_words);
+    for (int i = 0; i < total_words; i++) {
+        weights[i] = std::max(1, static_cast<int>(ceilf(words[i].cost_ms / static_cast<float>(tick_ms))));
+    }
+
+    const size_t total_entries = static_cast<size_t>(total_words) * static_cast<size_t>(capacity+1);
+    if (total_entries > MAX_KNAPSACK_ENTRIES) {
+        std::vector<int> order(total_words);
+        for (int i = 0; i < total_words; i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&words](const int a, const int b) {
+            return words[a].value * words[b].cost_ms > words[b].value * words[a].cost_ms;
+        });
+        int remaining = capacity;
+        for (int i: order) {
+            is_selected[i] = weights[i] <= remaining;
+            if (is_selected[i]) {
+                remaining -= weights[i];
+            }
+        }
+        return is_selected;
+    }
+
+    std::vector<int64_t> best(capacity+1, 0);
+    std::vector<uint8_t> is_taken(total_entries, 0);
+    for (int i = 0; i < total_words; i++) {
+        uint8_t *taken = &is_taken[static_cast<size_t>(i) * (capacity+1)];
+        for (int c = capacity; c >= weights[i]; c--) {
+            const int64_t value = best[c - weights[i]] + words[i].value;
+            if (value > best[c]) {
+                best[c] = value;
+                taken[c] = 1;
+            }
+        }
+    }
+
+    int c = capacity;
+    for (int i = total_words-1; i >= 0; i--) {
+        is_selected[i] = is_taken[static_cast<size_t>(i) * (capacity+1) + c] != 0;
+        if (is_selected[i]) {
+            c -= weights[i];
+        }
+    }
+    return is_selected;
+}
+
+// nearest path of the word to the cursor
+static int GetNearestPath(
+    const std::vector<TraceResult> &candidates, const PlanWord &word,
+    const Cursor &cursor, float &distance)
+{
+    int best_path = word.paths[0];
+    distance = GetDistance(cursor, candidates[best_path].path.front());
+    for (size_t i = 1; i < word.paths.size(); i++) {
+        const float d = GetDistance(cursor, candidates[word.paths[i]].path.front());
+        if (d < distance) {
+            distance = d;
+            best_path = word.paths[i];
+        }
+    }
+    return best_path;
+}
+
+std::vector<TraceResult> PlanTraces(
+    const std::vector<TraceResult> &candidates, const TracePlan &plan,
+    int *total_planned)
+{
+    const auto words = GetPlanWords(candidates, plan);
+    const auto is_selected = SelectWords(words, plan);
+
+    // greedily take the word with the most points per second from where the cursor is
+    std::vector<int> remaining;
+    for (int i = 0; i < static_cast<int>(words.size()); i++) {
+        if (is_selected[i]) {
+            remaining.push_back(i);
+        }
+    }
+    std::vector<int> order;
+    std::vector<int> paths;
+    Cursor cursor = plan.start;
+    while (!remaining.empty()) {
+        size_t best_index = 0;
+        int best_path = -1;
+        float best_rate = -1.0f;
+        float best_distance = 0.0f;
+        for (size_t k = 0; k < remaining.size(); k++) {
+            auto &word = words[remaining[k]];
+            float distance;
+            const int path = GetNearestPath(candidates, word, cursor, distance);
+            const float ms = static_cast<float>(word.length * plan.cell_ms) + plan.travel_ms_per_cell*distance;
+            const float rate = static_cast<float>(word.value) / std::max(ms, 1.0f);
+            // closer words break ties so the cursor doesn't wander
+            if ((rate > best_rate) || ((rate == best_rate) && (distance < best_distance))) {
+                best_rate = rate;
+                best_distance = distance;
+                best_index = k;
+                best_path = path;
+            }
+        }
+        order.push_back(remaining[best_index]);
+        paths.push_back(best_path);
+        cursor = candidates[best_path].path.back();
+        remaining[best_index] = remaining.back();
+        remaining.pop_back();
+    }
+
+    // now that the next word is known, prefer the path which ends closest to its start
+    Cursor previous_end = plan.start;
+    for (size_t k = 0; k < order.size(); k++) {
+        auto &word = words[order[k]];
+        if ((word.paths.size() > 1) && ((k+1) < order.size())) {
+            const Cursor &next_start = candidates[paths[k+1]].path.front();
+            float best_distance = -1.0f;
+            for (int path: word.paths) {
+                auto &p = candidates[path].path;
+                const float d = GetDistance(previous_end, p.front()) + GetDistance(p.back(), next_start);
+                if ((best_distance < 0.0f) || (d < best_distance)) {
+                    best_distance = d;
+                    paths[k] = path;
+                }
+            }
+        }
+        previous_end = candidates[paths[k]].path.back();
+    }
+
+    std::vector<TraceResult> traces;
+    for (int path: paths) {
+        traces.push_back(candidates[path]);
+        traces.back().status = TraceStatus::INCOMPLETE;
+    }
+    if (total_planned != nullptr) {
+        *total_planned = static_cast<int>(traces.size());
+    }
+
+    // words which don't fit are left at the end in case there is time left after all
+    std::vector<int> unplanned;
+    for (int i = 0; i < static_cast<int>(words.size()); i++) {
+        if (!is_selected[i]) {
+            unplanned.push_back(i);
+        }
+    }
+    std::sort(unplanned.begin(), unplanned.end(), [&words](const int a, const int b) {
+        return words[a].value > words[b].value;
+    });
+    for (int i: unplanned) {
+        traces.push_back(candidates[words[i].paths[0]]);
+        traces.back().status = TraceStatus::INCOMPLETE;
+    }
+    return traces;
+}
+
+}
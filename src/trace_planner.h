@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include "wordblitz.h"
+
+namespace wordblitz {
+
+// how long the tracer takes, which decides what is worth tracing in the time left
+struct TracePlan {
+    // time left in the round, 0 plans every word
+    int time_budget_ms = 0;
+    // the tracer waits this long on every cell of a path
+    int cell_ms = 10;
+    // cursor travel between the end of a word and the start of the next, per cell of distance
+    float travel_ms_per_cell = 0.0f;
+    // where the cursor starts
+    Cursor start = {0, 0};
+};
+
+// every path of each word which is tied for the best value of that word
+std::vector<TraceResult> GetTraceCandidates(const std::vector<SearchResult> &searches);
+
+// picks the words which fit into the time budget for the most points, and orders them
+// so the points per second stay high, including the cursor travel between words
+// candidates may hold several paths of a word, and the path which travels the least is used
+// returns one trace per word: the planned traces first, then the rest by value
+std::vector<TraceResult> PlanTraces(
+    const std::vector<TraceResult> &candidates, const TracePlan &plan,
+    int *total_planned=nullptr);
+
+}
@@ -1,9 +1,14 @@
 #include "unified_model.h"
 #include <chrono>
 #include <assert.h>
+#include <algorithm>
 #include <functional>
+#include <thread>
+#include <vector>
 #include <stdexcept>
 
+static void RunReadTask(const ReadTask &task);
+
 UnifiedModel::UnifiedModel(
         std::unique_ptr<BonusesModel>   &model_bonuses,
         std::unique_ptr<CharacterModel> &model_characters,
@@ -12,12 +17,71 @@ UnifiedModel::UnifiedModel(
 : m_model_bonuses(std::move(model_bonuses)),
   m_model_characters(std::move(model_characters)),
   m_model_values(std::move(model_values)),
-  m_params(params)
+  m_bonus_colours(static_cast<int>(wordblitz::CellModifier::MOD_3W)+1),
+  m_params(params),
+  m_read_threads_setting(-1),
+  m_is_tuned(false),
+  m_total_bonus_colours(0)
 {
+    // every cell of a cropper goes through its model in one invoke
+    // models which can't be resized fall back to an invoke per cell
+    const int total_cells = m_params->grid.size;
+    m_model_bonuses->SetBatchSize(total_cells);
+    m_model_characters->SetBatchSize(total_cells);
+    m_model_values->SetBatchSize(total_cells);
+
+    m_passes[0].model = m_model_bonuses.get();
+    m_passes[0].callback = [this](const int slot, const int index, wordblitz::Cell cell) {
+        cell.modifier = m_model_bonuses->GetPrediction(slot);
+        // every prediction of the model calibrates the colour prototypes
+        const int label = static_cast<int>(cell.modifier);
+        if (m_bonus_audits[index] >= 0) {
+            m_bonus_colours.AddAudit(m_bonus_audits[index] == label);
+        }
+        m_bonus_colours.Calibrate(m_bonus_stats[index], label);
+    };
+    m_passes[1].model = m_model_characters.get();
+    m_passes[1].callback = [this](const int slot, const int index, wordblitz::Cell cell) {
+        auto &p = *m_params;
+        cell.c = m_model_characters->GetPrediction(slot);
+        // copied into the buffers of the lattice, which is only searched with more than one candidate
+        if (p.total_letter_candidates > 1) {
+            const auto &candidates = m_model_characters->GetCandidates(slot);
+            p.lattice.cells[index].assign(candidates.begin(), candidates.end());
+        }
+    };
+    m_passes[2].model = m_model_values.get();
+    m_passes[2].callback = [this](const int slot, const int index, wordblitz::Cell cell) {
+        cell.value = m_model_values->GetPrediction(slot);
+    };
+    m_run_read_task = [this](const size_t i) {
+        RunReadTask(m_read_tasks[i]);
+    };
+}
 
+void UnifiedModel::SetModelConfigs(const ModelConfig &bonuses, const ModelConfig &characters, const ModelConfig &values) {
+    m_configs[0] = bonuses;
+    m_configs[1] = characters;
+    m_configs[2] = values;
+    m_is_tuned = true;
+    m_model_bonuses->SetBatchSize(bonuses.batch_size);
+    m_model_characters->SetBatchSize(characters.batch_size);
+    m_model_values->SetBatchSize(values.batch_size);
+    // interpreters are split again on the next update
+    m_read_threads_setting = -1;
 }
 
-typedef std::function<void (const uint8_t *, const int, const int, const int, wordblitz::Cell &)> GridIteratorCallback;
+void UnifiedModel::SetCropCaches(
+    std::unique_ptr<CropCache> &crops_bonuses,
+    std::unique_ptr<CropCache> &crops_characters,
+    std::unique_ptr<CropCache> &crops_values)
+{
+    m_crops_bonuses = std::move(crops_bonuses);
+    m_crops_characters = std::move(crops_characters);
+    m_crops_values = std::move(crops_values);
+}
+
+typedef std::function<void (const uint8_t *, const int, const int, const int, const int, wordblitz::Cell &)> GridIteratorCallback;
 
 void check_and_throw(bool v, const char *message) {
     if (!v) {
@@ -30,11 +94,10 @@ void IterateBufferUsingCropper(
     const float xscale, const float yscale,
     wordblitz::Grid &grid, GridCropper &cropper, GridIteratorCallback callback)
 {
-    const int sqrt_size = grid.sqrt_size;
-    for (int x = 0; x < sqrt_size; x++) {
-        for (int y = 0; y < sqrt_size; y++) {
+    for (int x = 0; x < grid.width; x++) {
+        for (int y = 0; y < grid.height; y++) {
             const int i = grid.GetIndex(x, y);
-            auto &cell = grid.GetCell(i);
+            auto cell = grid.GetCell(i);
 
             const int x_start = cropper.offset.x + x*cropper.spacing.x;
             const int y_start = cropper.offset.y + y*cropper.spacing.y;
@@ -57,57 +120,205 @@ void IterateBufferUsingCropper(
             check_and_throw((y_rescale + height_rescale) < height, "Cropper grid goes past bottom");
 
             const uint8_t *data = buffer + y_flip*row_stride + x_rescale*4;
-            callback(data, width_rescale, height_rescale, row_stride, cell);
+            callback(data, width_rescale, height_rescale, row_stride, i, cell);
         }
     }
 }
 
-void UnifiedModel::Update(const uint8_t *buffer, const int width, const int height, const int row_stride) {
-    const uint8_t *data = buffer;
-    auto &p = *m_params;
-
-    const float xscale = (float)width / (float)p.inter_buffer_size.x;
-    const float yscale = (float)height / (float)p.inter_buffer_size.y;
-
+// regions are collected up front so a cropper which goes past the screen throws before any model runs
+static void CollectCropRegions(
+    const uint8_t *buffer, const int width, const int height, const int row_stride,
+    const float xscale, const float yscale,
+    wordblitz::Grid &grid, GridCropper &cropper, std::vector<CropRegion> &regions)
+{
+    regions.clear();
     IterateBufferUsingCropper(
         buffer, width, height, row_stride,
         xscale, yscale,
-        p.grid, p.cropper_bonuses, 
-        [this](
+        grid, cropper,
+        [&regions](
             const uint8_t *data, 
             const int width, const int height, const int row_stride, 
-            wordblitz::Cell &cell) 
+            const int index, wordblitz::Cell &cell) 
         {
-            m_model_bonuses->CopyDataToInput(data, width, height, row_stride);
-            m_model_bonuses->Parse();
-            cell.modifier = m_model_bonuses->GetPrediction();
+            regions.push_back({data, width, height, index});
         });
+}
 
-    IterateBufferUsingCropper(
-        buffer, width, height, row_stride,
-        xscale, yscale,
-        p.grid, p.cropper_characters, 
-        [this](
-            const uint8_t *data, 
-            const int width, const int height, const int row_stride, 
-            wordblitz::Cell &cell) 
-        {
-            m_model_characters->CopyDataToInput(data, width, height, row_stride);
-            m_model_characters->Parse();
-            cell.c = m_model_characters->GetPrediction();
-        });
+static int GetTotalReadThreads(const AppParams &p) {
+    if (p.total_read_threads > 0) {
+        return p.total_read_threads;
+    }
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
 
-    IterateBufferUsingCropper(
-        buffer, width, height, row_stride,
-        xscale, yscale,
-        p.grid, p.cropper_values, 
-        [this](
-            const uint8_t *data, 
-            const int width, const int height, const int row_stride, 
-            wordblitz::Cell &cell) 
-        {
-            m_model_values->CopyDataToInput(data, width, height, row_stride);
-            m_model_values->Parse();
-            cell.value = m_model_values->GetPrediction();
-        });
-}
\ No newline at end of file
+// a bonus whose crop is at least this far from every colour prototype is left to the model
+// since it is likely a tile the classifier hasn't been calibrated for
+constexpr float BONUS_COLOUR_MAX_DISTANCE = 0.1f;
+
+// crops which were read before are decoded from their cached outputs, through the first slot of the batch
+// and only the crops which missed are left to run
+static void ReadCachedCrops(ModelPass &pass, wordblitz::Grid &grid, const int row_stride) {
+    if (pass.cache == nullptr) {
+        return;
+    }
+    pass.signatures.resize(pass.regions.size());
+    size_t total_misses = 0;
+    for (size_t i = 0; i < pass.regions.size(); i++) {
+        const auto region = pass.regions[i];
+        auto &signature = pass.signatures[total_misses];
+        GetCropSignature(region.data, region.width, region.height, row_stride, signature);
+        const uint8_t *output = pass.cache->Find(signature);
+        if (output != nullptr) {
+            pass.model->ParseRawOutput(output, 0);
+            pass.callback(0, region.cell, grid.GetCell(region.cell));
+            continue;
+        }
+        pass.regions[total_misses] = region;
+        total_misses++;
+    }
+    pass.regions.resize(total_misses);
+    pass.signatures.resize(total_misses);
+}
+
+// copies the crops of an interpreter into its slots and runs them
+static void RunReadTask(const ReadTask &task) {
+    auto &pass = *task.pass;
+    int first, count;
+    pass.model->GetInterpreterSlots(task.interpreter, first, count);
+    count = std::min(count, pass.total-first);
+    for (int slot = first; slot < first+count; slot++) {
+        auto &region = pass.regions[pass.start + slot];
+        pass.model->CopyDataToInput(region.data, region.width, region.height, task.row_stride, slot);
+    }
+    pass.model->Invoke(task.interpreter);
+}
+
+// bonuses whose colours are confidently close to one prototype are labelled without the model
+// the rest, and every so often a confident one to audit it, are left in the pass
+void UnifiedModel::ReadBonusColours(ModelPass &pass, const int row_stride) {
+    auto &p = *m_params;
+    m_bonus_stats.resize(p.grid.size);
+    m_bonus_audits.assign(p.grid.size, -1);
+    if (!p.is_classifying_bonus_colours) {
+        for (auto &region: pass.regions) {
+            GetColourStats(region.data, region.width, region.height, row_stride, m_bonus_stats[region.cell]);
+        }
+        return;
+    }
+
+    size_t total_fallbacks = 0;
+    for (size_t i = 0; i < pass.regions.size(); i++) {
+        const auto region = pass.regions[i];
+        auto &stats = m_bonus_stats[region.cell];
+        GetColourStats(region.data, region.width, region.height, row_stride, stats);
+        ColourClassifier::Prediction prediction;
+        const bool is_confident = 
+            m_bonus_colours.Predict(stats, prediction) &&
+            (prediction.margin >= p.bonus_colour_margin) &&
+            (prediction.distance <= BONUS_COLOUR_MAX_DISTANCE);
+        if (is_confident) {
+            m_total_bonus_colours++;
+            const int interval = p.bonus_colour_audit_interval;
+            if ((interval <= 0) || ((m_total_bonus_colours % interval) != 0)) {
+                m_bonus_colours.AddFast();
+                p.grid.modifiers[region.cell] = static_cast<wordblitz::CellModifier>(prediction.label);
+                continue;
+            }
+            m_bonus_audits[region.cell] = prediction.label;
+        } else {
+            m_bonus_colours.AddFallback();
+        }
+        pass.regions[total_fallbacks] = region;
+        total_fallbacks++;
+    }
+    pass.regions.resize(total_fallbacks);
+}
+
+void UnifiedModel::Update(const uint8_t *buffer, const int width, const int height, const int row_stride) {
+    auto &p = *m_params;
+
+    m_model_characters->SetTotalCandidates(p.total_letter_candidates);
+    p.lattice.cells.resize(p.grid.size);
+
+    // automatic read threads use the tuned interpreters of each model, with a thread per interpreter
+    // otherwise each model gets an equal share of the threads, and each of its interpreters runs on one of them
+    const bool is_tuned = m_is_tuned && (p.total_read_threads == 0);
+    const int total_threads = is_tuned ? 
+        (m_configs[0].total_interpreters + m_configs[1].total_interpreters + m_configs[2].total_interpreters) :
+        GetTotalReadThreads(p);
+    if (p.total_read_threads != m_read_threads_setting) {
+        const int total_interpreters = std::max(1, (total_threads+2) / 3);
+        m_model_bonuses->SetTotalInterpreters(is_tuned ? m_configs[0].total_interpreters : total_interpreters);
+        m_model_characters->SetTotalInterpreters(is_tuned ? m_configs[1].total_interpreters : total_interpreters);
+        m_model_values->SetTotalInterpreters(is_tuned ? m_configs[2].total_interpreters : total_interpreters);
+        m_read_threads_setting = p.total_read_threads;
+    }
+
+    const float xscale = (float)width / (float)p.inter_buffer_size.x;
+    const float yscale = (float)height / (float)p.inter_buffer_size.y;
+
+    auto &passes = m_passes;
+    CollectCropRegions(
+        buffer, width, height, row_stride, xscale, yscale, 
+        p.grid, p.cropper_bonuses, passes[0].regions);
+    CollectCropRegions(
+        buffer, width, height, row_stride, xscale, yscale, 
+        p.grid, p.cropper_characters, passes[1].regions);
+    CollectCropRegions(
+        buffer, width, height, row_stride, xscale, yscale, 
+        p.grid, p.cropper_values, passes[2].regions);
+
+    ReadBonusColours(passes[0], row_stride);
+
+    // the model view shows the resized crops of the last batch, so its model isn't cached while it is open
+    CropCache *caches[3] = {m_crops_bonuses.get(), m_crops_characters.get(), m_crops_values.get()};
+    for (int i = 0; i < 3; i++) {
+        auto &pass = passes[i];
+        const bool is_cached = p.is_caching_crops && (caches[i] != nullptr) && !pass.model->GetIsKeepingResize();
+        pass.cache = is_cached ? caches[i] : nullptr;
+        if (is_cached) {
+            pass.cache->SetTolerance(p.crop_cache_tolerance);
+        }
+        ReadCachedCrops(pass, p.grid, row_stride);
+    }
+
+    // every model runs a batch of its crops per round
+    // the interpreters of all models are fanned out together, and the predictions are written back in between
+    for (auto &pass: passes) {
+        pass.start = 0;
+    }
+    m_read_workers.SetTotalThreads(total_threads);
+    auto &tasks = m_read_tasks;
+    while (true) {
+        tasks.clear();
+        for (auto &pass: passes) {
+            const size_t remaining = pass.regions.size() - pass.start;
+            pass.total = static_cast<int>(std::min(remaining, static_cast<size_t>(pass.model->GetBatchSize())));
+            for (int k = 0; k < pass.model->GetTotalInterpreters(); k++) {
+                int first, count;
+                pass.model->GetInterpreterSlots(k, first, count);
+                if (first < pass.total) {
+                    tasks.push_back({&pass, k, row_stride});
+                }
+            }
+        }
+        if (tasks.empty()) {
+            break;
+        }
+
+        m_read_workers.Run(tasks.size(), m_run_read_task);
+
+        for (auto &pass: passes) {
+            pass.model->ParseOutputs(pass.total);
+            for (int slot = 0; slot < pass.total; slot++) {
+                const int index = pass.regions[pass.start + slot].cell;
+                pass.callback(slot, index, p.grid.GetCell(index));
+                if (pass.cache != nullptr) {
+                    pass.cache->Insert(pass.signatures[pass.start + slot], pass.model->GetOutputData(slot));
+                }
+            }
+            pass.start += pass.total;
+        }
+    }
+}
@@ -1,19 +1,77 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <vector>
 #include "wordblitz_model.h"
+#include "model_tuner.h"
+#include "crop_cache.h"
+#include "colour_classifier.h"
+#include "worker_pool.h"
 #include "app_params.h"
 #include "util/MSS.h"
 #include "wordblitz.h"
 
+// called with the slot of the batch which holds the prediction of the cell
+typedef std::function<void (const int, const int, wordblitz::Cell)> PredictionCallback;
+
+// part of the screen which is fed to a model for a cell
+struct CropRegion {
+    const uint8_t *data;
+    int width;
+    int height;
+    int cell;
+};
+
+// crops of one model which are run a batch at a time
+struct ModelPass {
+    Model *model;
+    // crops which missed the cache, and their signatures to insert them afterwards
+    CropCache *cache;
+    std::vector<CropRegion> regions;
+    std::vector<CropSignature> signatures;
+    PredictionCallback callback;
+    size_t start;
+    int total;
+};
+
+// an interpreter of a model and the crops of the current batch it runs
+struct ReadTask {
+    ModelPass *pass;
+    int interpreter;
+    int row_stride;
+};
+
 class UnifiedModel
 {
 public:
     std::unique_ptr<BonusesModel>   m_model_bonuses;
     std::unique_ptr<CharacterModel> m_model_characters;
     std::unique_ptr<ValuesModel>    m_model_values;
+    // outputs of each model for crops it has already read, which can be null
+    std::unique_ptr<CropCache>      m_crops_bonuses;
+    std::unique_ptr<CropCache>      m_crops_characters;
+    std::unique_ptr<CropCache>      m_crops_values;
+    // labels bonuses from their colours, calibrated by the predictions of the bonuses model
+    ColourClassifier                m_bonus_colours;
 private:
     std::shared_ptr<AppParams>      m_params;
+    // read threads setting the interpreters of each model were split for
+    int m_read_threads_setting;
+    // run the interpreters of every model, and are kept alive between reads
+    WorkerPool m_read_workers;
+    // tuned configurations of bonuses, characters and values, which are used when the read threads are automatic
+    bool m_is_tuned;
+    ModelConfig m_configs[3];
+    // colour statistics of the bonus crop of each cell, and the confident colour label which is audited by the model or -1
+    std::vector<ColourStats> m_bonus_stats;
+    std::vector<int> m_bonus_audits;
+    int m_total_bonus_colours;
+    // crops of bonuses, characters and values, and the interpreters of a round
+    // which are filled in place so a read reuses their buffers and callbacks
+    ModelPass m_passes[3];
+    std::vector<ReadTask> m_read_tasks;
+    WorkerPool::Task m_run_read_task;
 public:
     UnifiedModel(
         std::unique_ptr<BonusesModel>   &model_bonuses,
@@ -21,6 +79,17 @@ public:
         std::unique_ptr<ValuesModel>    &model_values,
         std::shared_ptr<AppParams>      &params);
 
+    // uses the tuned batch sizes, and the tuned interpreters while the read threads are automatic
+    void SetModelConfigs(const ModelConfig &bonuses, const ModelConfig &characters, const ModelConfig &values);
+
+    void SetCropCaches(
+        std::unique_ptr<CropCache> &crops_bonuses,
+        std::unique_ptr<CropCache> &crops_characters,
+        std::unique_ptr<CropCache> &crops_values);
+
     // expects an RGBA buffer  
+    // crops of all three models are run in parallel across the read threads
     void Update(const uint8_t *buffer, const int width, const int height, const int row_stride);
+private:
+    void ReadBonusColours(ModelPass &pass, const int row_stride);
 };
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "word_signatures.h"
+#include <stdint.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define WORDBLITZ_USE_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace wordtree;
+
+namespace wordblitz {
+
+// index of the lowest set bit, which is then cleared
+static int PopLowestBit(uint32_t &mask) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, mask);
+#else
+    const int i = __builtin_ctz(mask);
+#endif
+    mask &= mask-1;
+    return static_cast<int>(i);
+}
+
+static int PopCount(uint32_t mask) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt(mask));
+#else
+    return __builtin_popcount(mask);
+#endif
+}
+
+static LetterCounts CreateLetterCounts(const uint8_t *letters, const int length) {
+    uint8_t totals[32] = {0};
+    for (int i = 0; i < length; i++) {
+        if (totals[letters[i]] < 15) {
+            totals[letters[i]]++;
+        }
+    }
+
+    LetterCounts counts;
+    for (int i = 0; i < 16; i++) {
+        counts.counts[i] = static_cast<uint8_t>(totals[2*i] | (totals[2*i+1] << 4));
+    }
+    return counts;
+}
+
+// check if every letter count of the word fits into the letter counts of the board
+static bool IsCountSubset(const LetterCounts &word, const LetterCounts &board) {
+#ifdef WORDBLITZ_USE_SSE2
+    const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+    const __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(word.counts));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(board.counts));
+    // saturating subtraction is only non zero where the word needs more of a letter than the board has
+    const __m128i low = _mm_subs_epu8(_mm_and_si128(w, low_nibbles), _mm_and_si128(b, low_nibbles));
+    const __m128i high = _mm_subs_epu8(
+        _mm_and_si128(_mm_srli_epi16(w, 4), low_nibbles),
+        _mm_and_si128(_mm_srli_epi16(b, 4), low_nibbles));
+    const __m128i excess = _mm_or_si128(low, high);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(excess, _mm_setzero_si128())) == 0xFFFF;
+#else
+    for (int i = 0; i < 16; i++) {
+        if ((word.counts[i] & 0x0F) > (board.counts[i] & 0x0F)) return false;
+        if ((word.counts[i] >> 4) > (board.counts[i] >> 4)) return false;
+    }
+    return true;
+#endif
+}
+
+// boards with few distinct letters look up each subset of their letters
+// instead of scanning every group, which is worth it when there are far fewer subsets than groups
+constexpr uint32_t SUBSET_LOOKUP_RATIO = 16;
+// boards with more distinct letters than this are faster to solve with the word tree
+constexpr int SIGNATURE_MAX_DISTINCT_LETTERS = 5;
+
+WordSignatures::WordSignatures(const NodePool &pool) {
+    // depth first walk of the tree with an explicit stack
+    struct Frame {
+        uint32_t node_index;
+        uint32_t remaining_children;
+    };
+    struct Word {
+        uint32_t letter_mask;
+        uint32_t offset;
+        uint32_t length;
+    };
+    std::vector<Word> words;
+    std::vector<char> characters;
+    std::vector<Frame> stack;
+    std::vector<char> word;
+    stack.push_back({0, pool[0].child_mask});
+    while (!stack.empty()) {
+        auto &frame = stack.back();
+        if (frame.remaining_children == 0) {
+            stack.pop_back();
+            if (!word.empty()) {
+                word.pop_back();
+            }
+            continue;
+        }
+
+        uint32_t letters = frame.remaining_children;
+        const int letter = PopLowestBit(letters);
+        frame.remaining_children = letters;
+
+        const uint32_t child_index = pool[frame.node_index].children[letter];
+        const Node &child = pool[child_index];
+        word.push_back(static_cast<char>('a' + letter));
+        if (child.is_leaf) {
+            uint32_t letter_mask = 0;
+            for (char c: word) {
+                letter_mask |= (1u << (c - 'a'));
+            }
+            words.push_back({letter_mask, static_cast<uint32_t>(characters.size()), static_cast<uint32_t>(word.size())});
+            characters.insert(characters.end(), word.begin(), word.end());
+        }
+        stack.push_back({child_index, child.child_mask});
+    }
+
+    std::stable_sort(words.begin(), words.end(), [](const Word &a, const Word &b) {
+        return a.letter_mask < b.letter_mask;
+    });
+
+    m_max_length = 0;
+    m_offsets.push_back(0);
+    m_characters.reserve(characters.size());
+    m_letter_counts.reserve(words.size());
+    uint8_t letters[256];
+    for (uint32_t i = 0; i < static_cast<uint32_t>(words.size()); i++) {
+        auto &w = words[i];
+        const char *c = characters.data() + w.offset;
+        for (uint32_t j = 0; j < w.length; j++) {
+            letters[j] = static_cast<uint8_t>(c[j] - 'a');
+        }
+        m_characters.insert(m_characters.end(), c, c+w.length);
+        m_offsets.push_back(static_cast<uint32_t>(m_characters.size()));
+        m_letter_counts.push_back(CreateLetterCounts(letters, static_cast<int>(w.length)));
+        m_max_length = std::max(m_max_length, static_cast<int>(w.length));
+
+        if (m_group_masks.empty() || (m_group_masks.back() != w.letter_mask)) {
+            m_group_lookup[w.letter_mask] = static_cast<uint32_t>(m_group_masks.size());
+            m_group_masks.push_back(w.letter_mask);
+            m_group_offsets.push_back(i);
+        }
+    }
+    m_group_offsets.push_back(static_cast<uint32_t>(words.size()));
+}
+
+// groups of words which only use letters that are on the board
+void WordSignatures::FindGroups(const uint32_t board_mask, std::vector<uint32_t> &groups) const {
+    const uint32_t total_groups = static_cast<uint32_t>(m_group_masks.size());
+    const int total_letters = PopCount(board_mask);
+    if ((uint64_t(1) << total_letters) * SUBSET_LOOKUP_RATIO <= total_groups) {
+        // walk every subset of the board letters in decreasing order
+        uint32_t subset = board_mask;
+        while (subset != 0) {
+            auto it = m_group_lookup.find(subset);
+            if (it != m_group_lookup.end()) {
+                groups.push_back(it->second);
+            }
+            subset = (subset-1) & board_mask;
+        }
+        return;
+    }
+
+    const uint32_t *masks = m_group_masks.data();
+    const uint32_t missing_letters = ~board_mask;
+    uint32_t i = 0;
+#ifdef WORDBLITZ_USE_SSE2
+    const __m128i missing = _mm_set1_epi32(static_cast<int>(missing_letters));
+    const __m128i zero = _mm_setzero_si128();
+    for (; (i+4) <= total_groups; i += 4) {
+        const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(masks+i));
+        uint32_t is_valid = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(m, missing), zero)));
+        while (is_valid) {
+            groups.push_back(i + PopLowestBit(is_valid));
+        }
+    }
+#endif
+    for (; i < total_groups; i++) {
+        if ((masks[i] & missing_letters) == 0) {
+            groups.push_back(i);
+        }
+    }
+}
+
+// state shared by every level of the path search for a single word
+struct WordPathSearch {
+    const Topology &topology;
+    const ScoreTable &scores;
+    const BoardMasks &masks;
+    const char *word;
+    int length;
+
+    std::vector<uint8_t> visited;
+    std::vector<Cursor> cursor_stack;
+    std::vector<SearchResult> &results;
+};
+
+static void RecursiveSearchWordPath(
+    WordPathSearch &s, const int cell_index,
+    int depth, int letter_sum, int word_multiplier)
+{
+    const int width = s.topology.width;
+    s.cursor_stack[depth] = {cell_index % width, cell_index / width};
+    letter_sum += s.scores.letter_scores[cell_index];
+    word_multiplier *= s.scores.word_multipliers[cell_index];
+    const int length = depth+1;
+    if (length == s.length) {
+        SearchResult r = {
+            {s.cursor_stack.data(), s.cursor_stack.data()+length},
+            {s.word, s.word+length},
+            word_multiplier*letter_sum + length
+        };
+        s.results.emplace_back(r);
+        return;
+    }
+
+    const uint8_t letter = static_cast<uint8_t>(s.word[length] - 'a');
+    if (((s.masks.neighbour_letters[cell_index] >> letter) & 1u) == 0) {
+        return;
+    }
+
+    s.visited[cell_index] = 1;
+    auto &topology = s.topology;
+    for (int j = topology.offsets[cell_index]; j < topology.offsets[cell_index+1]; j++) {
+        const int next_cell_index = topology.adjacency[j];
+        if (s.visited[next_cell_index] || (s.masks.letters[next_cell_index] != letter)) {
+            continue;
+        }
+        RecursiveSearchWordPath(s, next_cell_index, depth+1, letter_sum, word_multiplier);
+    }
+    s.visited[cell_index] = 0;
+}
+
+std::vector<SearchResult> WordSignatures::Search(const Grid &grid) const {
+    std::vector<SearchResult> results;
+    const ScoreTable scores = CreateScoreTable(grid);
+    const BoardMasks masks = CreateBoardMasks(grid);
+
+    uint32_t board_mask = 0;
+    for (int i = 0; i < grid.size; i++) {
+        board_mask |= (1u << masks.letters[i]);
+    }
+    const LetterCounts board_counts = CreateLetterCounts(masks.letters.data(), grid.size);
+
+    // cells grouped by their letter so a word only starts on matching cells
+    std::vector<int> letter_offsets(MAX_BRANCHES+1, 0);
+    std::vector<int> letter_cells(grid.size);
+    for (int i = 0; i < grid.size; i++) {
+        letter_offsets[masks.letters[i]+1]++;
+    }
+    for (int i = 0; i < MAX_BRANCHES; i++) {
+        letter_offsets[i+1] += letter_offsets[i];
+    }
+    {
+        std::vector<int> cursors(letter_offsets.begin(), letter_offsets.end()-1);
+        for (int i = 0; i < grid.size; i++) {
+            letter_cells[cursors[masks.letters[i]]++] = i;
+        }
+    }
+
+    std::vector<uint32_t> groups;
+    FindGroups(board_mask, groups);
+
+    const int max_length = std::min(m_max_length, grid.size);
+
+    WordPathSearch s = {
+        grid.topology, scores, masks,
+        nullptr, 0,
+        std::vector<uint8_t>(grid.size, 0),
+        std::vector<Cursor>(max_length+1, {-1,-1}),
+        results
+    };
+
+    for (uint32_t group: groups) {
+        for (uint32_t i = m_group_offsets[group]; i < m_group_offsets[group+1]; i++) {
+            if (!IsCountSubset(m_letter_counts[i], board_counts)) {
+                continue;
+            }
+            s.word = m_characters.data() + m_offsets[i];
+            s.length = static_cast<int>(m_offsets[i+1]-m_offsets[i]);
+            const uint8_t letter = static_cast<uint8_t>(s.word[0] - 'a');
+            for (int j = letter_offsets[letter]; j < letter_offsets[letter+1]; j++) {
+                RecursiveSearchWordPath(s, letter_cells[j], 0, 0, 1);
+            }
+        }
+    }
+
+    return results;
+}
+
+SearchEngine ChooseSearchEngine(const Grid &grid) {
+    uint32_t board_mask = 0;
+    for (int i = 0; i < grid.size; i++) {
+        board_mask |= (1u << FindIndex(grid.characters[i]));
+    }
+    // measured with the bench target, the crossover doesn't move much with board size
+    return (PopCount(board_mask) <= SIGNATURE_MAX_DISTINCT_LETTERS) ?
+        SearchEngine::ENGINE_SIGNATURES :
+        SearchEngine::ENGINE_WORD_TREE;
+}
+
+std::vector<SearchResult> SearchBoard(
+    NodePool &pool, const WordSignatures &signatures,
+    const Grid &grid, const SearchEngine engine)
+{
+    if (engine == SearchEngine::ENGINE_SIGNATURES) {
+        return signatures.Search(grid);
+    }
+    return SearchWordTree(pool, grid);
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "wordtree.h"
+#include "wordblitz.h"
+
+namespace wordblitz {
+
+// number of times each letter appears in a word, packed as 4 bit counts
+// byte i holds letter 2i in the low nibble and letter 2i+1 in the high nibble
+// counts saturate at 15, which can only let extra words through the filter
+struct LetterCounts {
+    uint8_t counts[16];
+};
+
+// word first search which is an alternative to walking the word tree over the board
+// every dictionary word is filtered by comparing its letters against the letters of the board
+// and the survivors are confirmed with a path search
+// this is faster when the board has few distinct letters, since most words are rejected by the filter
+class WordSignatures
+{
+private:
+    // words are sorted by their letter mask
+    // word i is m_characters[m_offsets[i]] to m_characters[m_offsets[i+1]-1]
+    std::vector<char> m_characters;
+    std::vector<uint32_t> m_offsets;
+    std::vector<LetterCounts> m_letter_counts;
+    int m_max_length;
+
+    // words which use the same set of letters form a group
+    // bit i of the mask is set if the letter with index i is in the words
+    // group i holds words m_group_offsets[i] to m_group_offsets[i+1]-1
+    std::vector<uint32_t> m_group_masks;
+    std::vector<uint32_t> m_group_offsets;
+    std::unordered_map<uint32_t, uint32_t> m_group_lookup;
+public:
+    // the words are copied out of the tree, so later changes to the tree aren't seen
+    WordSignatures(const wordtree::NodePool &pool);
+    // returns every path of every word like SearchWordTree, but in a different order
+    std::vector<SearchResult> Search(const Grid &grid) const;
+
+    inline size_t GetTotalWords() const { return m_letter_counts.size(); }
+    inline size_t GetTotalGroups() const { return m_group_masks.size(); }
+private:
+    void FindGroups(const uint32_t board_mask, std::vector<uint32_t> &groups) const;
+};
+
+enum SearchEngine {
+    ENGINE_WORD_TREE, ENGINE_SIGNATURES
+};
+
+// pick the engine which is expected to be faster for the board
+SearchEngine ChooseSearchEngine(const Grid &grid);
+
+// solves with the chosen engine
+std::vector<SearchResult> SearchBoard(
+    wordtree::NodePool &pool, const WordSignatures &signatures,
+    const Grid &grid, const SearchEngine engine);
+
+}
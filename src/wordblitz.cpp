@@ -2,113 +2,458 @@
 #include <stdint.h>
 #include <unordered_map>
 #include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <fmt/core.h>
+
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#endif
 
 using namespace wordtree;
 
 namespace wordblitz {
 
-static void RecursiveSearchWordTree(
-    NodePool &pool, uint32_t parent_node_index,
-    const char *grid, bool *tracker, 
-    int x, int y,
-    std::vector<SearchResult> &results,
-    char *word_stack, Cursor *cursor_stack,
-    int depth,
-    const int sqrt_size) 
-{
-    // helper functions
-    const auto GetIndex = [&sqrt_size](const int x, const int y) -> int {
-        return x + y*sqrt_size;
-    };
+// depth first searches which take turns on a thread, so one search waits on
+// memory while the others run, which is about as many loads as a core keeps in flight
+constexpr int TOTAL_INTERLEAVED_SEARCHES = 8;
 
-    // try to set the current cell
-    const int cell_index = GetIndex(x, y);
-    auto &cell = tracker[cell_index];
-    char c = grid[cell_index];
-    if (cell) {
-        return;
-    }
+static thread_local SearchStats search_stats;
 
-    // check if this character goes into the tree
-    Node &parent = pool.at(parent_node_index);
-    int child_index = FindIndex(c);
-    uint32_t node_index = parent.children[child_index];
-    // doesn't exist
-    if (node_index == 0) {
-        return;
+SearchStats& GetSearchStats() {
+    return search_stats;
+}
+
+void ResetSearchStats() {
+    // the start cell times keep their buffer so resetting doesn't allocate
+    auto times = std::move(search_stats.start_cell_us);
+    std::fill(times.begin(), times.end(), 0.0f);
+    search_stats = SearchStats();
+    search_stats.start_cell_us = std::move(times);
+}
+
+void AddStartCellTime(const int cell_index, const std::chrono::steady_clock::time_point start) {
+    auto &times = search_stats.start_cell_us;
+    if (static_cast<int>(times.size()) <= cell_index) {
+        times.resize(cell_index+1, 0.0f);
     }
+    times[cell_index] += std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
 
-    // push
-    cell = true;
-    word_stack[depth] = c;
-    cursor_stack[depth] = {x, y};
-    Node &node = pool.at(node_index);
+// state shared by the interleaved searches of a board
+struct BoardSearch {
+    NodePool &pool;
+    const Topology &topology;
+    const char *characters;
+    const ScoreTable &scores;
+    const BoardMasks &masks;
+
+    std::vector<SearchResult> &results;
+    ResultRecycler<SearchResult> &recycler;
+};
+
+// a node is fetched a step before it is entered, so the load overlaps with the other searches
+static inline void PrefetchNode(const Node *node) {
+    const char *p = reinterpret_cast<const char*>(node);
+#ifdef _MSC_VER
+    _mm_prefetch(p, _MM_HINT_T0);
+    _mm_prefetch(p+64, _MM_HINT_T0);
+    _mm_prefetch(p+sizeof(Node)-1, _MM_HINT_T0);
+#else
+    __builtin_prefetch(p);
+    __builtin_prefetch(p+64);
+    __builtin_prefetch(p+sizeof(Node)-1);
+#endif
+}
+
+// one of the depth first searches which take turns on the thread
+struct InterleavedSearch {
+    int start_cell;
+    int depth;
+    // node and cell to enter on the next turn
+    uint32_t next_node;
+    int next_cell;
+    SearchFrame *frames;
+    uint8_t *visited;
+    char *word_stack;
+    Cursor *cursor_stack;
+};
+
+// push the node which was prefetched on the last turn
+static void EnterNextNode(BoardSearch &s, InterleavedSearch &c) {
+    const Node &node = s.pool[c.next_node];
+    const int cell_index = c.next_cell;
+    const int depth = c.depth;
+    const int width = s.topology.width;
+    c.word_stack[depth] = s.characters[cell_index];
+    c.cursor_stack[depth] = {cell_index % width, cell_index / width};
+    int letter_sum = s.scores.letter_scores[cell_index];
+    int word_multiplier = s.scores.word_multipliers[cell_index];
+    if (depth > 0) {
+        letter_sum += c.frames[depth-1].letter_sum;
+        word_multiplier *= c.frames[depth-1].word_multiplier;
+    }
+    WORDBLITZ_STAT(CountSearchNode(depth));
     if (node.is_leaf) {
-        SearchResult r = {
-            {cursor_stack, cursor_stack+depth+1},
-            {word_stack, word_stack+depth+1}
-        };
-        results.emplace_back(r);
+        auto &r = s.recycler.Push(s.results);
+        r.path.assign(c.cursor_stack, c.cursor_stack+depth+1);
+        r.word.assign(c.word_stack, c.word_stack+depth+1);
+        r.value = word_multiplier*letter_sum + depth+1;
+        r.confidence = 1.0f;
+        WORDBLITZ_STAT(GetSearchStats().results++);
+    }
+
+    const uint32_t letters = node.child_mask & s.masks.neighbour_letters[cell_index];
+    if (letters == 0) {
+        WORDBLITZ_STAT(GetSearchStats().child_misses++);
+        return;
     }
+    c.visited[cell_index] = 1;
+    c.frames[depth] = {
+        c.next_node, cell_index, s.topology.offsets[cell_index],
+        letters, letter_sum, word_multiplier
+    };
+    c.depth++;
+}
 
-    // set the cell and start depth first search
-    for (int xoff = -1; xoff <= 1; xoff++) {
-        for (int yoff = -1; yoff <= 1; yoff++) {
-            if ((xoff == 0) && (yoff == 0)) {
+// finds the next node to enter and prefetches it, returns false once every path is done
+static bool AdvanceSearch(BoardSearch &s, InterleavedSearch &c) {
+    auto &topology = s.topology;
+    while (c.depth > 0) {
+        auto &f = c.frames[c.depth-1];
+        for (int j = f.next; j < topology.offsets[f.cell+1]; j++) {
+            const int next_cell_index = topology.adjacency[j];
+            const uint8_t letter = s.masks.letters[next_cell_index];
+            if (c.visited[next_cell_index]) {
                 continue;
             }
-            int xn = x + xoff;
-            int yn = y + yoff;
-            // ignore if outside of bounds
-            if ((xn < 0) || (xn >= sqrt_size) || 
-                (yn < 0) || (yn >= sqrt_size))
-            {
+            if (((f.letters >> letter) & 1u) == 0) {
+                WORDBLITZ_STAT(GetSearchStats().child_misses++);
                 continue;
             }
-            // perform search
-            RecursiveSearchWordTree(
-                pool, node_index, 
-                grid, tracker,
-                xn, yn, 
-                results,
-                word_stack, cursor_stack,
-                depth+1, 
-                sqrt_size);
+            f.next = j+1;
+            c.next_node = s.pool[f.node].children[letter];
+            c.next_cell = next_cell_index;
+            PrefetchNode(&s.pool[c.next_node]);
+            return true;
         }
+        c.visited[f.cell] = 0;
+        c.depth--;
     }
+    return false;
+}
 
-    // pop
-    cell = false;
+// compressed sparse row layout from a list of neighbours per cell
+static Topology CreateTopology(
+    const TopologyType type, const int width, const int height, 
+    const std::vector<std::vector<int>> &neighbours) 
+{
+    Topology topology;
+    topology.type = type;
+    topology.width = width;
+    topology.height = height;
+    topology.offsets.reserve(neighbours.size()+1);
+    topology.offsets.push_back(0);
+    for (auto &cells: neighbours) {
+        topology.adjacency.insert(topology.adjacency.end(), cells.begin(), cells.end());
+        topology.offsets.push_back(static_cast<int>(topology.adjacency.size()));
+    }
+    return topology;
 }
 
-std::vector<SearchResult> SearchWordTree(NodePool &pool, const char *grid, const int sqrt_size) {
-    std::vector<SearchResult> results;
-    const int size = sqrt_size*sqrt_size;
+static void CheckTopologySize(const int width, const int height) {
+    if ((width <= 0) || (height <= 0)) {
+        throw std::runtime_error(fmt::format("Invalid board size {}x{}", width, height));
+    }
+}
+
+Topology CreateGridTopology(const int width, const int height) {
+    CheckTopologySize(width, height);
+    std::vector<std::vector<int>> neighbours(width*height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            auto &cells = neighbours[x + width*y];
+            for (int yoff = -1; yoff <= 1; yoff++) {
+                for (int xoff = -1; xoff <= 1; xoff++) {
+                    if ((xoff == 0) && (yoff == 0)) {
+                        continue;
+                    }
+                    const int xn = x + xoff;
+                    const int yn = y + yoff;
+                    // ignore if outside of bounds
+                    if ((xn < 0) || (xn >= width) || 
+                        (yn < 0) || (yn >= height))
+                    {
+                        continue;
+                    }
+                    cells.push_back(xn + width*yn);
+                }
+            }
+        }
+    }
+    return CreateTopology(TopologyType::TOPOLOGY_GRID, width, height, neighbours);
+}
 
-    char *word_stack = new char[64]{0};
-    bool *tracker = new bool[size]{false};
-    Cursor *cursor_stack = new Cursor[size]{{-1,-1}};
+Topology CreateTorusTopology(const int width, const int height) {
+    CheckTopologySize(width, height);
+    std::vector<std::vector<int>> neighbours(width*height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const int i = x + width*y;
+            auto &cells = neighbours[i];
+            for (int yoff = -1; yoff <= 1; yoff++) {
+                for (int xoff = -1; xoff <= 1; xoff++) {
+                    const int xn = (x + xoff + width) % width;
+                    const int yn = (y + yoff + height) % height;
+                    const int j = xn + width*yn;
+                    // narrow boards wrap onto the same cell more than once
+                    if ((j == i) || (std::find(cells.begin(), cells.end(), j) != cells.end())) {
+                        continue;
+                    }
+                    cells.push_back(j);
+                }
+            }
+        }
+    }
+    return CreateTopology(TopologyType::TOPOLOGY_TORUS, width, height, neighbours);
+}
 
-    // search the tree
-    for (int x = 0; x < sqrt_size; x++) {
-        for (int y = 0; y < sqrt_size; y++) {
-            RecursiveSearchWordTree(
-                pool, 0,
-                grid, tracker,
-                x, y, 
-                results,
-                word_stack, cursor_stack,
-                0, 
-                sqrt_size);
+Topology CreateHexTopology(const int width, const int height) {
+    CheckTopologySize(width, height);
+    // offsets of the rows above and below depend on whether the row is shifted
+    constexpr int EVEN_ROW_OFFSETS[6][2] = {{-1,0}, {1,0}, {-1,-1}, {0,-1}, {-1,1}, {0,1}};
+    constexpr int ODD_ROW_OFFSETS[6][2]  = {{-1,0}, {1,0}, {0,-1}, {1,-1}, {0,1}, {1,1}};
+
+    std::vector<std::vector<int>> neighbours(width*height);
+    for (int y = 0; y < height; y++) {
+        const auto &offsets = (y % 2) ? ODD_ROW_OFFSETS : EVEN_ROW_OFFSETS;
+        for (int x = 0; x < width; x++) {
+            auto &cells = neighbours[x + width*y];
+            for (auto &offset: offsets) {
+                const int xn = x + offset[0];
+                const int yn = y + offset[1];
+                if ((xn < 0) || (xn >= width) || 
+                    (yn < 0) || (yn >= height))
+                {
+                    continue;
+                }
+                cells.push_back(xn + width*yn);
+            }
         }
     }
+    return CreateTopology(TopologyType::TOPOLOGY_HEX, width, height, neighbours);
+}
+
+Topology CreateCustomTopology(const int width, const int height, const std::vector<std::vector<int>> &neighbours) {
+    CheckTopologySize(width, height);
+    const int size = width*height;
+    if (static_cast<int>(neighbours.size()) != size) {
+        throw std::runtime_error(fmt::format(
+            "Expected neighbours for {} cells, got {}", 
+            size, neighbours.size()));
+    }
+    for (int i = 0; i < size; i++) {
+        for (int j: neighbours[i]) {
+            if ((j < 0) || (j >= size) || (j == i)) {
+                throw std::runtime_error(fmt::format("Invalid neighbour {} of cell {}", j, i));
+            }
+        }
+    }
+    return CreateTopology(TopologyType::TOPOLOGY_CUSTOM, width, height, neighbours);
+}
 
-    delete[] tracker;
-    delete[] word_stack;
-    delete[] cursor_stack;
+bool IsSameTopology(const Topology &a, const Topology &b) {
+    return (a.type == b.type) && 
+           (a.width == b.width) && (a.height == b.height) && 
+           (a.offsets == b.offsets) && (a.adjacency == b.adjacency);
+}
+
+BoardMasks CreateBoardMasks(const Grid &grid) {
+    BoardMasks masks;
+    FillBoardMasks(grid, masks);
+    return masks;
+}
+
+void FillBoardMasks(const Grid &grid, BoardMasks &masks) {
+    masks.letters.resize(grid.size);
+    masks.neighbour_letters.resize(grid.size);
+
+    for (int i = 0; i < grid.size; i++) {
+        masks.letters[i] = FindIndex(grid.characters[i]);
+    }
+
+    auto &topology = grid.topology;
+    for (int i = 0; i < grid.size; i++) {
+        uint32_t letters = 0;
+        for (int j = topology.offsets[i]; j < topology.offsets[i+1]; j++) {
+            letters |= (1u << masks.letters[topology.adjacency[j]]);
+        }
+        masks.neighbour_letters[i] = letters;
+    }
+}
+
+ScoreTable CreateScoreTable(const Grid &grid) {
+    ScoreTable scores;
+    FillScoreTable(grid, scores);
+    return scores;
+}
+
+void FillScoreTable(const Grid &grid, ScoreTable &scores) {
+    scores.letter_scores.resize(grid.size);
+    scores.word_multipliers.resize(grid.size);
+
+    for (int i = 0; i < grid.size; i++) {
+        const auto cell = grid.GetCell(i);
+        int letter_score = 0;
+        int word_multiplier = 1;
+
+        switch (cell.modifier) {
+        case CellModifier::MOD_NONE:
+            letter_score = cell.value;
+            break;
+        case CellModifier::MOD_2L:
+            letter_score = 2*cell.value;
+            break;
+        case CellModifier::MOD_3L:
+            letter_score = 3*cell.value;
+            break;
+        case CellModifier::MOD_2W:
+            word_multiplier = 2;
+            break;
+        case CellModifier::MOD_3W:
+            word_multiplier = 3;
+            break;
+        default:
+            break;
+        }
+
+        scores.letter_scores[i] = letter_score;
+        scores.word_multipliers[i] = word_multiplier;
+    }
+}
+
+// moves the results into the order of a single search, which is by start cell
+// with a counting sort that swaps in place so the result buffers are kept
+static void SortByStartCell(
+    std::vector<SearchResult> &results, const int width, const int size,
+    std::vector<uint32_t> &counts, std::vector<uint32_t> &order)
+{
+    counts.assign(size+1, 0);
+    for (auto &r: results) {
+        counts[r.path[0].x + width*r.path[0].y + 1]++;
+    }
+    for (int i = 0; i < size; i++) {
+        counts[i+1] += counts[i];
+    }
+    order.resize(results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        auto &start = results[i].path[0];
+        order[i] = counts[start.x + width*start.y]++;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        while (order[i] != i) {
+            const uint32_t j = order[i];
+            std::swap(results[i], results[j]);
+            std::swap(order[i], order[j]);
+        }
+    }
+}
+
+static void SearchWordTreeWithArena(
+    NodePool &pool, const Grid &grid,
+    SearchArena &arena, std::vector<SearchResult> &results)
+{
+    const int size = grid.size;
+    FillScoreTable(grid, arena.scores);
+    FillBoardMasks(grid, arena.masks);
+    arena.results.Recycle(results);
+
+    // each start cell is searched by one of the interleaved searches
+    const int total_searches = std::min(TOTAL_INTERLEAVED_SEARCHES, size);
+    const int max_length = std::min(GetMaxWordLength(pool), size);
+    const int stack_size = max_length+1;
+    arena.visited.assign(total_searches*size, 0);
+    arena.word_stack.assign(total_searches*stack_size, 0);
+    arena.cursor_stack.assign(total_searches*stack_size, {-1,-1});
+    arena.frames.resize(total_searches*stack_size);
+
+    BoardSearch s = {
+        pool, grid.topology, grid.characters, arena.scores, arena.masks,
+        results, arena.results
+    };
+
+    const Node &root = pool[0];
+    const auto &masks = arena.masks;
+    int next_start = 0;
+    const auto StartSearch = [&](InterleavedSearch &c) {
+        for (; next_start < size; next_start++) {
+            const uint8_t letter = masks.letters[next_start];
+            if (((root.child_mask >> letter) & 1u) == 0) {
+                WORDBLITZ_STAT(GetSearchStats().child_misses++);
+                continue;
+            }
+            c.start_cell = next_start;
+            c.next_node = root.children[letter];
+            c.next_cell = next_start++;
+            PrefetchNode(&pool[c.next_node]);
+            return true;
+        }
+        return false;
+    };
+
+    InterleavedSearch searches[TOTAL_INTERLEAVED_SEARCHES];
+    int total_active = 0;
+    for (int k = 0; k < total_searches; k++) {
+        auto &c = searches[total_active];
+        c.depth = 0;
+        c.frames = &arena.frames[k*stack_size];
+        c.visited = &arena.visited[k*size];
+        c.word_stack = &arena.word_stack[k*stack_size];
+        c.cursor_stack = &arena.cursor_stack[k*stack_size];
+        if (StartSearch(c)) {
+            total_active++;
+        }
+    }
+
+    // every search enters the node it prefetched on its last turn, then picks and prefetches the next one
+    // finished searches are swapped out with the last active one
+    while (total_active > 0) {
+        for (int k = 0; k < total_active;) {
+            auto &c = searches[k];
+            WORDBLITZ_STAT(const int start_cell = c.start_cell);
+            WORDBLITZ_STAT(const auto step_start = std::chrono::steady_clock::now());
+            EnterNextNode(s, c);
+            const bool is_active = AdvanceSearch(s, c) || StartSearch(c);
+            WORDBLITZ_STAT(AddStartCellTime(start_cell, step_start));
+            if (is_active) {
+                k++;
+            } else {
+                std::swap(c, searches[--total_active]);
+            }
+        }
+    }
+
+    if (total_searches > 1) {
+        SortByStartCell(results, grid.width, size, arena.start_counts, arena.order);
+    }
+}
+
+std::vector<SearchResult> SearchWordTree(NodePool &pool, const Grid &grid) {
+    // a one off search doesn't reserve buffers, since they won't be reused
+    SearchArena arena;
+    std::vector<SearchResult> results;
+    SearchWordTreeWithArena(pool, grid, arena, results);
     return results;
 }
 
+void SearchWordTree(
+    NodePool &pool, const Grid &grid,
+    SearchArena &arena, std::vector<SearchResult> &results)
+{
+    arena.results.SetReserveLength(GetMaxWordLength(pool));
+    SearchWordTreeWithArena(pool, grid, arena, results);
+}
+
 int GetPathValue(const Grid &grid, std::vector<Cursor> &path) {
     int multiplier = 1;
     int total_value = 0;
@@ -141,38 +486,465 @@ int GetPathValue(const Grid &grid, std::vector<Cursor> &path) {
     return (multiplier * total_value) + static_cast<int>(path.size());
 }
 
-std::vector<TraceResult> GetTraceFromSearch(Grid &grid, std::vector<SearchResult> &searches) {
-    std::unordered_map<std::string, TraceResult> unique_traces;
-    for (auto &search: searches) {
-        auto &path = search.path;
-        auto &word = search.word;
-        int value = GetPathValue(grid, path);
-        // default place
-        if (unique_traces.find(word) == unique_traces.end()) {
-            unique_traces.insert({word, {path, word, value, TraceStatus::INCOMPLETE}});
+std::vector<TraceResult> GetTraceFromSearch(std::vector<SearchResult> &searches) {
+    SearchArena arena;
+    std::vector<TraceResult> traces;
+    GetTraceFromSearch(searches, arena, traces);
+    return traces;
+}
+
+void GetTraceFromSearch(
+    const std::vector<SearchResult> &searches,
+    SearchArena &arena, std::vector<TraceResult> &traces)
+{
+    // sorting by word puts all the paths of a word next to each other without a lookup
+    // the first path found is kept out of paths with the same value
+    auto &order = arena.order;
+    order.resize(searches.size());
+    for (uint32_t i = 0; i < static_cast<uint32_t>(searches.size()); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&searches](const uint32_t a, const uint32_t b) {
+        const int cmp = searches[a].word.compare(searches[b].word);
+        if (cmp != 0) {
+            return cmp < 0;
+        }
+        if (searches[a].value != searches[b].value) {
+            return searches[a].value > searches[b].value;
+        }
+        return a < b;
+    });
+
+    // keep the best path of each word at the front
+    size_t total_words = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if ((i > 0) && (searches[order[i]].word == searches[order[total_words-1]].word)) {
+            WORDBLITZ_STAT(GetSearchStats().duplicates_dropped++);
             continue;
         }
+        order[total_words++] = order[i];
+    }
+    order.resize(total_words);
+
+    // create a vector of value sorted results
+    std::sort(order.begin(), order.end(), [&searches](const uint32_t a, const uint32_t b) {
+        return searches[a].value > searches[b].value;
+    });
 
-        // get the trace if it exists, and replace if we have a better value
-        auto &prev_trace = unique_traces.at(word);
-        if (prev_trace.value >= value) {
+    arena.traces.SetReserveLength(arena.results.GetReserveLength());
+    arena.traces.Recycle(traces);
+    for (uint32_t i: order) {
+        auto &search = searches[i];
+        auto &trace = arena.traces.Push(traces);
+        trace.path.assign(search.path.begin(), search.path.end());
+        trace.word.assign(search.word);
+        trace.value = search.value;
+        trace.status = TraceStatus::INCOMPLETE;
+        trace.confidence = search.confidence;
+    }
+}
+
+// state shared by every level of the lattice search
+struct LatticeSearch {
+    NodePool &pool;
+    const Topology &topology;
+    const ScoreTable &scores;
+    const LetterLattice &lattice;
+    // candidate letters of the neighbours of each cell
+    std::vector<uint32_t> neighbour_letters;
+    float min_confidence;
+
+    std::vector<uint8_t> visited;
+    std::vector<char> word_stack;
+    std::vector<Cursor> cursor_stack;
+    std::vector<SearchResult> &results;
+};
+
+static void RecursiveSearchWordTreeLattice(
+    LatticeSearch &s, const Node &node,
+    const int cell_index, const char c,
+    int depth, int letter_sum, int word_multiplier, float confidence)
+{
+    // push
+    const int width = s.topology.width;
+    s.word_stack[depth] = c;
+    s.cursor_stack[depth] = {cell_index % width, cell_index / width};
+    letter_sum += s.scores.letter_scores[cell_index];
+    word_multiplier *= s.scores.word_multipliers[cell_index];
+    if (node.is_leaf) {
+        SearchResult r = {
+            {s.cursor_stack.data(), s.cursor_stack.data()+depth+1},
+            {s.word_stack.data(), s.word_stack.data()+depth+1},
+            word_multiplier*letter_sum + depth+1,
+            confidence
+        };
+        s.results.emplace_back(r);
+    }
+
+    if ((node.child_mask & s.neighbour_letters[cell_index]) == 0) {
+        return;
+    }
+
+    s.visited[cell_index] = 1;
+    auto &topology = s.topology;
+    for (int j = topology.offsets[cell_index]; j < topology.offsets[cell_index+1]; j++) {
+        const int next_cell_index = topology.adjacency[j];
+        if (s.visited[next_cell_index]) {
             continue;
         }
+        // candidates are sorted, so the rest are even less likely
+        for (auto &candidate: s.lattice.cells[next_cell_index]) {
+            const float next_confidence = confidence*candidate.probability;
+            if (next_confidence < s.min_confidence) {
+                break;
+            }
+            const uint8_t letter = FindIndex(candidate.c);
+            if (((node.child_mask >> letter) & 1u) == 0) {
+                continue;
+            }
+            RecursiveSearchWordTreeLattice(
+                s, s.pool[node.children[letter]],
+                next_cell_index, candidate.c,
+                depth+1, letter_sum, word_multiplier, next_confidence);
+        }
+    }
+    s.visited[cell_index] = 0;
+}
 
-        unique_traces.insert({word, {path, word, value, TraceStatus::INCOMPLETE}});
+std::vector<SearchResult> SearchWordTreeLattice(
+    NodePool &pool, const Grid &grid, 
+    const LetterLattice &lattice, const float min_confidence)
+{
+    const int size = grid.size;
+    if (static_cast<int>(lattice.cells.size()) != size) {
+        throw std::runtime_error(fmt::format(
+            "Lattice has {} cells but the board has {}", 
+            lattice.cells.size(), size));
     }
 
-    // create a vector of value sorted results
-    std::vector<TraceResult> traces;
-    for (auto &[word, trace]: unique_traces) {
-        traces.emplace_back(std::move(trace));
+    std::vector<SearchResult> results;
+    const ScoreTable scores = CreateScoreTable(grid);
+
+    std::vector<uint32_t> cell_letters(size, 0);
+    for (int i = 0; i < size; i++) {
+        for (auto &candidate: lattice.cells[i]) {
+            cell_letters[i] |= (1u << FindIndex(candidate.c));
+        }
+    }
+
+    auto &topology = grid.topology;
+    std::vector<uint32_t> neighbour_letters(size, 0);
+    for (int i = 0; i < size; i++) {
+        for (int j = topology.offsets[i]; j < topology.offsets[i+1]; j++) {
+            neighbour_letters[i] |= cell_letters[topology.adjacency[j]];
+        }
+    }
+
+    const int max_length = std::min(GetMaxWordLength(pool), size);
+    LatticeSearch s = {
+        pool, topology, scores, lattice,
+        std::move(neighbour_letters), min_confidence,
+        std::vector<uint8_t>(size, 0),
+        std::vector<char>(max_length+1, 0),
+        std::vector<Cursor>(max_length+1, {-1,-1}),
+        results
+    };
+
+    const Node &root = pool[0];
+    for (int i = 0; i < size; i++) {
+        for (auto &candidate: lattice.cells[i]) {
+            if (candidate.probability < min_confidence) {
+                break;
+            }
+            const uint8_t letter = FindIndex(candidate.c);
+            if (((root.child_mask >> letter) & 1u) == 0) {
+                continue;
+            }
+            RecursiveSearchWordTreeLattice(
+                s, pool[root.children[letter]],
+                i, candidate.c,
+                0, 0, 1, candidate.probability);
+        }
+    }
+
+    return results;
+}
+
+// we only check the clock periodically since it is expensive compared to a node visit
+constexpr int TOPK_CLOCK_CHECK_INTERVAL = 256;
+
+// state shared by every level of the branch and bound search
+struct TopKSearch {
+    NodePool &pool;
+    const Grid &grid;
+    const ScoreTable &scores;
+    const BoardMasks &masks;
+    // cells ordered by descending contributions for the upper bound
+    std::vector<int> letter_order;
+    std::vector<int> multiplier_order;
+
+    std::vector<uint8_t> visited;
+    std::vector<char> word_stack;
+    std::vector<Cursor> cursor_stack;
+
+    // min heap on value, entries are unique by their leaf node
+    struct Entry {
+        uint32_t node_index;
+        TraceResult trace;
+    };
+    std::vector<Entry> heap;
+    // slot in the heap of each leaf node which has an entry
+    std::unordered_map<uint32_t, size_t> heap_slots;
+    size_t max_results = 0;
+
+    std::chrono::steady_clock::time_point deadline = {};
+    bool has_deadline = false;
+    bool is_expired = false;
+    int nodes_until_clock_check = TOPK_CLOCK_CHECK_INTERVAL;
+
+    TopKSearch(NodePool &_pool, const Grid &_grid, const ScoreTable &_scores, const BoardMasks &_masks)
+    : pool(_pool), grid(_grid), scores(_scores), masks(_masks)
+    {}
+};
+
+static bool CompareHeapEntry(const TopKSearch::Entry &a, const TopKSearch::Entry &b) {
+    return a.trace.value > b.trace.value;
+}
+
+// lowest value a new word needs to beat to enter the heap
+static int GetHeapThreshold(const TopKSearch &s) {
+    if (s.heap.size() < s.max_results) {
+        return -1;
+    }
+    return s.heap.front().trace.value;
+}
+
+// best possible score if the word is extended by another remaining_depth unvisited cells
+static int GetUpperBound(
+    const TopKSearch &s,
+    const int length, const int letter_sum, const int word_multiplier, 
+    const int remaining_depth) 
+{
+    int best_letter_sum = letter_sum;
+    int best_multiplier = word_multiplier;
+    int best_length = length;
+
+    int n = 0;
+    for (int i: s.letter_order) {
+        if (n >= remaining_depth) break;
+        if (s.visited[i]) continue;
+        best_letter_sum += s.scores.letter_scores[i];
+        best_length++;
+        n++;
+    }
+
+    n = 0;
+    for (int i: s.multiplier_order) {
+        if (n >= remaining_depth) break;
+        if (s.visited[i]) continue;
+        best_multiplier *= s.scores.word_multipliers[i];
+        n++;
+    }
+
+    return best_multiplier*best_letter_sum + best_length;
+}
+
+static void SwapHeapEntries(TopKSearch &s, const size_t a, const size_t b) {
+    std::swap(s.heap[a], s.heap[b]);
+    s.heap_slots[s.heap[a].node_index] = a;
+    s.heap_slots[s.heap[b].node_index] = b;
+}
+
+static void SiftHeapUp(TopKSearch &s, size_t slot) {
+    while (slot > 0) {
+        const size_t parent = (slot-1) / 2;
+        if (!CompareHeapEntry(s.heap[parent], s.heap[slot])) {
+            break;
+        }
+        SwapHeapEntries(s, parent, slot);
+        slot = parent;
+    }
+}
+
+static void SiftHeapDown(TopKSearch &s, size_t slot) {
+    const size_t size = s.heap.size();
+    while (true) {
+        size_t lowest = slot;
+        for (size_t child = 2*slot+1; (child <= 2*slot+2) && (child < size); child++) {
+            if (CompareHeapEntry(s.heap[lowest], s.heap[child])) {
+                lowest = child;
+            }
+        }
+        if (lowest == slot) {
+            break;
+        }
+        SwapHeapEntries(s, slot, lowest);
+        slot = lowest;
+    }
+}
+
+static void PushTopKResult(TopKSearch &s, uint32_t node_index, const int length, const int value) {
+    if (value <= GetHeapThreshold(s)) {
+        return;
+    }
+
+    auto CreateTrace = [&]() -> TraceResult {
+        return {
+            {s.cursor_stack.data(), s.cursor_stack.data()+length},
+            {s.word_stack.data(), s.word_stack.data()+length},
+            value, TraceStatus::INCOMPLETE
+        };
+    };
+
+    // replace a worse path for the same word, which can only move it down the min heap
+    auto it = s.heap_slots.find(node_index);
+    if (it != s.heap_slots.end()) {
+        const size_t slot = it->second;
+        if (s.heap[slot].trace.value < value) {
+            s.heap[slot].trace = CreateTrace();
+            SiftHeapDown(s, slot);
+        }
+        return;
+    }
+
+    // evict the lowest value
+    if (s.heap.size() >= s.max_results) {
+        SwapHeapEntries(s, 0, s.heap.size()-1);
+        s.heap_slots.erase(s.heap.back().node_index);
+        s.heap.pop_back();
+        SiftHeapDown(s, 0);
+    }
+    s.heap.push_back({node_index, CreateTrace()});
+    s.heap_slots[node_index] = s.heap.size()-1;
+    SiftHeapUp(s, s.heap.size()-1);
+}
+
+static void RecursiveSearchWordTreeTopK(
+    TopKSearch &s, const uint32_t node_index,
+    const int cell_index,
+    int depth, int letter_sum, int word_multiplier)
+{
+    if (s.is_expired) {
+        return;
+    }
+
+    if (s.has_deadline && (--s.nodes_until_clock_check <= 0)) {
+        s.nodes_until_clock_check = TOPK_CLOCK_CHECK_INTERVAL;
+        if (std::chrono::steady_clock::now() >= s.deadline) {
+            s.is_expired = true;
+            return;
+        }
+    }
+
+    // push
+    const int width = s.grid.width;
+    s.word_stack[depth] = s.grid.characters[cell_index];
+    s.cursor_stack[depth] = {cell_index % width, cell_index / width};
+    letter_sum += s.scores.letter_scores[cell_index];
+    word_multiplier *= s.scores.word_multipliers[cell_index];
+    const int length = depth+1;
+
+    const Node &node = s.pool[node_index];
+    if (node.is_leaf) {
+        PushTopKResult(s, node_index, length, word_multiplier*letter_sum + length);
     }
 
-    std::sort(traces.begin(), traces.end(), [](const TraceResult &a, const TraceResult &b) {
-        return a.value > b.value;
+    // prune if no extension of this prefix can make it into the heap
+    const bool is_prunable = 
+        (node.max_depth == 0) ||
+        (GetUpperBound(s, length, letter_sum, word_multiplier, node.max_depth) <= GetHeapThreshold(s));
+    if (is_prunable) {
+        return;
+    }
+
+    const uint32_t letters = node.child_mask & s.masks.neighbour_letters[cell_index];
+    if (letters == 0) {
+        return;
+    }
+
+    s.visited[cell_index] = 1;
+    auto &topology = s.grid.topology;
+    for (int j = topology.offsets[cell_index]; j < topology.offsets[cell_index+1]; j++) {
+        const int next_cell_index = topology.adjacency[j];
+        const uint8_t letter = s.masks.letters[next_cell_index];
+        if (s.visited[next_cell_index] || (((letters >> letter) & 1u) == 0)) {
+            continue;
+        }
+        RecursiveSearchWordTreeTopK(
+            s, node.children[letter],
+            next_cell_index,
+            depth+1, letter_sum, word_multiplier);
+    }
+    s.visited[cell_index] = 0;
+}
+
+std::vector<TraceResult> SearchWordTreeTopK(
+    NodePool &pool, const Grid &grid, 
+    const SearchLimits &limits, bool *is_complete) 
+{
+    const auto start = std::chrono::steady_clock::now();
+    const int size = grid.size;
+    const ScoreTable scores = CreateScoreTable(grid);
+    const BoardMasks masks = CreateBoardMasks(grid);
+
+    const auto max_results = (limits.max_results > 0) ? 
+        static_cast<size_t>(limits.max_results) : 
+        std::numeric_limits<size_t>::max();
+
+    TopKSearch s(pool, grid, scores, masks);
+    s.max_results = max_results;
+    s.has_deadline = limits.time_budget.count() > 0;
+    s.deadline = start + limits.time_budget;
+
+    for (int i = 0; i < size; i++) {
+        s.letter_order.push_back(i);
+        s.multiplier_order.push_back(i);
+    }
+    std::stable_sort(s.letter_order.begin(), s.letter_order.end(), [&scores](int a, int b) {
+        return scores.letter_scores[a] > scores.letter_scores[b];
     });
+    std::stable_sort(s.multiplier_order.begin(), s.multiplier_order.end(), [&scores](int a, int b) {
+        return scores.word_multipliers[a] > scores.word_multipliers[b];
+    });
+
+    const int max_length = std::min(GetMaxWordLength(pool), size);
+    s.visited.assign(size, 0);
+    s.word_stack.assign(max_length+1, 0);
+    s.cursor_stack.assign(max_length+1, {-1,-1});
+
+    // start from the most valuable cells so that good words are found before the deadline
+    std::vector<int> start_order(size);
+    for (int i = 0; i < size; i++) {
+        start_order[i] = i;
+    }
+    std::stable_sort(start_order.begin(), start_order.end(), [&scores](int a, int b) {
+        return scores.letter_scores[a]*scores.word_multipliers[a] > 
+               scores.letter_scores[b]*scores.word_multipliers[b];
+    });
+
+    const Node &root = pool[0];
+    for (int i: start_order) {
+        const uint8_t letter = masks.letters[i];
+        if (((root.child_mask >> letter) & 1u) == 0) {
+            continue;
+        }
+        RecursiveSearchWordTreeTopK(s, root.children[letter], i, 0, 0, 1);
+        if (s.is_expired) {
+            break;
+        }
+    }
+
+    if (is_complete != nullptr) {
+        *is_complete = !s.is_expired;
+    }
 
+    std::sort_heap(s.heap.begin(), s.heap.end(), CompareHeapEntry);
+    std::vector<TraceResult> traces;
+    traces.reserve(s.heap.size());
+    for (auto &entry: s.heap) {
+        traces.emplace_back(std::move(entry.trace));
+    }
     return traces;
 }
 
-}
\ No newline at end of file
+}
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "wordtree.h"
+#include <stdint.h>
+#include <algorithm>
 #include <vector>
+#include <chrono>
 
 namespace wordblitz {
 
@@ -13,6 +16,9 @@ struct Cursor {
 struct SearchResult {
     std::vector<Cursor> path;
     std::string word;
+    int value;
+    // joint probability of the letters on the path, which is only below 1 for lattice searches
+    float confidence = 1.0f;
 };
 
 enum CellModifier {
@@ -34,18 +40,65 @@ struct TraceResult {
     std::string word;
     int value;
     TraceStatus status;
+    float confidence = 1.0f;
+};
+
+// a letter which the recognizer thinks a cell could hold
+struct LetterCandidate {
+    char c;
+    float probability;
+};
+
+// candidate letters of each cell, most likely first
+struct LetterLattice {
+    std::vector<std::vector<LetterCandidate>> cells;
+};
+
+enum TopologyType {
+    TOPOLOGY_GRID, TOPOLOGY_TORUS, TOPOLOGY_HEX, TOPOLOGY_CUSTOM
+};
+
+// cells are laid out row by row in a width*height board
+// the neighbours of cell i are adjacency[offsets[i]] to adjacency[offsets[i+1]-1]
+struct Topology {
+    TopologyType type;
+    int width;
+    int height;
+    std::vector<int> offsets;
+    std::vector<int> adjacency;
+
+    int GetSize() const {
+        return width*height;
+    }
 };
 
+// 8-connected rectangle
+Topology CreateGridTopology(const int width, const int height);
+// 8-connected rectangle whose edges wrap around
+Topology CreateTorusTopology(const int width, const int height);
+// 6-connected hexagons where odd rows are shifted half a cell to the right
+Topology CreateHexTopology(const int width, const int height);
+// neighbours[i] lists the cells adjacent to cell i
+Topology CreateCustomTopology(const int width, const int height, const std::vector<std::vector<int>> &neighbours);
+bool IsSameTopology(const Topology &a, const Topology &b);
+
 struct Grid {
     char *characters;
     int *values;
     CellModifier *modifiers;
-    const int sqrt_size;
+    const Topology topology;
+    const int width;
+    const int height;
     const int size;
-    Grid(int _sqrt_size)
-    : sqrt_size(_sqrt_size), size(_sqrt_size*_sqrt_size)
+    Grid(int sqrt_size)
+    : Grid(CreateGridTopology(sqrt_size, sqrt_size))
+    {}
+
+    Grid(const Topology &_topology)
+    : topology(_topology), 
+      width(_topology.width), height(_topology.height), 
+      size(_topology.GetSize())
     {
-        int size = sqrt_size*sqrt_size;
         characters = new char[size]{0};
         values = new int[size]{0};
         modifiers = new CellModifier[size]{MOD_NONE};
@@ -66,12 +119,176 @@ struct Grid {
     }
 
     int GetIndex(const int x, const int y) const {
-        return x + sqrt_size*y;
+        return x + width*y;
     }
 };
 
-std::vector<SearchResult> SearchWordTree(wordtree::NodePool &pool, const char *grid, const int sqrt_size);
+// per cell score contributions which are precomputed once per board
+// letter_scores holds value*letter_multiplier, word_multipliers holds 1, 2 or 3
+struct ScoreTable {
+    std::vector<int> letter_scores;
+    std::vector<int> word_multipliers;
+};
+
+ScoreTable CreateScoreTable(const Grid &grid);
+// refills the table in place so its buffers are reused
+void FillScoreTable(const Grid &grid, ScoreTable &scores);
+
+// per board lookup tables used to expand a search node without touching dead end children
+struct BoardMasks {
+    // letter index of each cell
+    std::vector<uint8_t> letters;
+    // letters held by the neighbours of each cell
+    std::vector<uint32_t> neighbour_letters;
+};
+
+BoardMasks CreateBoardMasks(const Grid &grid);
+void FillBoardMasks(const Grid &grid, BoardMasks &masks);
+
+// words can't be longer than the deepest branch of the dictionary
+inline int GetMaxWordLength(const wordtree::NodePool &pool) {
+    return pool[0].max_depth;
+}
+
+// search results are scored during the search
+std::vector<SearchResult> SearchWordTree(wordtree::NodePool &pool, const Grid &grid);
 int GetPathValue(const Grid &grid, std::vector<Cursor> &path);
-std::vector<TraceResult> GetTraceFromSearch(Grid &grid, std::vector<SearchResult> &searches);
+std::vector<TraceResult> GetTraceFromSearch(std::vector<SearchResult> &searches);
+
+// keeps the results dropped from a vector so the buffers of their path and word can be reused
+// buffers are reserved for the longest word, and vectors for the most results seen,
+// so refilling them never allocates
+template <typename T>
+class ResultRecycler
+{
+private:
+    std::vector<T> m_spare;
+    size_t m_reserve_length = 0;
+    size_t m_reserve_size = 0;
+public:
+    void SetReserveLength(const size_t length) {
+        m_reserve_length = std::max(m_reserve_length, length);
+    }
+    size_t GetReserveLength() const { return m_reserve_length; }
+
+    // moves the results from first onwards into the spares
+    // and grows the vector to fit as many results as it has ever been refilled with
+    void Recycle(std::vector<T> &results, const size_t first=0) {
+        for (size_t i = first; i < results.size(); i++) {
+            m_spare.push_back(std::move(results[i]));
+        }
+        results.erase(results.begin()+first, results.end());
+        results.reserve(m_reserve_size);
+    }
+
+    // appends a result with a spare buffer when there is one
+    T& Push(std::vector<T> &results) {
+        m_reserve_size = std::max(m_reserve_size, results.size()+1);
+        if (results.size() == results.capacity()) {
+            results.reserve(std::max(m_reserve_size, 2*results.size()));
+        }
+        if (m_spare.empty()) {
+            results.emplace_back();
+        } else {
+            results.push_back(std::move(m_spare.back()));
+            m_spare.pop_back();
+        }
+        auto &r = results.back();
+        r.path.reserve(m_reserve_length);
+        r.word.reserve(m_reserve_length);
+        return r;
+    }
+};
+
+// a level of one of the interleaved depth first searches
+struct SearchFrame {
+    uint32_t node;
+    int cell;
+    // next adjacency entry of the cell to try
+    int next;
+    uint32_t letters;
+    int letter_sum;
+    int word_multiplier;
+};
+
+// buffers which are kept between searches, so a search and building its traces
+// don't allocate once the buffers have grown to fit the largest board
+struct SearchArena {
+    ScoreTable scores;
+    BoardMasks masks;
+    // one board and stack per interleaved search
+    std::vector<uint8_t> visited;
+    std::vector<char> word_stack;
+    std::vector<Cursor> cursor_stack;
+    std::vector<SearchFrame> frames;
+    // results of each start cell, used to put the interleaved results back in order
+    std::vector<uint32_t> start_counts;
+    // search results sorted by word when building traces
+    std::vector<uint32_t> order;
+    ResultRecycler<SearchResult> results;
+    ResultRecycler<TraceResult> traces;
+};
+
+// same as above, but results are refilled in place
+void SearchWordTree(
+    wordtree::NodePool &pool, const Grid &grid,
+    SearchArena &arena, std::vector<SearchResult> &results);
+// same as above, but traces are refilled in place
+void GetTraceFromSearch(
+    const std::vector<SearchResult> &searches,
+    SearchArena &arena, std::vector<TraceResult> &traces);
+
+// search where each cell can be any of its candidate letters in the lattice
+// the letters of the grid are ignored, and paths whose confidence drops below min_confidence are pruned
+std::vector<SearchResult> SearchWordTreeLattice(
+    wordtree::NodePool &pool, const Grid &grid, 
+    const LetterLattice &lattice, const float min_confidence);
+
+// counters from inside the searches, which only count when built with WORDBLITZ_SEARCH_STATS
+// otherwise the counting compiles to nothing and every counter stays at zero
+#ifdef WORDBLITZ_SEARCH_STATS
+#define WORDBLITZ_STAT(...) __VA_ARGS__
+#else
+#define WORDBLITZ_STAT(...)
+#endif
+
+struct SearchStats {
+    uint64_t nodes_entered = 0;
+    // neighbours whose letter isn't a child of the node, a dead end counts once
+    uint64_t child_misses = 0;
+    int max_depth = 0;
+    uint64_t results = 0;
+    // paths dropped for a better path of the same word
+    uint64_t duplicates_dropped = 0;
+    // microseconds spent on the paths starting from each cell
+    std::vector<float> start_cell_us;
+};
+
+// counters of the calling thread, which accumulate until they are reset
+SearchStats& GetSearchStats();
+void ResetSearchStats();
+void AddStartCellTime(const int cell_index, const std::chrono::steady_clock::time_point start);
+
+inline void CountSearchNode(const int depth) {
+    auto &stats = GetSearchStats();
+    stats.nodes_entered++;
+    if (stats.max_depth < depth+1) {
+        stats.max_depth = depth+1;
+    }
+}
+
+// bounds for an anytime search
+// max_results = 0 keeps every unique word
+// time_budget = 0 runs the search to completion
+struct SearchLimits {
+    int max_results = 0;
+    std::chrono::microseconds time_budget{0};
+};
+
+// branch and bound search which keeps the best unique words in a bounded heap
+// returns value sorted traces, which are the best found so far if the time budget expires
+std::vector<TraceResult> SearchWordTreeTopK(
+    wordtree::NodePool &pool, const Grid &grid, 
+    const SearchLimits &limits, bool *is_complete=nullptr);
 
 }
@@ -1,34 +1,45 @@
 #pragma once
 
+#include <vector>
 #include "model.h"
 #include "wordblitz.h"
 
 class ValuesModel: public Model 
 {
 private:
-    int m_pred;
+    // prediction of each crop in the batch
+    std::vector<int> m_preds;
 public:
-    ValuesModel(const char *filepath);
-    void Parse() override;
-    int GetPrediction() const { return m_pred; }
+    ValuesModel(const char *filepath, const ModelEngine engine=GetDefaultModelEngine());
+    int GetPrediction(const int index=0) const { return m_preds[index]; }
+protected:
+    void ParseOutput(const ModelOutput &output, const int index) override;
 };
 
 class CharacterModel: public Model
 {
 private:
-    char m_char;
+    std::vector<char> m_chars;
+    // most likely letters first, only the best letter by default
+    // which skips the softmax and leaves its probability at 1
+    int m_total_candidates;
+    std::vector<std::vector<wordblitz::LetterCandidate>> m_candidates;
 public:
-    CharacterModel(const char *filepath);
-    void Parse() override;
-    char GetPrediction() const { return m_char; }
+    CharacterModel(const char *filepath, const ModelEngine engine=GetDefaultModelEngine());
+    char GetPrediction(const int index=0) const { return m_chars[index]; }
+    void SetTotalCandidates(const int total_candidates);
+    const std::vector<wordblitz::LetterCandidate>& GetCandidates(const int index=0) const { return m_candidates[index]; }
+protected:
+    void ParseOutput(const ModelOutput &output, const int index) override;
 };
 
 class BonusesModel: public Model 
 {
 private:
-    wordblitz::CellModifier m_pred;
+    std::vector<wordblitz::CellModifier> m_preds;
 public:
-    BonusesModel(const char *filepath);
-    void Parse() override;
-    wordblitz::CellModifier GetPrediction() const { return m_pred; }
+    BonusesModel(const char *filepath, const ModelEngine engine=GetDefaultModelEngine());
+    wordblitz::CellModifier GetPrediction(const int index=0) const { return m_preds[index]; }
+protected:
+    void ParseOutput(const ModelOutput &output, const int index) override;
 };
\ No newline at end of file
@@ -1,22 +1,11 @@
 #include "wordblitz_model.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
 #include <fmt/core.h>
 
-int argmax(const float *arr, const int N) {
-    float max_val = arr[0];
-    int max_index = 0; 
-    for (int i = 1; i < N; i++) {
-        const float v = arr[i];
-        if (v > max_val) {
-            max_val = v;
-            max_index = i;
-        }
-    }
-    return max_index;
-}
-
-ValuesModel::ValuesModel(const char *filepath)
-: Model(filepath)
+ValuesModel::ValuesModel(const char *filepath, const ModelEngine engine)
+: Model(filepath, engine)
 {
     if (GetOutputSize() != 22) {
         throw std::runtime_error(fmt::format(
@@ -24,23 +13,23 @@ ValuesModel::ValuesModel(const char *filepath)
             GetOutputSize(), 22
         ));
     }
-    m_pred = 0;
+    m_preds.assign(1, 0);
 }
 
-void ValuesModel::Parse() {
-    Model::Parse();
-    bool is_single_digit = argmax(m_output_buffer, 2) == 1;
-    int left  = argmax(m_output_buffer+2   , 10);
-    int right = argmax(m_output_buffer+2+10, 10);
+void ValuesModel::ParseOutput(const ModelOutput &output, const int index) {
+    m_preds.resize(GetBatchSize(), 0);
+    bool is_single_digit = output.ArgMax(0, 2) == 1;
+    int left  = output.ArgMax(2   , 10);
+    int right = output.ArgMax(2+10, 10);
     if (is_single_digit) {
-        m_pred = right;
+        m_preds[index] = right;
     } else {
-        m_pred = left*10 + right;
+        m_preds[index] = left*10 + right;
     }
 }
 
-CharacterModel::CharacterModel(const char *filepath)
-: Model(filepath)
+CharacterModel::CharacterModel(const char *filepath, const ModelEngine engine)
+: Model(filepath, engine)
 {
     if (GetOutputSize() != 26) {
         throw std::runtime_error(fmt::format(
@@ -48,17 +37,71 @@ CharacterModel::CharacterModel(const char *filepath)
             GetOutputSize(), 26
         ));
     }
-    m_char = 0;
+    m_total_candidates = 1;
+    m_chars.assign(1, 0);
+    m_candidates.resize(1);
 }
 
-void CharacterModel::Parse() {
-    Model::Parse();
-    int i = argmax(m_output_buffer, 26);
-    m_char = 'a' + i;
+void CharacterModel::SetTotalCandidates(const int total_candidates) {
+    m_total_candidates = std::max(1, std::min(total_candidates, 26));
+}
+
+void CharacterModel::ParseOutput(const ModelOutput &output, const int index) {
+    m_chars.resize(GetBatchSize(), 0);
+    m_candidates.resize(GetBatchSize());
+    int i = output.ArgMax(0, 26);
+    m_chars[index] = 'a' + i;
+
+    // the best letter alone doesn't need probabilities, since the lattice is only searched with more candidates
+    auto &candidates = m_candidates[index];
+    if (m_total_candidates == 1) {
+        candidates.resize(1);
+        candidates[0] = {static_cast<char>('a' + i), 1.0f};
+        return;
+    }
+
+    // the output may be logits or already a distribution
+    float scores[26];
+    output.Dequantize(0, 26, scores);
+    float probabilities[26];
+    float total = 0.0f;
+    bool is_distribution = true;
+    for (int j = 0; j < 26; j++) {
+        const float v = scores[j];
+        is_distribution = is_distribution && (v >= 0.0f) && (v <= 1.0f);
+        total += v;
+    }
+    // quantized probabilities only sum to 1 within their rounding
+    const float tolerance = (output.type == TENSOR_FLOAT32) ? 1e-3f : std::max(1e-3f, 26.0f*output.scale);
+    is_distribution = is_distribution && (std::abs(total-1.0f) < tolerance);
+    if (is_distribution) {
+        std::copy(scores, scores+26, probabilities);
+    } else {
+        const float max_val = scores[i];
+        total = 0.0f;
+        for (int j = 0; j < 26; j++) {
+            probabilities[j] = std::exp(scores[j] - max_val);
+            total += probabilities[j];
+        }
+        for (int j = 0; j < 26; j++) {
+            probabilities[j] /= total;
+        }
+    }
+
+    candidates.resize(26);
+    for (int j = 0; j < 26; j++) {
+        candidates[j] = {static_cast<char>('a' + j), probabilities[j]};
+    }
+    std::partial_sort(
+        candidates.begin(), candidates.begin()+m_total_candidates, candidates.end(),
+        [](const wordblitz::LetterCandidate &a, const wordblitz::LetterCandidate &b) {
+            return a.probability > b.probability;
+        });
+    candidates.resize(m_total_candidates);
 }
 
-BonusesModel::BonusesModel(const char *filepath)
-: Model(filepath)
+BonusesModel::BonusesModel(const char *filepath, const ModelEngine engine)
+: Model(filepath, engine)
 {
     if (GetOutputSize() != 5) {
         throw std::runtime_error(fmt::format(
@@ -66,20 +109,21 @@ BonusesModel::BonusesModel(const char *filepath)
             GetOutputSize(), 5
         ));
     }
-    m_pred = wordblitz::CellModifier::MOD_NONE;
+    m_preds.assign(1, wordblitz::CellModifier::MOD_NONE);
 }
 
-void BonusesModel::Parse() {
-    Model::Parse();
-    int i = argmax(m_output_buffer, 5);
+void BonusesModel::ParseOutput(const ModelOutput &output, const int index) {
+    m_preds.resize(GetBatchSize(), wordblitz::CellModifier::MOD_NONE);
+    auto &pred = m_preds[index];
+    int i = output.ArgMax(0, 5);
     switch (i) {
-    case 0: m_pred = wordblitz::CellModifier::MOD_NONE; break;
-    case 1: m_pred = wordblitz::CellModifier::MOD_2L; break;
-    case 2: m_pred = wordblitz::CellModifier::MOD_2W; break;
-    case 3: m_pred = wordblitz::CellModifier::MOD_3L; break;
-    case 4: m_pred = wordblitz::CellModifier::MOD_3W; break;
+    case 0: pred = wordblitz::CellModifier::MOD_NONE; break;
+    case 1: pred = wordblitz::CellModifier::MOD_2L; break;
+    case 2: pred = wordblitz::CellModifier::MOD_2W; break;
+    case 3: pred = wordblitz::CellModifier::MOD_3L; break;
+    case 4: pred = wordblitz::CellModifier::MOD_3W; break;
     default:
-        m_pred = wordblitz::CellModifier::MOD_NONE; 
+        pred = wordblitz::CellModifier::MOD_NONE; 
         break;
     }
 }
\ No newline at end of file
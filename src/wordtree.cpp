@@ -1,6 +1,7 @@
 #include "wordtree.h"
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
 
 namespace wordtree {
 
@@ -40,6 +41,9 @@ void ReadWordTree(const char *buffer, const int buffer_size, NodePool &pool, con
             // pop the stack
             } else {
                 curr_node_index = node_stack[--stack_index];
+                auto &parent = pool.at(curr_node_index);
+                parent.max_depth = std::max(parent.max_depth, static_cast<uint8_t>(node.max_depth+1));
+                parent.subtree_mask |= node.subtree_mask;
             }
             continue;
         }
@@ -60,6 +64,8 @@ void ReadWordTree(const char *buffer, const int buffer_size, NodePool &pool, con
 
         uint8_t child_index = FindIndex(c);
         node.children[child_index] = pool_index;
+        node.child_mask |= (1u << child_index);
+        node.subtree_mask |= (1u << child_index);
         curr_node_index = pool_index;
         node_stack[++stack_index] = curr_node_index;
         pool_index++;
@@ -91,7 +97,11 @@ bool InsertWordTree(NodePool &pool, const char *word, const int length) {
     for (int i = 0; i < length; i++) {
         char c = word[i];
         auto &curr_node = pool.at(curr_node_index);
+        curr_node.max_depth = std::max(curr_node.max_depth, static_cast<uint8_t>(length-i));
         uint8_t child_index = FindIndex(c);
+        for (int j = i; j < length; j++) {
+            curr_node.subtree_mask |= (1u << FindIndex(word[j]));
+        }
         uint32_t next_node_index = curr_node.children[child_index];
         // already exists
         if (next_node_index != 0) {
@@ -102,6 +112,7 @@ bool InsertWordTree(NodePool &pool, const char *word, const int length) {
             // our reference may be invalid after the emplace since the pool could resize
             auto &new_curr_node = pool.at(curr_node_index);
             new_curr_node.children[child_index] = pool_index;
+            new_curr_node.child_mask |= (1u << child_index);
             curr_node_index = pool_index++;
         }
     }
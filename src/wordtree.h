@@ -16,6 +16,13 @@ uint8_t FindIndex(char c);
 
 struct Node {
     bool is_leaf = false;
+    // length of the longest word suffix below this node
+    // this is an upper bound since removals don't shrink it
+    uint8_t max_depth = 0;
+    // bit i is set if children[i] exists
+    uint32_t child_mask = 0;
+    // bit i is set if the letter with index i appears anywhere below this node
+    uint32_t subtree_mask = 0;
     uint32_t children[MAX_BRANCHES] = {0};
 };
 
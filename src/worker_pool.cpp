@@ -0,0 +1,117 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(const int total_threads)
+: m_generation(0),
+  m_is_stopping(false),
+  m_total_busy(0),
+  m_task(nullptr),
+  m_total_tasks(0),
+  m_next_task(0)
+{
+    SetTotalThreads(total_threads);
+}
+
+WorkerPool::~WorkerPool() {
+    StopThreads();
+}
+
+void WorkerPool::SetTotalThreads(const int total_threads) {
+    const size_t total_workers = static_cast<size_t>(std::max(0, total_threads-1));
+    if (total_workers == m_threads.size()) {
+        return;
+    }
+    StopThreads();
+    m_threads.reserve(total_workers);
+    for (size_t i = 0; i < total_workers; i++) {
+        m_threads.emplace_back(&WorkerPool::WorkerLoop, this, m_generation);
+    }
+}
+
+void WorkerPool::Run(const size_t total_tasks, const Task &task) {
+    if (total_tasks == 0) {
+        return;
+    }
+    {
+        auto lock = std::unique_lock(m_mutex);
+        m_task = &task;
+        m_total_tasks = total_tasks;
+        m_next_task = 0;
+        m_error = nullptr;
+    }
+
+    // a single task runs on the caller without waking the workers
+    const bool is_waking = !m_threads.empty() && (total_tasks > 1);
+    if (is_waking) {
+        {
+            auto lock = std::unique_lock(m_mutex);
+            m_total_busy = static_cast<int>(m_threads.size());
+            m_generation++;
+        }
+        m_start_cv.notify_all();
+    }
+
+    RunTasks();
+
+    auto lock = std::unique_lock(m_mutex);
+    if (is_waking) {
+        m_done_cv.wait(lock, [this]() { return m_total_busy == 0; });
+    }
+    m_task = nullptr;
+    if (m_error != nullptr) {
+        auto error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void WorkerPool::WorkerLoop(uint64_t generation) {
+    while (true) {
+        {
+            auto lock = std::unique_lock(m_mutex);
+            m_start_cv.wait(lock, [this, generation]() { return m_is_stopping || (m_generation != generation); });
+            if (m_is_stopping) {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        RunTasks();
+
+        auto lock = std::unique_lock(m_mutex);
+        m_total_busy--;
+        if (m_total_busy == 0) {
+            m_done_cv.notify_one();
+        }
+    }
+}
+
+void WorkerPool::RunTasks() {
+    while (true) {
+        const size_t i = m_next_task.fetch_add(1);
+        if (i >= m_total_tasks) {
+            break;
+        }
+        try {
+            (*m_task)(i);
+        } catch (...) {
+            auto lock = std::unique_lock(m_mutex);
+            if (m_error == nullptr) {
+                m_error = std::current_exception();
+            }
+        }
+    }
+}
+
+void WorkerPool::StopThreads() {
+    {
+        auto lock = std::unique_lock(m_mutex);
+        m_is_stopping = true;
+    }
+    m_start_cv.notify_all();
+    for (auto &thread: m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+    m_is_stopping = false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// threads which stay alive between runs, so a read doesn't start and join threads for every batch
+// the thread which calls Run also takes tasks, so a pool of n threads keeps n-1 workers
+class WorkerPool
+{
+public:
+    typedef std::function<void (const size_t)> Task;
+private:
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_start_cv;
+    std::condition_variable m_done_cv;
+    // each run bumps the generation to wake the workers
+    uint64_t m_generation;
+    bool m_is_stopping;
+    // workers which haven't finished the current run
+    int m_total_busy;
+
+    const Task *m_task;
+    size_t m_total_tasks;
+    std::atomic<size_t> m_next_task;
+    std::exception_ptr m_error;
+public:
+    WorkerPool(const int total_threads=1);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool &operator=(const WorkerPool&) = delete;
+
+    // restarts the workers if the number of threads changed, which can't be called during a run
+    void SetTotalThreads(const int total_threads);
+    inline int GetTotalThreads() const { return static_cast<int>(m_threads.size())+1; }
+    // calls the task with every index up to total_tasks across the threads and waits for all of them
+    // the first error is rethrown once every task has finished
+    void Run(const size_t total_tasks, const Task &task);
+private:
+    void WorkerLoop(uint64_t generation);
+    void RunTasks();
+    void StopThreads();
+};